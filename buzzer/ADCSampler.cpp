@@ -0,0 +1,152 @@
+/*
+  File:
+  ADCSampler.cpp
+
+  Description:
+  Samples the ADC channels Buzzer cares about (the internal 1.1V bandgap, used to work out Vcc, and
+  A0) in the background. Conversions are auto-triggered by the Timer0 overflow that already drives
+  millis(), and the ADC complete interrupt stores each result in a timestamped sample table and
+  switches the mux to the next channel.
+*/
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "ADCSampler.h"
+
+// Both channels are measured against AVcc, so switching channels never switches the reference.
+#if defined(__AVR_ATmega32U4__) || defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+  // MUX5 lives in ADCSRB on these parts and is 0 for both channels. A0 is ADC7 on the 32U4.
+  static const unsigned char channel_muxes[NUM_ADC_CHANNELS] = {
+    _BV(REFS0) | _BV(MUX4) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1),
+    _BV(REFS0) | _BV(MUX2) | _BV(MUX1) | _BV(MUX0)
+  };
+#else
+  static const unsigned char channel_muxes[NUM_ADC_CHANNELS] = {
+    _BV(REFS0) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1),
+    _BV(REFS0)
+  };
+#endif
+
+// The ISR needs to know which sampler to hand conversions to.
+static ADCSampler *active_sampler = NULL;
+
+ISR(ADC_vect) {
+  // must read ADCL first - it then locks ADCH
+  unsigned char low = ADCL;
+  unsigned char high = ADCH;
+  if (active_sampler != NULL) active_sampler->handleConversion((high << 8) | low);
+}
+
+/*
+ * Fills the sample table with one blocking conversion per channel, then hands the ADC over to the
+ * Timer0 auto-trigger and the ADC complete interrupt. Must be called once from setup() before any
+ * of the Get methods are used.
+*/
+
+void ADCSampler::begin() {
+  // Make sure no stale conversion lands in the table while it's being seeded.
+  ADCSRA &= ~(_BV(ADIE) | _BV(ADATE));
+  for (unsigned char channel = 0; channel < NUM_ADC_CHANNELS; channel++) {
+    selectChannel(channel);
+    // Wait for Vref to settle. This is the only settle delay left, and it only happens at boot.
+    delay(2);
+    convertBlocking();
+    _samples[channel].raw = convertBlocking();
+    _samples[channel].timestamp = millis();
+  }
+  _curr_channel = 0;
+  selectChannel(_curr_channel);
+  _is_settling = true;
+  active_sampler = this;
+  // Auto-trigger on Timer0 overflow (ADTS = 0b100), prescaler 128, interrupt on completion.
+  ADCSRB = (ADCSRB & ~(_BV(ADTS1) | _BV(ADTS0))) | _BV(ADTS2);
+  ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+}
+
+/*
+ * Called from the ADC complete ISR. Stores the conversion (unless it's the first one after a mux
+ * switch) and moves on to the next channel. The next conversion starts on the next Timer0 overflow,
+ * ~1ms later, which is plenty of time for the bandgap to settle.
+ *
+ * @input the raw 10 bit conversion result.
+*/
+
+void ADCSampler::handleConversion(unsigned int raw) {
+  if (_is_settling) {
+    _is_settling = false;
+    return;
+  }
+  _samples[_curr_channel].raw = raw;
+  _samples[_curr_channel].timestamp = millis();
+  _curr_channel = (_curr_channel + 1) % NUM_ADC_CHANNELS;
+  selectChannel(_curr_channel);
+  _is_settling = true;
+}
+
+/*
+ * Returns a copy of the latest sample for a channel.
+ *
+ * @input a channel ID from the adc_channels enum.
+ * @return the latest sample for that channel.
+*/
+
+ADCSample ADCSampler::GetSample(unsigned char channel) {
+  ADCSample sample;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    sample.raw = _samples[channel].raw;
+    sample.timestamp = _samples[channel].timestamp;
+  }
+  return sample;
+}
+
+/*
+ * Returns the latest raw conversion result for a channel.
+ *
+ * @input a channel ID from the adc_channels enum.
+ * @return the latest raw 10 bit conversion result for that channel.
+*/
+
+unsigned int ADCSampler::GetRaw(unsigned char channel) {
+  return GetSample(channel).raw;
+}
+
+/*
+ * From: https://provideyourown.com/2012/secret-arduino-voltmeter-measure-battery-voltage/
+ * Uses the latest sample of the internal 1.1V reference to calculate what Vcc is.
+ * When the Arduino is being powered by the lipo then Vcc is the lipo voltage. When the micro
+ * USB cable is plugged in the Vcc will be >= 5V.
+ *
+ * @return Vcc in mV.
+*/
+
+long ADCSampler::GetVcc() {
+  unsigned int raw = GetRaw(ADC_CHANNEL_VCC);
+  if (raw == 0) return 0;
+  return 1125300L / raw; // Calculate Vcc (in mV); 1125300 = 1.1*1023*1000
+}
+
+/*
+ * Points the ADC mux at the given channel.
+ *
+ * @input a channel ID from the adc_channels enum.
+*/
+
+void ADCSampler::selectChannel(unsigned char channel) {
+  ADMUX = channel_muxes[channel];
+}
+
+/*
+ * Runs one conversion on the currently selected channel and busy-polls until it's done. Only used
+ * by begin() to seed the sample table.
+ *
+ * @return the raw 10 bit conversion result.
+*/
+
+unsigned int ADCSampler::convertBlocking() {
+  ADCSRA |= _BV(ADSC); // Start conversion
+  while (bit_is_set(ADCSRA,ADSC)); // measuring
+  unsigned char low = ADCL;
+  unsigned char high = ADCH;
+  return (high << 8) | low;
+}
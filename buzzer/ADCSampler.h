@@ -0,0 +1,42 @@
+/*
+  File:
+  ADCSampler.h
+
+  Description:
+  Samples the ADC channels Buzzer cares about (the internal 1.1V bandgap, used to work out Vcc, and
+  A0) in the background. Conversions are auto-triggered by the Timer0 overflow that already drives
+  millis(), and the ADC complete interrupt stores each result in a timestamped sample table and
+  switches the mux to the next channel. Callers read the cached samples, so nobody has to wait for
+  the reference to settle or busy-poll ADSC anymore.
+*/
+
+#ifndef ADCSAMPLER_H
+#define ADCSAMPLER_H
+
+#include <Arduino.h>
+
+// IDs of the channels that get sampled. The order is the order they are sampled in.
+enum adc_channels {ADC_CHANNEL_VCC, ADC_CHANNEL_A0, NUM_ADC_CHANNELS};
+
+struct ADCSample {
+  unsigned int raw;
+  unsigned long timestamp;
+};
+
+class ADCSampler {
+  private:
+    volatile ADCSample _samples[NUM_ADC_CHANNELS];
+    volatile unsigned char _curr_channel = 0;
+    // The first conversion after the mux has been switched is thrown away.
+    volatile bool _is_settling = true;
+    void selectChannel(unsigned char channel);
+    unsigned int convertBlocking();
+  public:
+    void begin();
+    void handleConversion(unsigned int raw);
+    ADCSample GetSample(unsigned char channel);
+    unsigned int GetRaw(unsigned char channel);
+    long GetVcc();
+};
+
+#endif
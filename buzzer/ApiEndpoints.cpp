@@ -0,0 +1,80 @@
+/*
+  File:
+  ApiEndpoints.cpp
+
+  Description:
+  Registry of the buzzer_api endpoints. See ApiEndpoints.h.
+*/
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include "ApiEndpoints.h"
+
+static const char get_new_buzzer_name_path[] PROGMEM = "get_new_buzzer_name";
+static const char is_buzzer_registered_path[] PROGMEM = "is_buzzer_registered";
+static const char get_available_party_path[] PROGMEM = "get_available_party";
+static const char accept_party_path[] PROGMEM = "accept_party";
+static const char claim_party_path[] PROGMEM = "claim_party";
+static const char heartbeat_path[] PROGMEM = "heartbeat";
+
+// Indexed by api_endpoints.
+static const char *const api_paths[NUM_API_ENDPOINTS] PROGMEM = {
+  get_new_buzzer_name_path,
+  is_buzzer_registered_path,
+  get_available_party_path,
+  accept_party_path,
+  claim_party_path,
+  heartbeat_path
+};
+
+/*
+ * @input the record store the base URL is kept in.
+*/
+
+ApiEndpoints::ApiEndpoints(EEPROMRecordStore *store) : _store(store) {
+  strcpy_P(_config.base_url, PSTR(DEFAULT_API_BASE_URL));
+}
+
+/*
+ * Loads the base URL from the EEPROM. Falls back to DEFAULT_API_BASE_URL if none was ever set.
+*/
+
+void ApiEndpoints::Begin() {
+  if (!_store->Begin() || !_store->Read(&_config) || _config.base_url[0] == '\0') {
+    strcpy_P(_config.base_url, PSTR(DEFAULT_API_BASE_URL));
+  }
+  _config.base_url[LONGEST_API_BASE_URL] = '\0';
+}
+
+/*
+ * Points the Buzzer at another backend and stores the base URL in the EEPROM.
+ *
+ * @input the base URL, ending in a '/'. An empty string goes back to DEFAULT_API_BASE_URL.
+ * @return false if the base URL is too long, true otherwise.
+*/
+
+bool ApiEndpoints::SetBaseURL(const char *base_url) {
+  if (strlen(base_url) > LONGEST_API_BASE_URL) return false;
+  memset(&_config, 0, sizeof(_config));
+  strcpy(_config.base_url, base_url);
+  _store->Write(&_config);
+  if (_config.base_url[0] == '\0') strcpy_P(_config.base_url, PSTR(DEFAULT_API_BASE_URL));
+  return true;
+}
+
+/*
+ * @return the base URL all endpoint paths are relative to.
+*/
+
+const char *ApiEndpoints::BaseURL() {
+  return _config.base_url;
+}
+
+/*
+ * @input an id from the api_endpoints enum.
+ * @return the path of the endpoint.
+*/
+
+FlashStrPtr ApiEndpoints::Path(unsigned char endpoint) {
+  return (FlashStrPtr) pgm_read_word(&api_paths[endpoint]);
+}
@@ -0,0 +1,42 @@
+/*
+  File:
+  ApiEndpoints.h
+
+  Description:
+  Registry of the buzzer_api endpoints. Every URL the Buzzer requests is a base URL followed by an
+  endpoint path. The paths are short PROGMEM strings looked up by id, and the base URL is kept in
+  its own EEPROMRecordStore so a Buzzer can be pointed at a local or staging backend over USB
+  serial (see read_serial_commands() in buzzer.ino) without reflashing. An empty store means the
+  production backend.
+*/
+
+#ifndef APIENDPOINTS_H
+#define APIENDPOINTS_H
+
+#include "Helpers.h"
+#include "EEPROMRecordStore.h"
+
+#define DEFAULT_API_BASE_URL "http://restaur-anteater.herokuapp.com/buzzer_api/"
+#define LONGEST_API_BASE_URL 59
+
+// Ids of the endpoints, used to look their paths up.
+enum api_endpoints {API_GET_NEW_BUZZER_NAME, API_IS_BUZZER_REGISTERED, API_GET_AVAILABLE_PARTY,
+                    API_ACCEPT_PARTY, API_CLAIM_PARTY, API_HEARTBEAT, NUM_API_ENDPOINTS};
+
+struct ApiConfig {
+  char base_url[LONGEST_API_BASE_URL+1];
+};
+
+class ApiEndpoints {
+  private:
+    EEPROMRecordStore *_store;
+    ApiConfig _config;
+  public:
+    ApiEndpoints(EEPROMRecordStore *store);
+    void Begin();
+    bool SetBaseURL(const char *base_url);
+    const char *BaseURL();
+    FlashStrPtr Path(unsigned char endpoint);
+};
+
+#endif
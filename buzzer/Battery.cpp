@@ -0,0 +1,67 @@
+/*
+  File:
+  Battery.cpp
+
+  Description:
+  Turns lipo voltages into a state of charge percentage. Uses a LiPo discharge curve stored in
+  PROGMEM and linear interpolation between its points. Everything is integer math so no float
+  routines get linked in.
+*/
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include "Battery.h"
+
+struct CurvePoint {
+  int cell_mv;
+  short percentage;
+};
+
+// Resting voltage of a single LiPo cell vs state of charge, highest voltage first.
+static const CurvePoint lipo_curve[] PROGMEM = {
+  {4200, 100}, {4150, 95}, {4110, 90}, {4080, 85}, {4020, 80}, {3980, 75}, {3950, 70},
+  {3910, 65}, {3870, 60}, {3850, 55}, {3840, 50}, {3820, 45}, {3800, 40}, {3790, 35},
+  {3770, 30}, {3750, 25}, {3730, 20}, {3710, 15}, {3690, 10}, {3610, 5}, {3270, 0}
+};
+
+#define LIPO_CURVE_LEN (sizeof(lipo_curve) / sizeof(lipo_curve[0]))
+
+/*
+ * Looks up the state of charge of a single LiPo cell on the discharge curve.
+ *
+ * @input the resting voltage of the cell in mV.
+ * @return the state of charge as a percentage in [0, 100].
+*/
+
+short BatteryCellMVToPercentage(int cell_mv) {
+  int upper_mv = pgm_read_word(&lipo_curve[0].cell_mv);
+  if (cell_mv >= upper_mv) return 100;
+  short upper_percentage = 100;
+  for (unsigned char i = 1; i < LIPO_CURVE_LEN; i++) {
+    int lower_mv = pgm_read_word(&lipo_curve[i].cell_mv);
+    short lower_percentage = pgm_read_word(&lipo_curve[i].percentage);
+    if (cell_mv >= lower_mv) {
+      // Linear interpolation between the two points, rounded to the nearest percent.
+      long span_mv = upper_mv - lower_mv;
+      long offset = (long) (cell_mv - lower_mv) * (upper_percentage - lower_percentage);
+      return lower_percentage + (offset + span_mv / 2) / span_mv;
+    }
+    upper_mv = lower_mv;
+    upper_percentage = lower_percentage;
+  }
+  return 0;
+}
+
+/*
+ * Adds back the voltage sag caused by the cell radio so a loaded cell can be looked up on the
+ * resting curve.
+ *
+ * @input the measured voltage of a cell in mV.
+ * @input whether the cell radio has been transmitting recently.
+ * @return the estimated resting voltage of the cell in mV.
+*/
+
+int CompensateBatteryMVForLoad(int cell_mv, bool is_radio_active) {
+  if (is_radio_active) return cell_mv + BATT_RADIO_ACTIVE_SAG_MV;
+  return cell_mv;
+}
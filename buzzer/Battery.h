@@ -0,0 +1,21 @@
+/*
+  File:
+  Battery.h
+
+  Description:
+  Turns lipo voltages into a state of charge percentage. Uses a LiPo discharge curve stored in
+  PROGMEM and linear interpolation between its points. Everything is integer math so no float
+  routines get linked in.
+*/
+
+#ifndef BATTERY_H
+#define BATTERY_H
+
+// How much (in mV) the FONA lipo sags while the cell radio has recently been transmitting. The
+// curve is for a resting cell, so this gets added back to the FONA lipo's samples.
+#define BATT_RADIO_ACTIVE_SAG_MV 40
+
+short BatteryCellMVToPercentage(int cell_mv);
+int CompensateBatteryMVForLoad(int cell_mv, bool is_radio_active);
+
+#endif
@@ -0,0 +1,69 @@
+/*
+  File:
+  Board.h
+
+  Description:
+  Compile time description of the pins the firmware drives directly, one Board specialization
+  per PCB version (see Version.h). These are the button polled every loop and the FONA and Arduino
+  reset lines. Each one is a FastPin, so every access compiles down to a single sbi/cbi/in
+  instruction instead of digitalRead()/digitalWrite() looking the pin up in tables at runtime. The
+  button's polarity is folded in at compile time too.
+
+  The pin numbers in Pins.h are still what pinMode(), analogWrite(), the PowerManager wake pin and
+  the rest of the Arduino API use. The two have to agree (Arduino Leonardo numbering for the
+  ATmega32U4, e.g. pin 8 is PB4).
+*/
+
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <avr/io.h>
+#include "Version.h"
+
+// I/O addresses of the ATmega32U4 PINx registers. The DDRx and PORTx registers follow at +1 and +2.
+#define PINB_IO_ADDR 0x03
+#define PINC_IO_ADDR 0x06
+
+// One GPIO pin. The addresses are template arguments so the compiler sees constant low I/O
+// addresses and emits single instructions.
+template <unsigned char pin_addr, unsigned char bit, bool is_active_low = false>
+struct FastPin {
+  static const unsigned char PIN_ADDR = pin_addr;
+  static const unsigned char DDR_ADDR = pin_addr + 1;
+  static const unsigned char PORT_ADDR = pin_addr + 2;
+  static const unsigned char MASK = _BV(bit);
+  static const bool IS_ACTIVE_LOW = is_active_low;
+
+  static inline void SetOutput() { _SFR_IO8(DDR_ADDR) |= MASK; }
+  static inline void SetInput() { _SFR_IO8(DDR_ADDR) &= (unsigned char) ~MASK; }
+  // For an input these turn the internal pull up on and off.
+  static inline void SetHigh() { _SFR_IO8(PORT_ADDR) |= MASK; }
+  static inline void SetLow() { _SFR_IO8(PORT_ADDR) &= (unsigned char) ~MASK; }
+  static inline bool IsHigh() { return _SFR_IO8(PIN_ADDR) & MASK; }
+  // true if the pin is at its active level (low for an active low pin).
+  static inline bool IsActive() { return IsHigh() != is_active_low; }
+};
+
+template <int board_type> struct Board;
+
+template <> struct Board<V2> {
+  // Pin 8, pulled up and shorted to ground when pressed.
+  typedef FastPin<PINB_IO_ADDR, 4, true> Button;
+  // Pin 13.
+  typedef FastPin<PINC_IO_ADDR, 7> FonaRst;
+  // Pin 10, wired to the Arduino's RESET. Driving it low resets the Buzzer.
+  typedef FastPin<PINB_IO_ADDR, 6> ArduinoRst;
+};
+
+template <> struct Board<V1> : Board<V2> {};
+
+// No FONA reset line on this one.
+template <> struct Board<JANKBOARD> {
+  // Pin 8, high when pressed.
+  typedef FastPin<PINB_IO_ADDR, 4> Button;
+  typedef FastPin<PINB_IO_ADDR, 6> ArduinoRst;
+};
+
+typedef Board<BOARD_TYPE> ThisBoard;
+
+#endif
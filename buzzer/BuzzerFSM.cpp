@@ -25,11 +25,15 @@ BuzzerFSM::BuzzerFSM(State initial_state, int initial_state_id): _curr_state_id(
 /*
  * Calls the state_func associated with the current state.
  *
- * If this state was just transitioned to, the state start time is set to the current time.
+ * If this state was just transitioned to, the state start time is set to the current time and the
+ * enter_func of the state is run.
 */
 
 int BuzzerFSM::DoState() {
-  if (_state_start_time == NEW_STATE) _state_start_time = millis();
+  if (_state_start_time == NEW_STATE) {
+    _state_start_time = millis();
+    EnterState();
+  }
   return _states[_curr_state_id].state_func(_state_start_time, _num_iterations_in_state);
 }
 
@@ -41,15 +45,18 @@ int BuzzerFSM::DoState() {
 */
 
 void BuzzerFSM::TransitionToNextState(int do_state_ret_val) {
-  int prev_state = _curr_state_id;
-  if (do_state_ret_val == SUCCESS) _curr_state_id = _states[_curr_state_id].next_state_success;
-  if (do_state_ret_val == ERROR) _curr_state_id = _states[_curr_state_id].next_state_failure;
-  if (do_state_ret_val == TIMEOUT) _curr_state_id = _states[_curr_state_id].next_state_timeout;
-  if (prev_state == _curr_state_id) {
+  int next_state = _curr_state_id;
+  if (do_state_ret_val == SUCCESS) next_state = _states[_curr_state_id].next_state_success;
+  if (do_state_ret_val == ERROR) next_state = _states[_curr_state_id].next_state_failure;
+  if (do_state_ret_val == TIMEOUT) next_state = _states[_curr_state_id].next_state_timeout;
+  if (next_state == _curr_state_id) {
     // State is being repeated so increment _num_iterations_in_state.
     _num_iterations_in_state++;
   } else {
-    // FSM is transition to a new state so clear _num_iterations_in_state and _state_start_time
+    // FSM is transition to a new state so run the exit_func of the old state and clear
+    // _num_iterations_in_state and _state_start_time
+    ExitState();
+    _curr_state_id = next_state;
     _num_iterations_in_state = 0;
     _state_start_time = NEW_STATE;
   }
@@ -108,11 +115,44 @@ void BuzzerFSM::LongButtonPress() {
 */
 
 void BuzzerFSM::ForceState(int new_state_id) {
+  // Only states that have actually been entered get exited.
+  if (_state_start_time != NEW_STATE) ExitState();
   _state_start_time = NEW_STATE;
   _num_iterations_in_state = 0;
   _curr_state_id = new_state_id;
 }
 
+/*
+ * Puts the FSM in the state with the given ID, as if it had just been transitioned to there. For
+ * tools/serial_replay, which starts the replay of a recorded run at a SERIAL_LOG_STATE marker.
+ *
+ * @input the ID of the state to start at.
+*/
+
+void BuzzerFSM::StartAt(int state_id) {
+  ForceState(state_id);
+}
+
+/*
+ * Runs the enter_func of the current state, if it has one. With SERIAL_LOG the state entry is
+ * marked in the FONA serial log first, so tools/serial_replay can start from there.
+*/
+
+void BuzzerFSM::EnterState() {
+#if SERIAL_LOG
+  fona_serial.MarkState(_curr_state_id);
+#endif
+  if (_states[_curr_state_id].enter_func != NULL) _states[_curr_state_id].enter_func();
+}
+
+/*
+ * Runs the exit_func of the current state, if it has one.
+*/
+
+void BuzzerFSM::ExitState() {
+  if (_states[_curr_state_id].exit_func != NULL) _states[_curr_state_id].exit_func();
+}
+
 /*
  * Called by loop() in buzzer.ino when low cell reception has been detected.
  *
@@ -124,6 +164,14 @@ void BuzzerFSM::LowCellReception() {
   if (_curr_state_id == IDLE || _curr_state_id == HEARTBEAT) ForceState(LOW_CELL_RECEPTION);
 }
 
+/*
+ * @return the ID of the state the FSM is in.
+*/
+
+int BuzzerFSM::CurrentStateId() {
+  return _curr_state_id;
+}
+
 /*
  * Adds a state to the FSM.
  *
@@ -138,10 +186,13 @@ void BuzzerFSM::AddState(State state_to_add, int state_id) {
 
 /*
  * Actual performs the work for the current state and then calls TransitionToNextState based
- * on the return value of the state work function.
+ * on the return value of the state work function. The stack used meanwhile (exit_func included)
+ * goes to the current state in stack_monitor, anything outside of it to STACK_SLOT_LOOP.
 */
 
 void BuzzerFSM::ProcessState() {
+  stack_monitor.Attribute(_curr_state_id);
   int ret_val = DoState();
   TransitionToNextState(ret_val);
+  stack_monitor.Attribute(STACK_SLOT_LOOP);
 }
@@ -16,17 +16,26 @@
 // parameters are how long the FSM has been in that state and the int is the number of iterations
 // that the state has been repeated. This function will return SUCCESS, TIMEOUT, ERROR, or
 // REPEAT (defined as an enum in Globals.h). State transitions are made based on this return value.
+//
+// enter_func and exit_func are optional (leave them out of the initializer and they are NULL).
+// enter_func is called exactly once right before the first state_func call after the state has been
+// transitioned to, exit_func is called exactly once when the FSM leaves the state. One-time work
+// (drawing the static parts of a screen, stopping the motor) belongs in these so state_func only
+// has to do the incremental work each iteration.
 struct State {
   int next_state_success;
   int next_state_failure;
   int next_state_timeout;
   int (*state_func)(unsigned long, int);
+  void (*enter_func)();
+  void (*exit_func)();
 };
 
 // enum that contains all the possible state IDs.
 enum state_ids {INIT, INIT_FONA, INIT_GPRS, GET_BUZZER_NAME, IDLE, CHECK_BUZZER_REGISTRATION,
                 WAIT_BUZZER_REGISTRATION, GET_AVAILABLE_PARTY, ACCEPT_AVAILABLE_PARTY, HEARTBEAT,
-                BUZZ, CHARGING, SHUTDOWN, SLEEP, FATAL_ERROR, LOW_CELL_RECEPTION, WAKEUP};
+                BUZZ, CHARGING, SHUTDOWN, SLEEP, FATAL_ERROR, LOW_CELL_RECEPTION, WAKEUP,
+                RESUME_FONA, WAIT_NETWORK, NUM_STATES};
 
 // _state_start_time is set to this after a state has been
 // transitioned to. This is not a private class variable to save space.
@@ -39,10 +48,12 @@ class BuzzerFSM {
     unsigned long _state_start_time = 0;
     int _num_iterations_in_state = 0;
     int _curr_state_id;
-    State _states[WAKEUP+1];
+    State _states[NUM_STATES];
     int DoState();
     void TransitionToNextState(int do_state_ret_val);
     void ForceState(int new_state_id);
+    void EnterState();
+    void ExitState();
   public:
     void AddState(State state_to_add, int state_id);
     void ProcessState();
@@ -51,6 +62,8 @@ class BuzzerFSM {
     void USBCablePluggedIn();
     void USBCableUnplugged();
     void LowCellReception();
+    void StartAt(int state_id);
+    int CurrentStateId();
     BuzzerFSM(State initial_state, int initial_state_id);
     BuzzerFSM(){};
 };
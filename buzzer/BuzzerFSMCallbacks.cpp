@@ -7,30 +7,176 @@
   BuzzerFSM::DoState.
 */
 
-#include <ArduinoJson.h>
 #include "BuzzerFSMCallbacks.h"
 #include "Globals.h"
 #include "BuzzerFSM.h"
 #include "EEPROMReadWrite.h"
+#include "HeartbeatCadence.h"
+#include "Board.h"
+#include "JsonExtractor.h"
+
+// Decides when HEARTBEAT pings the API next.
+static HeartbeatCadence heartbeat_cadence;
+
+// Used in states that are meant to be repeated multiple times without error. This int and the
+// corresponding macro allow a state to keep track of how many times it has errored. If a state
+// doesn't normally repeat and is only meant to be run once before transition, we can just return
+// repeat and check if num_iterations_in_state is greater than MAX_RETRIES. States that are meant to
+// be run more than once can't do that, hence this int and macro. This is a little janky as this
+// probably should be something that BuzzerFSM handles but I elected to do this as a band-aid as
+// to not add additional complications to BuzzerFSM when only a few states need to use this.
+static int num_iterations_in_error = 0;
+#define CHECK_ERR_IN_INTERATION(err, val_when_err) \
+  if (err == val_when_err) { \
+      if (num_iterations_in_error >= MAX_RETRIES) return ERROR; \
+      num_iterations_in_error++; \
+      return REPEAT; \
+  } \
+  num_iterations_in_error = 0; \
+
+static int IsBuzzerRegistered(bool *is_buzzer_registered);
+static int APIPOST(unsigned char endpoint, char *body, int body_size, JsonExtractor *reply);
+static int APIPOSTBuzzerName(unsigned char endpoint, JsonExtractor *reply, bool is_buzzing);
+
+// The fields of each API reply the callbacks look at. See JsonExtractor.h.
+struct ErrorReply {
+  bool error;
+};
+
+static const JsonField error_reply_fields[] PROGMEM = {
+  JSON_FIELD(ErrorReply, error, ERROR_STATUS_FIELD, JSON_BOOL)
+};
+
+struct BuzzerNameReply {
+  bool error;
+  char buzzer_name[LONGEST_BUZZER_NAME+1];
+};
+
+static const JsonField buzzer_name_reply_fields[] PROGMEM = {
+  JSON_FIELD(BuzzerNameReply, error, ERROR_STATUS_FIELD, JSON_BOOL),
+  JSON_FIELD(BuzzerNameReply, buzzer_name, BUZZER_NAME_FIELD, JSON_STRING)
+};
+
+struct RegistrationReply {
+  bool error;
+  bool is_registered;
+};
+
+static const JsonField registration_reply_fields[] PROGMEM = {
+  JSON_FIELD(RegistrationReply, error, ERROR_STATUS_FIELD, JSON_BOOL),
+  JSON_FIELD(RegistrationReply, is_registered, IS_BUZZER_REGISTERED_FIELD, JSON_BOOL)
+};
+
+struct AvailPartyReply {
+  bool error;
+  bool is_party_avail;
+  short wait_time;
+  int party_id;
+  char party_name[LONGEST_PARTY_NAME+1];
+};
+
+static const JsonField avail_party_reply_fields[] PROGMEM = {
+  JSON_FIELD(AvailPartyReply, error, ERROR_STATUS_FIELD, JSON_BOOL),
+  JSON_FIELD(AvailPartyReply, is_party_avail, PARTY_AVAIL_FIELD, JSON_BOOL),
+  JSON_FIELD(AvailPartyReply, wait_time, PARTY_WAIT_TIME_FIELD, JSON_INT),
+  JSON_FIELD(AvailPartyReply, party_id, PARTY_ID_FIELD, JSON_INT),
+  JSON_FIELD(AvailPartyReply, party_name, PARTY_NAME_FIELD, JSON_STRING)
+};
+
+struct HeartbeatReply {
+  bool error;
+  bool is_active;
+  bool buzz;
+  long retry_after;
+  unsigned int state_version;
+};
+
+static const JsonField heartbeat_reply_fields[] PROGMEM = {
+  JSON_FIELD(HeartbeatReply, error, ERROR_STATUS_FIELD, JSON_BOOL),
+  JSON_FIELD(HeartbeatReply, is_active, IS_ACTIVE_FIELD, JSON_BOOL),
+  JSON_FIELD(HeartbeatReply, buzz, BUZZ_FIELD, JSON_BOOL),
+  JSON_FIELD(HeartbeatReply, retry_after, RETRY_AFTER_FIELD, JSON_INT),
+  JSON_FIELD(HeartbeatReply, state_version, STATE_VERSION_FIELD, JSON_INT)
+};
+
+// The last full heartbeat reply. Stands in for the reply when the API answers with a 304, which
+// means nothing changed since the reply with the version in request_bodies.
+static HeartbeatReply last_heartbeat_reply;
+
+// Set after a warm boot skipped CHECK_BUZZER_REGISTRATION. IDLE asks the API once the screen is up
+// and a successful heartbeat also counts as proof that the Buzzer is still registered.
+static bool is_registration_unverified = false;
 
 /*
- * The intial state of the Buzzer FSM. Displays "BUZZER" on the OLED for 5 seconds then proceeds.
+ * Updates the registration status in the boot snapshot. Only touches the EEPROM if it changed.
+ *
+ * @input whether the Buzzer is registered with the backend.
+*/
+
+void SetBootSnapshotRegistered(bool is_registered) {
+  is_registration_unverified = false;
+  if (boot_snapshot.is_registered == is_registered) return;
+  boot_snapshot.is_registered = is_registered;
+  EEPROMWriteBootSnapshot(&boot_snapshot);
+}
+
+/*
+ * Enter function for INIT. Displays "BUZZER" on the OLED.
+*/
+
+void InitEnterFunc() {
+  oled.set1X();
+  DISPLAY_MESSAGE_FLASH("BUZZER");
+}
+
+/*
+ * The intial state of the Buzzer FSM. Waits SPLASH_MS with "BUZZER" on the OLED then proceeds. The
+ * FONA reset and the motor test were started by setup() and go on meanwhile. On a warm boot (see
+ * setup() in buzzer.ino) the splash is skipped.
  *
  * @input how long the FSM has been in the current state.
  * @input how many iterations the FSM has been in the current state.
- * @return SUCCESS always.
+ * @return TIMEOUT on a warm boot, SUCCESS otherwise.
 */
 
 int InitFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  if (num_iterations_in_state == 0){
-    oled.clear();
-    oled.set1X();
-    OLED_PRINTLN_FLASH("BUZZER");
-  }
-  delay(5000);
+  if (is_warm_boot) return TIMEOUT;
+  delay(SPLASH_MS);
   return SUCCESS;
 }
 
+/*
+ * Enter function for RESUME_FONA.
+*/
+
+void ResumeFonaShieldEnterFunc() {
+  DISPLAY_MESSAGE_FLASH("Reconnecting.....");
+}
+
+/*
+ * Warm boot replacement for INIT_FONA, INIT_GPRS and CHECK_BUZZER_REGISTRATION. Reuses the FONA
+ * and its GPRS connection if they survived the reset. Registration is rechecked later by IDLE.
+ *
+ * @input how long the FSM has been in the current state.
+ * @input how many iterations the FSM has been in the current state.
+ * @return SUCCESS if the FONA is ready for HTTP requests, ERROR if it needs the full init.
+*/
+
+int ResumeFonaShieldFunc(unsigned long state_start_time, int num_iterations_in_state) {
+  if (!(boot_snapshot.modem_flags & MODEM_GPRS_UP) || !fona_shield.resumeShield()) return ERROR;
+  is_registration_unverified = true;
+  return SUCCESS;
+}
+
+/*
+ * Enter function for INIT_FONA.
+*/
+
+void InitFonaShieldEnterFunc() {
+  oled.set1X();
+  DISPLAY_MESSAGE_FLASH("Initializing\ncell modem.....");
+}
+
 /*
  * State function that tries to initialize the cell radio (FONA). It tries to intialize the
  * radio for MAX_RETRIES number of times before failing.
@@ -43,14 +189,8 @@ int InitFunc(unsigned long state_start_time, int num_iterations_in_state) {
 */
 
 int InitFonaShieldFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  if (num_iterations_in_state == 0) {
-    oled.clear();
-    oled.set1X();
-    OLED_PRINTLN_FLASH("Initializing\ncell modem.....");
-  }
   if (num_iterations_in_state >= MAX_RETRIES) {
-    oled.clear();
-    OLED_PRINTLN_FLASH("Failed to initialize\ncell modem.");
+    DISPLAY_MESSAGE_FLASH("Failed to initialize\ncell modem.");
     delay(10000);
     return ERROR;
   }
@@ -61,6 +201,42 @@ int InitFonaShieldFunc(unsigned long state_start_time, int num_iterations_in_sta
   return SUCCESS;
 }
 
+/*
+ * Enter function for WAIT_NETWORK.
+*/
+
+void WaitNetworkEnterFunc() {
+  DISPLAY_MESSAGE_FLASH("Waiting for cell\nnetwork.....");
+}
+
+/*
+ * Waits for the FONA to register with the cell network, which it does on its own once it has
+ * booted. GPRS can't be attached before that, and asking is much quicker than letting
+ * enableGPRS() fail until then, so INIT_GPRS starts as soon as the network is there.
+ *
+ * @input how long the FSM has been in the current state.
+ * @input how many iterations the FSM has been in the current state.
+ * @return SUCCESS once the FONA is registered, REPEAT while it isn't, and TIMEOUT if it still
+ * isn't after NETWORK_REG_TIMEOUT (INIT_GPRS then retries as usual).
+*/
+
+int WaitNetworkFunc(unsigned long state_start_time, int num_iterations_in_state) {
+  if (fona_shield.IsRegistered()) return SUCCESS;
+  if (millis() - state_start_time >= NETWORK_REG_TIMEOUT) return TIMEOUT;
+  delay(250);
+  return REPEAT;
+}
+
+/*
+ * Enter function for INIT_GPRS.
+*/
+
+void InitGPRSEnterFunc() {
+  fona_shield.SetPowerState(MODEM_ACTIVE);
+  oled.set1X();
+  DISPLAY_MESSAGE_FLASH("Initializing GPRS.....");
+}
+
 /*
  * Configures the cell radio for GPRS usage. This function tries to enable GPRS for MAX_RETRIES
  * number of times before failing.
@@ -73,14 +249,8 @@ int InitFonaShieldFunc(unsigned long state_start_time, int num_iterations_in_sta
 */
 
 int InitGPRSFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  if (num_iterations_in_state == 0) {
-    oled.clear();
-    oled.set1X();
-    OLED_PRINTLN_FLASH("Initializing GPRS.....");
-  }
   if (num_iterations_in_state >= MAX_RETRIES) {
-    oled.clear();
-    OLED_PRINTLN_FLASH("Failed to initialize\nGPRS connection.");
+    DISPLAY_MESSAGE_FLASH("Failed to initialize\nGPRS connection.");
     delay(10000);
     return ERROR;
   }
@@ -91,6 +261,14 @@ int InitGPRSFunc(unsigned long state_start_time, int num_iterations_in_state) {
   return SUCCESS;
 }
 
+/*
+ * Enter function for GET_BUZZER_NAME.
+*/
+
+void GetBuzzerNameEnterFunc() {
+  DISPLAY_MESSAGE_FLASH("Getting a name.....");
+}
+
 /*
  * If the Buzzer is being powered up for the first time, it needs a name. This function pings the
  * API and gets a name for the buzzer.
@@ -101,64 +279,138 @@ int InitGPRSFunc(unsigned long state_start_time, int num_iterations_in_state) {
 */
 
 int GetBuzzerNameFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  oled.clear();
-  OLED_PRINTLN_FLASH("Getting a name.....");
-  char buf[BUF_LENGTH_MEDIUM];
-  int err = fona_shield.HTTPGETOneLine(F("http://restaur-anteater.herokuapp.com/buzzer_api/get_new_buzzer_name"), buf, sizeof(buf));
+  BuzzerNameReply reply;
+  JsonExtractor extractor(buzzer_name_reply_fields, JSON_NUM_FIELDS(buzzer_name_reply_fields), &reply);
+  int err = fona_shield.HTTPGETJSON(api_endpoints.BaseURL(), api_endpoints.Path(API_GET_NEW_BUZZER_NAME), &extractor);
   if (err == ERROR) return (num_iterations_in_state < MAX_RETRIES) ? REPEAT : ERROR;
-  StaticJsonBuffer<BUF_LENGTH_MEDIUM> jsonBuffer;
-  JsonObject& root = jsonBuffer.parseObject(buf);
-  if (root[ERROR_STATUS_FIELD]) return (num_iterations_in_state < MAX_RETRIES) ? REPEAT : ERROR;
-  const char *buzzer_name = root[BUZZER_NAME_FIELD];
-  strncpy(eeprom_data.buzzer_name, buzzer_name, sizeof(eeprom_data.buzzer_name));
+  if (reply.error || reply.buzzer_name[0] == '\0') return (num_iterations_in_state < MAX_RETRIES) ? REPEAT : ERROR;
+  strncpy(eeprom_data.buzzer_name, reply.buzzer_name, sizeof(eeprom_data.buzzer_name));
+  request_bodies.SetBuzzerName(eeprom_data.buzzer_name);
   EEPROMWrite(&eeprom_data);
+  SetBootSnapshotRegistered(false);
   return SUCCESS;
 }
 
+// Screens used by the states that stay up for a long time. See Display.h.
+static const char buzzer_name_label[] PROGMEM = "Buzzer name:";
+static const char party_name_label[] PROGMEM = "Party name:";
+static const char charging_label[] PROGMEM = "Charging.....";
+static const char battery_label[] PROGMEM = "Battery: ";
+
+static const ScreenRow idle_screen[] PROGMEM = {
+  {DISPLAY_NO_FIELD, 0, buzzer_name_label},
+  {DISPLAY_BUZZER_NAME, 1, NULL},
+  {DISPLAY_BATTERY, 2, battery_label},
+  {DISPLAY_END_OF_SCREEN, 0, NULL}
+};
+
+static const ScreenRow party_screen[] PROGMEM = {
+  {DISPLAY_NO_FIELD, 0, party_name_label},
+  {DISPLAY_PARTY_NAME, 1, NULL},
+  {DISPLAY_BATTERY, 2, battery_label},
+  {DISPLAY_STATUS, 3, NULL},
+  {DISPLAY_END_OF_SCREEN, 0, NULL}
+};
+
+static const ScreenRow charging_screen[] PROGMEM = {
+  {DISPLAY_NO_FIELD, 0, charging_label},
+  {DISPLAY_BATTERY, 1, battery_label},
+  {DISPLAY_END_OF_SCREEN, 0, NULL}
+};
+
+// Vibration patterns. See Haptics.h.
+const HapticStep double_buzz_pattern[] PROGMEM = {
+  {255, 30, false},
+  {0, 30, false},
+  {255, 30, false},
+  {0, 0, false}
+};
+
+// Played over and over in BUZZ. A short ramp up takes the edge off the start of every pulse.
+static const HapticStep table_ready_pattern[] PROGMEM = {
+  {255, 10, true},
+  {255, 190, false},
+  {0, 100, false},
+  {0, 0, false}
+};
+
 /*
- * This helper function writes the battery percentage on the given row every 1000 state iterations.
- * For states like IDLE or HEARTBEAT that are called repeatedly this happens fairly quickly but
- * might needs some tweaking.
- *
- * @input the OLED row the battery percentage should be displayed on.
- * @input how many iterations the FSM has been in the current state.
- * @input the frequency that the battery info should be written.
+ * This helper function puts the battery percentage in the battery field of the current screen.
+ * Nothing is sent to the OLED unless the percentage changed since it was last drawn, so states can
+ * call this every iteration.
 */
 
-void UpdateBatteryPercentage(int row, int num_iterations_in_state, int update_frequency) {
-  if (num_iterations_in_state % update_frequency == 0) {
-    oled.setCol(0);
-    oled.setRow(row);
-    oled.clearToEOL();
-    OLED_PRINT_FLASH("Battery: ");
-    oled.print(batt_percentage);
-    OLED_PRINTLN_FLASH("%");
-  }
+void UpdateBatteryPercentage() {
+  // "100%" plus the null terminator.
+  char batt_buf[5];
+  itoa(batt_percentage, batt_buf, 10);
+  strcat(batt_buf, "%");
+  display.SetField(DISPLAY_BATTERY, batt_buf);
+}
+
+// Whether IDLE has already dimmed the OLED. Reset every time IDLE is entered so the screen is only
+// dimmed once per visit instead of on every iteration after the first 20 seconds.
+static bool is_idle_screen_dimmed = false;
+
+/*
+ * Enter function for IDLE. Displays the name of the buzzer.
+*/
+
+void IdleEnterFunc() {
+  has_system_been_initialized = true;
+  is_idle_screen_dimmed = false;
+  // Nothing is sent in IDLE unless the registration check runs, so the FONA can sleep.
+  fona_shield.SetPowerState(MODEM_SLEEP);
+  display.SetScreen(idle_screen);
+  display.SetField(DISPLAY_BUZZER_NAME, eeprom_data.buzzer_name);
 }
 
 /*
  * The state that happens when the Buzzer is just sitting there without a party assigned to it.
  *
- * Displays the name of the buzzer and the battery percentage.
+ * Keeps the battery percentage up to date and dims the OLED after 20 seconds. After that the
+ * Arduino is powered down for IDLE_NAP_MS every iteration. The radio is turned off once the Buzzer
+ * has been idle for IDLE_RADIO_OFF_MS, at the cost of a slower first request when it's used again.
+ *
+ * After a warm boot the registration check is done here, on the second iteration so the screen is
+ * already up. If the API can't be reached it is tried again the next time IDLE is entered.
  *
  * @input how long the FSM has been in the current state.
  * @input how many iterations the FSM has been in the current state.
- * @return REPEAT always. An external event (button press, charging cable plugged in) needs to occur
- * to transition away from this state.
+ * @return TIMEOUT if the registration check found the Buzzer isn't registered anymore, REPEAT
+ * otherwise. An external event (button press, charging cable plugged in) needs to occur to
+ * transition away from this state.
 */
 
 int IdleFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  has_system_been_initialized = true;
-  if (num_iterations_in_state == 0) {
-    oled.clear();
-    OLED_PRINTLN_FLASH("Buzzer name:");
-    oled.println(eeprom_data.buzzer_name);
+  if (is_registration_unverified && num_iterations_in_state == 1) {
+    bool is_buzzer_registered;
+    if (IsBuzzerRegistered(&is_buzzer_registered) != ERROR) {
+      SetBootSnapshotRegistered(is_buzzer_registered);
+      if (!is_buzzer_registered) return TIMEOUT;
+    }
+  }
+  UpdateBatteryPercentage();
+  if (!is_idle_screen_dimmed && millis() - state_start_time >= 20000) {
+    oled.setContrast(0);
+    is_idle_screen_dimmed = true;
   }
-  UpdateBatteryPercentage(2, num_iterations_in_state, 1000);
-  if (millis() - state_start_time >= 20000) oled.setContrast(0);
+  if (millis() - state_start_time >= IDLE_RADIO_OFF_MS && fona_shield.PowerState() == MODEM_SLEEP) {
+    fona_shield.SetPowerState(MODEM_MIN_FUNC);
+  }
+  // Nobody is looking at a dimmed screen, so duty cycle the Arduino until the button is pressed.
+  if (is_idle_screen_dimmed && button_press_start == 0) power_manager.PowerDown(IDLE_NAP_MS);
   return REPEAT;
 }
 
+/*
+ * Exit function for IDLE. Undoes the dimming so the next screen is readable.
+*/
+
+void IdleExitFunc() {
+  if (is_idle_screen_dimmed) oled.setContrast(OLED_DEFAULT_CONTRAST);
+}
+
 /*
  * The state that is called right before SLEEP. Shows a shutdown message for 5 seconds then
  * moves on.
@@ -169,13 +421,22 @@ int IdleFunc(unsigned long state_start_time, int num_iterations_in_state) {
 */
 
 int ShutdownFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  oled.clear();
-  OLED_PRINTLN_FLASH("Shutting down.\nBye bye!");
+  DISPLAY_MESSAGE_FLASH("Shutting down.\nBye bye!");
   delay(5000);
-  oled.clear();
+  display.Clear();
   return SUCCESS;
 }
 
+/*
+ * Enter function for CHARGING.
+*/
+
+void ChargeEnterFunc() {
+  // Not MODEM_MIN_FUNC: unplugging goes straight back to using the network.
+  fona_shield.SetPowerState(MODEM_SLEEP);
+  display.SetScreen(charging_screen);
+}
+
 /*
  * State that occurs when the Buzzer is charging (USB cable plugged in). Shows a message that the
  * battery is charging and the battery percentage.
@@ -187,11 +448,7 @@ int ShutdownFunc(unsigned long state_start_time, int num_iterations_in_state) {
 */
 
 int ChargeFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  if (num_iterations_in_state == 0) {
-    oled.clear();
-    OLED_PRINTLN_FLASH("Charging.....");
-  }
-  UpdateBatteryPercentage(1, num_iterations_in_state, 1000);
+  UpdateBatteryPercentage();
   return REPEAT;
 }
 
@@ -206,20 +463,29 @@ int ChargeFunc(unsigned long state_start_time, int num_iterations_in_state) {
 */
 
 int WakeupFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  oled.clear();
-  OLED_PRINTLN_FLASH("Starting up.....");
+  DISPLAY_MESSAGE_FLASH("Starting up.....");
   delay(5000);
-  oled.clear();
+  display.Clear();
   if (has_system_been_initialized) return SUCCESS;
   if (eeprom_data.curr_party_id != NO_PARTY) return TIMEOUT;
   return ERROR;
 }
 
+/*
+ * Enter function for SLEEP. Turns off the OLED and turns the cell radio off.
+*/
+
+void SleepEnterFunc() {
+  display.Clear();
+  oled.ssd1306WriteCmd(SSD1306_DISPLAYOFF);
+  if (!fona_shield.SetPowerState(MODEM_MIN_FUNC)) DEBUG_PRINTLN_FLASH("Failed to put cell modem to sleep.");
+}
+
 /*
  * State that occurs when the Buzzer is "shutdown". Shutting down the Buzzer consists of turning
- * off the OLED and doing nothing. Tests show that the Buzzer can go 2-3 days like this. If the
- * Buzzer was fully initialized before shutdown then we can perform a hot start and just go
- * straight to the IDLE.
+ * off the OLED and the cell radio and keeping the Arduino powered down except for a short wakeup
+ * every SLEEP_NAP_MS to check the button and the USB cable. If the Buzzer was fully initialized
+ * before shutdown then we can perform a hot start and just go straight to the IDLE.
  *
  * @input how long the FSM has been in the current state.
  * @input how many iterations the FSM has been in the current state.
@@ -228,13 +494,21 @@ int WakeupFunc(unsigned long state_start_time, int num_iterations_in_state) {
 */
 
 int SleepFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  if (num_iterations_in_state == 0) {
-    oled.clear();
-  }
-  delay(500);
+  // Don't power down in the middle of a long button press, loop() needs to see the release.
+  if (button_press_start == 0) power_manager.PowerDown(SLEEP_NAP_MS);
   return REPEAT;
 }
 
+/*
+ * Exit function for SLEEP. Turns the OLED back on. The cell radio stays off until the next state
+ * asks for another power state or makes a request. If waking the radio fails that request fails
+ * and the usual retry/FATAL_ERROR path takes over.
+*/
+
+void SleepExitFunc() {
+  oled.ssd1306WriteCmd(SSD1306_DISPLAYON);
+}
+
 /*
  * Helper method that pings the API to see if a Buzzer is registered and returns whether it is.
  *
@@ -244,46 +518,118 @@ int SleepFunc(unsigned long state_start_time, int num_iterations_in_state) {
 */
 
 int IsBuzzerRegistered(bool *is_buzzer_registered) {
-  char rep_buf[BUF_LENGTH_SMALL];
-  int err = APIPOSTBuzzerName(F("http://restaur-anteater.herokuapp.com/buzzer_api/is_buzzer_registered"), rep_buf, sizeof(rep_buf), false);
+  RegistrationReply reply;
+  JsonExtractor extractor(registration_reply_fields, JSON_NUM_FIELDS(registration_reply_fields), &reply);
+  int err = APIPOSTBuzzerName(API_IS_BUZZER_REGISTERED, &extractor, false);
   if (err == ERROR) return ERROR;
-  StaticJsonBuffer<BUF_LENGTH_SMALL> jsonBuffer;
-  JsonObject& root = jsonBuffer.parseObject(rep_buf);
-  *is_buzzer_registered = root[IS_BUZZER_REGISTERED_FIELD];
-  return root[ERROR_STATUS_FIELD];
+  *is_buzzer_registered = reply.is_registered;
+  return reply.error;
+}
+
+/*
+ * Helper method that POSTs a body to an API endpoint on the configured backend.
+ *
+ * @input an id from the api_endpoints enum.
+ * @input a char buf with the POST body.
+ * @input the size of the above body (see RequestBodies).
+ * @input a JsonExtractor for the API reply.
+ * @return the result of FonaShield::HTTPPOSTJSON().
+*/
+
+int APIPOST(unsigned char endpoint, char *body, int body_size, JsonExtractor *reply) {
+  // The HTTP call (AT commands, reply parsing) is measured apart from the state that makes it.
+  unsigned char stack_slot = stack_monitor.Attribute(STACK_SLOT_FONA);
+  // Each request gets the whole watchdog budget, even when a state makes several.
+  watchdog.Kick();
+  int err = fona_shield.HTTPPOSTJSON(api_endpoints.BaseURL(), api_endpoints.Path(endpoint), body, body_size, reply);
+  stack_monitor.Attribute(stack_slot);
+  return err;
 }
 
 /*
  * Helper method for calls to the API that just need the buzzer name as a POST parameter.
  *
- * @input a FlashStrPtr that represents the API endpoint to ping.
- * @input a ptr to a char buf where the API reply will be put.
- * @input the size of the above buffer.
+ * @input an id from the api_endpoints enum.
+ * @input a JsonExtractor for the API reply.
  * @input a bool representing whether or not the buzzer is buzzing. Used for debugging purposes
  * but may be removed soon to save space.
- * @return the result of FonaShield::HTTPPOSTOneLine().
+ * @return the result of FonaShield::HTTPPOSTJSON().
+*/
+
+int APIPOSTBuzzerName(unsigned char endpoint, JsonExtractor *reply, bool is_buzzing) {
+  return APIPOST(endpoint, request_bodies.BuzzerNameBody(), request_bodies.BuzzerNameBodySize(), reply);
+}
+
+/*
+ * Sends the operations queued in the outbox, oldest first, until it is empty or a request fails.
+ * An operation stays queued until the API has answered it.
+ *
+ * @return SUCCESS if the outbox is empty, ERROR if a request failed (the operation is still
+ * queued), or TIMEOUT if the API turned an operation down (e.g. someone else already took the
+ * party). The turned down operation is removed.
+*/
+
+int DrainOutbox() {
+  OutboxEntry *entry;
+  while ((entry = outbox.Peek()) != NULL) {
+    ErrorReply reply;
+    JsonExtractor extractor(error_reply_fields, JSON_NUM_FIELDS(error_reply_fields), &reply);
+    if (entry->op == OUTBOX_ACCEPT_PARTY) {
+      request_bodies.SetAcceptParty(entry->party_id, entry->key);
+      int err = APIPOST(API_ACCEPT_PARTY, request_bodies.AcceptPartyBody(), request_bodies.AcceptPartyBodySize(),
+                        &extractor);
+      if (err == ERROR) return ERROR;
+    }
+    outbox.Pop();
+    if (reply.error) return TIMEOUT;
+  }
+  return SUCCESS;
+}
+
+/*
+ * Helper method that copies a party the API handed out into eeprom_data. Doesn't write the EEPROM.
+ *
+ * @input the reply of get_available_party or claim_party.
 */
 
-int APIPOSTBuzzerName(FlashStrPtr api_endpoint, char *rep_buf, int rep_buf_len, bool is_buzzing) {
-  FlashStrPtr json_skeleton = F("{\"" BUZZER_NAME_FIELD "\":\"%s\"}");
-  // -2 because the string format specificer won't be in the char buf after the snprintf.
-  char post_data[strlen_P((prog_char *)json_skeleton)-2+strlen(eeprom_data.buzzer_name)+1];
-  snprintf_P(post_data, sizeof(post_data), (prog_char *)json_skeleton, eeprom_data.buzzer_name);
-  return fona_shield.HTTPPOSTOneLine(api_endpoint, post_data, sizeof(post_data), rep_buf, rep_buf_len);
+static void SetEEPROMDataParty(AvailPartyReply *reply) {
+  // The state version the Buzzer knows belongs to the old party.
+  request_bodies.SetStateVersion(0);
+  eeprom_data.wait_time = reply->wait_time;
+  eeprom_data.curr_party_id = reply->party_id;
+  strncpy(eeprom_data.party_name, reply->party_name, sizeof(eeprom_data.party_name));
 }
 
 /*
  * Helper method that sets the curr_party_id to NO_PARTY and updates the data stored in the EEPROM.
+ * Also resets the heartbeat cadence and drops queued operations since the party they were about
+ * is gone.
 */
 
 void SetEEPROMDataNoParty() {
+  heartbeat_cadence.PartyCleared();
+  outbox.RemoveParty(eeprom_data.curr_party_id);
+  request_bodies.SetStateVersion(0);
   eeprom_data.curr_party_id = NO_PARTY;
   EEPROMWrite(&eeprom_data);
 }
 
+/*
+ * Enter function for HEARTBEAT. The party screen isn't drawn until the first heartbeat confirms
+ * the party is still active.
+*/
+
+void HeartbeatEnterFunc() {
+  // Heartbeats are polled, the FONA only needs to be awake while one is being sent.
+  fona_shield.SetPowerState(MODEM_SLEEP);
+  heartbeat_cadence.PollNow();
+}
+
 /*
  * The state the runs repeatedly when a Buzzer is assigned a party. This calls the 'heartbeat' API
  * endpoint to get status updates (whether or not a table is ready or the party has been deleted).
+ * How often that happens is decided by heartbeat_cadence; in between heartbeats the Arduino is
+ * powered down in HEARTBEAT_NAP_MS chunks.
  *
  * @input how long the FSM has been in the current state.
  * @input how many iterations the FSM has been in the current state.
@@ -293,66 +639,93 @@ void SetEEPROMDataNoParty() {
 */
 
 int HeartbeatFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  // If there is valid party data in the EEPROM the Buzzer will jump to this state, so we want to
-  // check that the party is still actually active before writing all the data to the OLED.
-  if (num_iterations_in_state == 1) {
-    oled.clear();
-    OLED_PRINTLN_FLASH("Party name:");
-    oled.println(eeprom_data.party_name);
-    // Writes the battery percentage now.
-    UpdateBatteryPercentage(2, num_iterations_in_state, 1);
+  // Does nothing until the party screen is up.
+  UpdateBatteryPercentage();
+  unsigned long time_until_poll = heartbeat_cadence.TimeUntilPoll(millis());
+  if (time_until_poll > 0) {
+    if (button_press_start == 0) power_manager.PowerDown(min(time_until_poll, HEARTBEAT_NAP_MS));
+    return REPEAT;
+  }
+  // Queued operations (accepting this party) have to reach the API before heartbeats make sense.
+  int outbox_err = DrainOutbox();
+  if (outbox_err == TIMEOUT) {
+    SetEEPROMDataNoParty();
+    return TIMEOUT;
+  }
+  if (outbox_err == ERROR) {
+    display.SetScreen(party_screen);
+    display.SetField(DISPLAY_PARTY_NAME, eeprom_data.party_name);
+    display.SetField(DISPLAY_STATUS, F("Waiting for signal"));
+    heartbeat_cadence.PollFailed(millis());
+    return REPEAT;
   }
-  if (num_iterations_in_state != 0) UpdateBatteryPercentage(2, num_iterations_in_state, 5);
-  PrintFreeRAM();
-  char rep_buf[BUF_LENGTH_MEDIUM];
-  PrintFreeRAM();
-  short err = APIPOSTBuzzerName(F("http://restaur-anteater.herokuapp.com/buzzer_api/heartbeat"), rep_buf, sizeof(rep_buf), false);
+  HeartbeatReply reply;
+  JsonExtractor extractor(heartbeat_reply_fields, JSON_NUM_FIELDS(heartbeat_reply_fields), &reply);
+  short err = APIPOST(API_HEARTBEAT, request_bodies.HeartbeatBody(), request_bodies.HeartbeatBodySize(), &extractor);
+  // Backs off before the retry, so MAX_RETRIES failures in a row span a few minutes of outage.
+  if (err == ERROR) heartbeat_cadence.PollFailed(millis());
   CHECK_ERR_IN_INTERATION(err, ERROR);
-  PrintFreeRAM();
-  StaticJsonBuffer<BUF_LENGTH_MEDIUM> jsonBuffer;
-  JsonObject& root = jsonBuffer.parseObject(rep_buf);
-  PrintFreeRAM();
-  err = root[ERROR_STATUS_FIELD];
-  if (err) return ERROR;
-  short is_active = root[IS_ACTIVE_FIELD];
-  if (!is_active) {
+  // Nothing changed since the last full reply, so the body wasn't even read.
+  if (fona_shield.WasNotModified()) {
+    reply = last_heartbeat_reply;
+  } else {
+    if (reply.error) return ERROR;
+    last_heartbeat_reply = reply;
+    request_bodies.SetStateVersion(reply.state_version);
+  }
+  if (!reply.is_active) {
     SetEEPROMDataNoParty();
     return TIMEOUT;
   }
-  short buzz = root[BUZZ_FIELD];
-  if (buzz) return SUCCESS;
+  // If there is valid party data in the EEPROM the Buzzer will jump to this state, so we want to
+  // check that the party is still actually active before writing all the data to the OLED.
+  // This only costs I2C traffic the first time around.
+  display.SetScreen(party_screen);
+  display.SetField(DISPLAY_PARTY_NAME, eeprom_data.party_name);
+  display.SetField(DISPLAY_STATUS, "");
+  UpdateBatteryPercentage();
+  // The API only answers heartbeats from registered Buzzers.
+  is_registration_unverified = false;
+  heartbeat_cadence.PollDone(millis(), reply.retry_after);
+  if (reply.buzz) return SUCCESS;
   return REPEAT;
 }
 
 /*
- * The state the runs when there is a party available. This pings an API endpoint that confirms
- * that the Buzzer is accepting the available party.
+ * The state the runs when there is a party available. Queues the operation that confirms to the
+ * API that the Buzzer is accepting the available party and tries to send it straight away. If the
+ * request fails the party is kept anyway and HEARTBEAT keeps trying to send the accept before its
+ * heartbeats.
  *
  * @input how long the FSM has been in the current state.
  * @input how many iterations the FSM has been in the current state.
- * @return SUCCESS if the party was successfully accepted or ERROR otherwise.
+ * @return SUCCESS if the party was accepted or the accept is still queued, TIMEOUT if the API
+ * turned the party down.
 */
 
 int AcceptAvailPartyFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  char rep_buf[BUF_LENGTH_SMALL];
-  FlashStrPtr json_skeleton = F("{\"" BUZZER_NAME_FIELD "\":\"%s\",\"" PARTY_ID_FIELD "\":%d}");
-  // calculate the number of digits in the current party_id
-  int num_digits = NUM_DIGITS(eeprom_data.curr_party_id);
-  // -4 is because the string format specifiers won't actually be in the final char buf.
-  char post_data[strlen_P((prog_char *)json_skeleton)+strlen(eeprom_data.buzzer_name)+num_digits+1];
-  snprintf_P(post_data, sizeof(post_data), (prog_char *)json_skeleton, eeprom_data.buzzer_name, eeprom_data.curr_party_id);
-  short err;
-  err = fona_shield.HTTPPOSTOneLine(F("http://restaur-anteater.herokuapp.com/buzzer_api/accept_party"), post_data, sizeof(post_data), rep_buf, sizeof(rep_buf));
-  if (err == ERROR) return (num_iterations_in_state < MAX_RETRIES) ? REPEAT : ERROR;
-  StaticJsonBuffer<BUF_LENGTH_SMALL> jsonBuffer;
-  JsonObject& root = jsonBuffer.parseObject(rep_buf);
-  err = root[ERROR_STATUS_FIELD];
-  if (err) return TIMEOUT;
+  outbox.Add(OUTBOX_ACCEPT_PARTY, eeprom_data.curr_party_id);
   // write the active party to the EEPROM
   EEPROMWrite(&eeprom_data);
+  heartbeat_cadence.PartyAccepted(millis(), eeprom_data.wait_time);
+  if (DrainOutbox() == TIMEOUT) {
+    SetEEPROMDataNoParty();
+    return TIMEOUT;
+  }
   return SUCCESS;
 }
 
+/*
+ * Enter function for GET_AVAILABLE_PARTY. IDLE may have turned the radio off, and the requests
+ * from here until HEARTBEAT come back to back, so the FONA is brought back to MODEM_SLEEP once
+ * rather than woken from MODEM_MIN_FUNC for every request.
+*/
+
+void GetAvailPartyEnterFunc() {
+  DISPLAY_MESSAGE_FLASH("Checking for parties\nwith no buzzer");
+  fona_shield.SetPowerState(MODEM_SLEEP);
+}
+
 /*
  * The state the runs when a short button press occurs. It pings an API endpoint to see if there are
  * any parties available. If there are, then ACCEPT_AVAILABLE_PARTY will be the next state.
@@ -364,29 +737,59 @@ int AcceptAvailPartyFunc(unsigned long state_start_time, int num_iterations_in_s
 */
 
 int GetAvailPartyFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  oled.clear();
-  OLED_PRINTLN_FLASH("Checking for parties");
-  OLED_PRINTLN_FLASH("with no buzzer");
-  delay(100);
-  char rep_buf[BUF_LENGTH_LARGE];
-  int err = APIPOSTBuzzerName(F("http://restaur-anteater.herokuapp.com/buzzer_api/get_available_party"), rep_buf, sizeof(rep_buf), false);
+  AvailPartyReply reply;
+  JsonExtractor extractor(avail_party_reply_fields, JSON_NUM_FIELDS(avail_party_reply_fields), &reply);
+  int err = APIPOSTBuzzerName(API_GET_AVAILABLE_PARTY, &extractor, false);
   if (err == ERROR) return (num_iterations_in_state < MAX_RETRIES) ? REPEAT : ERROR;
-  StaticJsonBuffer<BUF_LENGTH_LARGE> jsonBuffer;
-  JsonObject& root = jsonBuffer.parseObject(rep_buf);
-  if (root[ERROR_STATUS_FIELD]) return (num_iterations_in_state < MAX_RETRIES) ? REPEAT : ERROR;
-  bool party_avail = root[PARTY_AVAIL_FIELD];
-  if (party_avail){
-    eeprom_data.wait_time = root[PARTY_WAIT_TIME_FIELD];
-    eeprom_data.curr_party_id = root[PARTY_ID_FIELD];
-    strncpy(eeprom_data.party_name, root[PARTY_NAME_FIELD], sizeof(eeprom_data.party_name));
+  if (reply.error) return (num_iterations_in_state < MAX_RETRIES) ? REPEAT : ERROR;
+  if (reply.is_party_avail){
+    SetEEPROMDataParty(&reply);
     return SUCCESS;
   }
-  oled.clear();
-  OLED_PRINTLN_FLASH("No avail parties.");
+  DISPLAY_MESSAGE_FLASH("No avail parties.");
   delay(5000);
   return TIMEOUT;
 }
 
+/*
+ * Replaces GET_AVAILABLE_PARTY and ACCEPT_AVAILABLE_PARTY when CLAIM_PARTY_MODE is set. Pings an
+ * API endpoint that picks the next party with no buzzer and accepts it for this Buzzer in one
+ * go, which saves a whole HTTP transaction (~5s with the FONA) per buzzer handed out. A buzzer
+ * that claims again without having let go of its party gets the same party back, so a retry
+ * after a lost reply doesn't take a second party.
+ *
+ * @input how long the FSM has been in the current state.
+ * @input how many iterations the FSM has been in the current state.
+ * @return SUCCESS if a party was claimed, TIMEOUT if there are no parties available, and ERROR if
+ * the API call has failed more than MAX_RETRIES number of times.
+*/
+
+int ClaimPartyFunc(unsigned long state_start_time, int num_iterations_in_state) {
+  AvailPartyReply reply;
+  JsonExtractor extractor(avail_party_reply_fields, JSON_NUM_FIELDS(avail_party_reply_fields), &reply);
+  int err = APIPOSTBuzzerName(API_CLAIM_PARTY, &extractor, false);
+  if (err == ERROR) return (num_iterations_in_state < MAX_RETRIES) ? REPEAT : ERROR;
+  if (reply.error) return (num_iterations_in_state < MAX_RETRIES) ? REPEAT : ERROR;
+  if (reply.is_party_avail) {
+    SetEEPROMDataParty(&reply);
+    // write the active party to the EEPROM
+    EEPROMWrite(&eeprom_data);
+    heartbeat_cadence.PartyAccepted(millis(), eeprom_data.wait_time);
+    return SUCCESS;
+  }
+  DISPLAY_MESSAGE_FLASH("No avail parties.");
+  delay(5000);
+  return TIMEOUT;
+}
+
+/*
+ * Enter function for CHECK_BUZZER_REGISTRATION.
+*/
+
+void CheckBuzzerRegEnterFunc() {
+  DISPLAY_MESSAGE_FLASH("Checking if this\nbuzzer is registered");
+}
+
 /*
  * This state is called in the initial Buzzer setup to see whether or not the Buzzer is registered
  * with the backend.
@@ -398,20 +801,29 @@ int GetAvailPartyFunc(unsigned long state_start_time, int num_iterations_in_stat
 */
 
 int CheckBuzzerRegFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  oled.clear();
-  OLED_PRINTLN_FLASH("Checking if this\nbuzzer is registered");
   bool is_buzzer_registered;
   if (IsBuzzerRegistered(&is_buzzer_registered) == ERROR)
     return (num_iterations_in_state < MAX_RETRIES) ? REPEAT : ERROR;
   if (is_buzzer_registered) {
-    oled.clear();
-    OLED_PRINTLN_FLASH("Buzzer registered!");
+    SetBootSnapshotRegistered(true);
+    DISPLAY_MESSAGE_FLASH("Buzzer registered!");
     delay(2000);
     return SUCCESS;
   }
   return TIMEOUT;
 }
 
+/*
+ * Enter function for WAIT_BUZZER_REGISTRATION. Like GET_AVAILABLE_PARTY, it can follow an IDLE
+ * that turned the radio off, so the FONA is brought back to MODEM_SLEEP.
+*/
+
+void WaitBuzzerRegEnterFunc() {
+  DISPLAY_MESSAGE_FLASH("Please register\nbuzzer.\nBuzzer name: ");
+  oled.println(eeprom_data.buzzer_name);
+  fona_shield.SetPowerState(MODEM_SLEEP);
+}
+
 /*
  * If the Buzzer isn't registered, this state is called to wait for the Buzzer to be registered
  * before preceeding to normal Buzzer activities.
@@ -424,24 +836,20 @@ int CheckBuzzerRegFunc(unsigned long state_start_time, int num_iterations_in_sta
 */
 
 int WaitBuzzerRegFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  oled.clear();
-  OLED_PRINTLN_FLASH("Please register");
-  OLED_PRINTLN_FLASH("buzzer.");
-  OLED_PRINTLN_FLASH("Buzzer name: ");
-  oled.println(eeprom_data.buzzer_name);
   bool is_buzzer_registered;
   if (IsBuzzerRegistered(&is_buzzer_registered) == ERROR)
     return (num_iterations_in_state < MAX_RETRIES) ? REPEAT : ERROR;
   if (!is_buzzer_registered) return REPEAT;
-  oled.clear();
-  OLED_PRINTLN_FLASH("Buzzer successfully");
-  OLED_PRINTLN_FLASH("registered!");
+  SetBootSnapshotRegistered(true);
+  DISPLAY_MESSAGE_FLASH("Buzzer successfully\nregistered!");
   delay(5000);
   return SUCCESS;
 }
 
 /*
- * This function gets called when an unrecoverable/fatal error has occured.
+ * This function gets called when an unrecoverable/fatal error has occured. Before resetting the
+ * Arduino it marks the boot snapshot so the next boot is a warm one, if the Buzzer was registered,
+ * and leaves a crash record (see Watchdog.h).
  *
  * @input how long the FSM has been in the current state.
  * @input how many iterations the FSM has been in the current state.
@@ -449,50 +857,48 @@ int WaitBuzzerRegFunc(unsigned long state_start_time, int num_iterations_in_stat
 */
 
 int FatalErrorFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  oled.clear();
-  analogWrite(BUZZER_PIN, 255);
-  delay(300);
-  analogWrite(BUZZER_PIN, 0);
-  delay(300);
-  analogWrite(BUZZER_PIN, 255);
-  delay(300);
-  analogWrite(BUZZER_PIN, 0);
-  OLED_PRINTLN_FLASH("Fatal error occured.");
-  OLED_PRINTLN_FLASH("Restarting buzzer in\n10 seconds.");
+  haptics.Play(double_buzz_pattern);
+  DISPLAY_MESSAGE_FLASH("Fatal error occured.\nRestarting buzzer in\n10 seconds.");
+  if (boot_snapshot.is_registered) {
+    boot_snapshot.is_warm_restart_pending = true;
+    boot_snapshot.modem_flags = (fona_shield.IsGPRSUp()) ? MODEM_GPRS_UP : 0;
+    EEPROMWriteBootSnapshot(&boot_snapshot);
+  }
+  watchdog.RecordCrash(CRASH_FATAL_ERROR);
   delay(10000);
-  digitalWrite(ARDUINO_RST_PIN, LOW);
+  ThisBoard::ArduinoRst::SetLow();
   // This should never happen.
   return SUCCESS;
 }
 
+/*
+ * Enter function for LOW_CELL_RECEPTION. Buzzes twice and tells the user what's going on.
+*/
+
+void LowCellReceptionEnterFunc() {
+  // loop() samples the link, and wakes the FONA for it, every LINK_SUSPECT_SAMPLE_MAX_AGE.
+  fona_shield.SetPowerState(MODEM_SLEEP);
+  haptics.Play(double_buzz_pattern);
+  DISPLAY_MESSAGE_FLASH("Low cell reception\n");
+}
+
 /*
  * This function gets called when the Buzzer no longer has acceptable cell signal (as measured
-* using the RSSI from the cell modem).
+ * by link_monitor). The link has to get clearly better than what made it low before this state is
+ * left, see LinkMonitor.h. The link is only sampled by loop(), at its LINK_SUSPECT_SAMPLE_MAX_AGE
+ * cadence, so this just looks at the cached verdict and powers down in between.
  *
  * @input how long the FSM has been in the current state.
  * @input how many iterations the FSM has been in the current state.
- * @return REPEAT if the RSSI is below the signal threshold or an error was encountered interacting
- * with the cell modem, ERROR if we encountered an error with the cell modem too many times, SUCCESS
- * if the Buzzer is back in cell range and we want to go to HEARTBEAT, TIMEOUT if we are back in cell
- * range and we want to go to IDLE.
+ * @return REPEAT if the link is still low, ERROR if there hasn't been a link sample for
+ * LOW_CELL_SAMPLE_FAIL_MS, SUCCESS if the Buzzer is back in cell range and we want to go to
+ * HEARTBEAT, TIMEOUT if we are back in cell range and we want to go to IDLE.
 */
 
 int LowCellReceptionFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  if (num_iterations_in_state == 0) {
-    oled.clear();
-    analogWrite(BUZZER_PIN, 255);
-    delay(300);
-    analogWrite(BUZZER_PIN, 0);
-    delay(300);
-    analogWrite(BUZZER_PIN, 255);
-    delay(300);
-    analogWrite(BUZZER_PIN, 0);
-    OLED_PRINTLN_FLASH("Low cell reception\n");
-  }
-  int rssi_val = fona_shield.GetRSSIVal();
-  CHECK_ERR_IN_INTERATION(rssi_val, -1);
-  if (rssi_val < LOW_SIGNAL_THRESHOLD) {
-    delay(1000);
+  if (link_monitor.IsLow()) {
+    if (fona_shield.LinkSampleAge() >= LOW_CELL_SAMPLE_FAIL_MS) return ERROR;
+    power_manager.PowerDown(LOW_CELL_NAP_MS);
     return REPEAT;
   }
   if (eeprom_data.curr_party_id != NO_PARTY) return SUCCESS;
@@ -500,10 +906,27 @@ int LowCellReceptionFunc(unsigned long state_start_time, int num_iterations_in_s
 }
 
 /*
- * This state runs when then Buzzer should buzz. It vibrates the motor for 2 seconds then pings the
- * API to see whether or not it should keep buzzing or return to IDLE. This API interaction is
- * likely to change in the near future. API pinging takes ~5 seconds so no delay call is needed
- * before buzzing again.
+ * Enter function for BUZZ.
+*/
+
+void BuzzEnterFunc() {
+  // BUZZ is always entered from HEARTBEAT, so usually only the status field gets drawn here.
+  display.SetScreen(party_screen);
+  display.SetField(DISPLAY_PARTY_NAME, eeprom_data.party_name);
+  UpdateBatteryPercentage();
+  display.SetField(DISPLAY_STATUS, F("Table Ready!"));
+  // Heartbeats go back to back, putting the FONA to sleep in between would only slow them down.
+  fona_shield.SetPowerState(MODEM_ACTIVE);
+  // Keeps going on its own until BUZZ is left, however long the heartbeats take.
+  haptics.Play(table_ready_pattern, true);
+}
+
+/*
+ * This state runs when then Buzzer should buzz. The motor pattern started by BuzzEnterFunc plays in
+ * the background while this pings the API back to back to see whether or not it should keep
+ * buzzing or return to IDLE, so how soon a seated party is noticed only depends on the round trip.
+ * The heartbeat sends the state version, so while nothing changes the API answers with a 304 and
+ * no body has to be read. The motor is stopped as soon as the party is no longer active.
  *
  * @input how long the FSM has been in the current state.
  * @input how many iterations the FSM has been in the current state.
@@ -513,23 +936,31 @@ int LowCellReceptionFunc(unsigned long state_start_time, int num_iterations_in_s
 */
 
 int BuzzFunc(unsigned long state_start_time, int num_iterations_in_state) {
-  oled.clear();
-  OLED_PRINTLN_FLASH("Table Ready!");
-  analogWrite(BUZZER_PIN, 255);
-  delay(2000);
-  analogWrite(BUZZER_PIN, 0);
-  char rep_buf[BUF_LENGTH_MEDIUM];
+  HeartbeatReply reply;
+  JsonExtractor extractor(heartbeat_reply_fields, JSON_NUM_FIELDS(heartbeat_reply_fields), &reply);
   short err;
-  err = APIPOSTBuzzerName(F("http://restaur-anteater.herokuapp.com/buzzer_api/heartbeat"), rep_buf, sizeof(rep_buf), true);
+  err = APIPOST(API_HEARTBEAT, request_bodies.HeartbeatBody(), request_bodies.HeartbeatBodySize(), &extractor);
   CHECK_ERR_IN_INTERATION(err, ERROR);
-  StaticJsonBuffer<BUF_LENGTH_MEDIUM> jsonBuffer;
-  JsonObject& root = jsonBuffer.parseObject(rep_buf);
-  err = root[ERROR_STATUS_FIELD];
-  CHECK_ERR_IN_INTERATION(err, 1);
-  short is_active = root[IS_ACTIVE_FIELD];
-  if (!is_active) {
+  if (fona_shield.WasNotModified()) {
+    reply = last_heartbeat_reply;
+  } else {
+    err = reply.error;
+    CHECK_ERR_IN_INTERATION(err, 1);
+    last_heartbeat_reply = reply;
+    request_bodies.SetStateVersion(reply.state_version);
+  }
+  if (!reply.is_active) {
+    haptics.Stop();
     SetEEPROMDataNoParty();
     return SUCCESS;
   }
   return REPEAT;
 }
+
+/*
+ * Exit function for BUZZ. Makes sure the motor is off no matter how the FSM left the state.
+*/
+
+void BuzzExitFunc() {
+  haptics.Stop();
+}
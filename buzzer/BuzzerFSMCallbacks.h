@@ -12,6 +12,9 @@
 
 #include "Helpers.h"
 #include "Pins.h"
+#include "JsonExtractor.h"
+#include "ApiEndpoints.h"
+#include "Haptics.h"
 
 #define PARTY_AVAIL_FIELD "p_a"
 #define PARTY_NAME_FIELD "n"
@@ -23,36 +26,50 @@
 #define IS_BUZZER_REGISTERED_FIELD "i_reg"
 #define ERROR_STATUS_FIELD "e"
 #define ERROR_MESSAGE_FIELD "e_msg"
+// Sent with queued operations so the API can spot resends. See Outbox.h.
+#define IDEMPOTENCY_KEY_FIELD "k"
+// Version of the party state the API last sent. The API answers a heartbeat that sends the current
+// version with a 304 and no body.
+#define STATE_VERSION_FIELD "v"
+// Optional, seconds the API would like the Buzzer to wait before the next heartbeat.
+#define RETRY_AFTER_FIELD "r_a"
 
+// Set to 1 to take a party with a single claim_party call that picks and accepts the next party in
+// one round trip, instead of get_available_party followed by accept_party. The backend has to
+// serve claim_party (see tools/mock_buzzer_api.cpp).
+#define CLAIM_PARTY_MODE 0
 
-// Used in states that are meant to be repeated multiple times without error. This int and the
-// corresponding macro allow a state to keep track of how many times it has errored. If a state
-// doesn't normally repeat and is only meant to be run once before transition, we can just return
-// repeat and check if num_iterations_in_state is greater than MAX_RETRIES. States that are meant to
-// be run more than once can't do that, hence this int and macro. This is a little janky as this
-// probably should be something that BuzzerFSM handles but I elected to do this as a band-aid as
-// to not add additional complications to BuzzerFSM when only a few states need to use this.
-static int num_iterations_in_error = 0;
-#define CHECK_ERR_IN_INTERATION(err, val_when_err) \
-  if (err == val_when_err) { \
-      if (num_iterations_in_error >= MAX_RETRIES) return ERROR; \
-      num_iterations_in_error++; \
-      return REPEAT; \
-  } \
-  num_iterations_in_error = 0; \
+// Contrast the SSD1306Ascii Adafruit128x64 init sequence sets. Used to undo IDLE's dimming.
+#define OLED_DEFAULT_CONTRAST 0xCF
+
+// How long INIT shows the splash on a cold boot. The FONA is booting behind it (see setup()).
+#define SPLASH_MS 2000
+
+// How long WAIT_NETWORK waits for the FONA to register with the cell network before INIT_GPRS
+// tries anyway.
+#define NETWORK_REG_TIMEOUT 30000
+
+// How long IDLE keeps the radio on after the Buzzer was last used. Turning it back on means
+// registering with the network and bringing GPRS up again, which takes seconds.
+#define IDLE_RADIO_OFF_MS 1800000UL
+
+// How long LOW_CELL_RECEPTION waits (in ms) without a link sample before it takes the FONA to be
+// unreachable. loop() samples every LINK_SUSPECT_SAMPLE_MAX_AGE while the link is low.
+#define LOW_CELL_SAMPLE_FAIL_MS 60000
 
 int InitFunc(unsigned long state_start_time, int num_iterations_in_state);
+int ResumeFonaShieldFunc(unsigned long state_start_time, int num_iterations_in_state);
 int BuzzFunc(unsigned long state_start_time, int num_iterations_in_state);
 int InitFonaShieldFunc(unsigned long state_start_time, int num_iterations_in_state);
+int WaitNetworkFunc(unsigned long state_start_time, int num_iterations_in_state);
 int InitGPRSFunc(unsigned long state_start_time, int num_iterations_in_state);
 int GetBuzzerNameFunc(unsigned long state_start_time, int num_iterations_in_state);
 int IdleFunc(unsigned long state_start_time, int num_iterations_in_state);
 int CheckBuzzerRegFunc(unsigned long state_start_time, int num_iterations_in_state);
 int WaitBuzzerRegFunc(unsigned long state_start_time, int num_iterations_in_state);
-static int IsBuzzerRegistered(bool *is_buzzer_registered);
 int GetAvailPartyFunc(unsigned long state_start_time, int num_iterations_in_state);
-static int APIPOSTBuzzerName(FlashStrPtr api_endpoint, char *rep_buf, int rep_buf_len, bool is_buzzing);
 int AcceptAvailPartyFunc(unsigned long state_start_time, int num_iterations_in_state);
+int ClaimPartyFunc(unsigned long state_start_time, int num_iterations_in_state);
 int HeartbeatFunc(unsigned long state_start_time, int num_iterations_in_state);
 int ShutdownFunc(unsigned long state_start_time, int num_iterations_in_state);
 int SleepFunc(unsigned long state_start_time, int num_iterations_in_state);
@@ -60,6 +77,30 @@ int WakeupFunc(unsigned long state_start_time, int num_iterations_in_state);
 int ChargeFunc(unsigned long state_start_time, int num_iterations_in_state);
 int FatalErrorFunc(unsigned long state_start_time, int num_iterations_in_state);
 int LowCellReceptionFunc(unsigned long state_start_time, int num_iterations_in_state);
-static void UpdateBatteryPercentage(int row, int num_iterations_in_state);
+void UpdateBatteryPercentage();
+int DrainOutbox();
+void SetBootSnapshotRegistered(bool is_registered);
+
+void InitEnterFunc();
+void ResumeFonaShieldEnterFunc();
+void InitFonaShieldEnterFunc();
+void WaitNetworkEnterFunc();
+void InitGPRSEnterFunc();
+void GetBuzzerNameEnterFunc();
+void IdleEnterFunc();
+void IdleExitFunc();
+void CheckBuzzerRegEnterFunc();
+void WaitBuzzerRegEnterFunc();
+void GetAvailPartyEnterFunc();
+void HeartbeatEnterFunc();
+void BuzzEnterFunc();
+void BuzzExitFunc();
+void SleepEnterFunc();
+void SleepExitFunc();
+void ChargeEnterFunc();
+void LowCellReceptionEnterFunc();
+
+// The two 300ms pulses used at boot, on fatal errors and on low cell reception.
+extern const HapticStep double_buzz_pattern[] PROGMEM;
 
 #endif
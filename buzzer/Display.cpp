@@ -0,0 +1,127 @@
+/*
+  File:
+  Display.cpp
+
+  Description:
+  Small retained-mode layer on top of the OLED. See Display.h for how screens and fields work.
+*/
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include "Display.h"
+
+Display::Display(SSD1306Ascii *oled) : _oled(oled) {
+  hideAllFields();
+}
+
+/*
+ * Switches to the given screen. If it is already the current screen nothing happens, otherwise the
+ * OLED is cleared, all the static labels are drawn and every field on the screen is marked as
+ * needing to be drawn by the next SetField call.
+ *
+ * @input a PROGMEM array of ScreenRows terminated by a row with DISPLAY_END_OF_SCREEN as its field.
+*/
+
+void Display::SetScreen(const ScreenRow *screen) {
+  if (screen == _curr_screen) return;
+  _curr_screen = screen;
+  _oled->clear();
+  hideAllFields();
+  for (const ScreenRow *screen_row = screen; ; screen_row++) {
+    unsigned char field = pgm_read_byte(&screen_row->field);
+    if (field == DISPLAY_END_OF_SCREEN) break;
+    unsigned char row = pgm_read_byte(&screen_row->row);
+    const char *label = (const char *) pgm_read_ptr(&screen_row->label);
+    _oled->setCursor(0, row);
+    if (label != NULL) _oled->print((FlashStrPtr) label);
+    if (field == DISPLAY_NO_FIELD) continue;
+    _rows[field] = row;
+    _start_cols[field] = _oled->col();
+    _end_cols[field] = _oled->col();
+    _dirty_fields |= _BV(field);
+  }
+}
+
+/*
+ * Sets a field of the current screen to a string in SRAM. Only goes to the OLED if the field is on
+ * the current screen and the string is different from what the field shows.
+ *
+ * @input a field ID from the display_fields enum.
+ * @input a single line, null terminated string.
+*/
+
+void Display::SetField(unsigned char field, const char *text) {
+  drawField(field, text, false);
+}
+
+/*
+ * Same as above, for a string in flash.
+ *
+ * @input a field ID from the display_fields enum.
+ * @input a single line FlashStrPtr.
+*/
+
+void Display::SetField(unsigned char field, FlashStrPtr text) {
+  drawField(field, (const char *) text, true);
+}
+
+/*
+ * Clears the OLED and prints a one-off message (which may contain newlines). Leaves the retained
+ * screen so the next SetScreen call always redraws.
+ *
+ * @input a FlashStrPtr with the message.
+*/
+
+void Display::ShowMessage(FlashStrPtr message) {
+  Clear();
+  _oled->println(message);
+}
+
+/*
+ * Clears the OLED and forgets the current screen.
+*/
+
+void Display::Clear() {
+  _curr_screen = NULL;
+  hideAllFields();
+  _oled->clear();
+}
+
+/*
+ * Marks every field as not being on the current screen.
+*/
+
+void Display::hideAllFields() {
+  memset(_rows, DISPLAY_FIELD_HIDDEN, sizeof(_rows));
+  _dirty_fields = 0;
+}
+
+/*
+ * Draws a field if it is visible and its value changed. The new value is written starting at the
+ * field's first column and only the part of the old value that sticks out past the new one is
+ * blanked, so at most the field's own column span goes over I2C.
+ *
+ * @input a field ID from the display_fields enum.
+ * @input a single line, null terminated string.
+ * @input whether the string is in flash or in SRAM.
+*/
+
+void Display::drawField(unsigned char field, const char *text, bool is_flash) {
+  if (field >= NUM_DISPLAY_FIELDS || _rows[field] == DISPLAY_FIELD_HIDDEN) return;
+  unsigned int hash = 0xFFFF;
+  for (const char *c = text; ; c++) {
+    char ch = (is_flash) ? pgm_read_byte(c) : *c;
+    if (ch == '\0') break;
+    hash = _crc16_update(hash, ch);
+  }
+  if (!(_dirty_fields & _BV(field)) && hash == _hashes[field]) return;
+  _oled->setCursor(_start_cols[field], _rows[field]);
+  if (is_flash) _oled->print((FlashStrPtr) text);
+  else _oled->print(text);
+  unsigned char end_col = _oled->col();
+  if (end_col < _end_cols[field]) _oled->clear(end_col, _end_cols[field] - 1, _rows[field], _rows[field]);
+  _end_cols[field] = end_col;
+  _hashes[field] = hash;
+  _dirty_fields &= ~_BV(field);
+}
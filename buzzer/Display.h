@@ -0,0 +1,60 @@
+/*
+  File:
+  Display.h
+
+  Description:
+  Small retained-mode layer on top of the OLED. A screen is declared as a PROGMEM list of rows,
+  each with an optional static label and an optional field (buzzer name, party name, battery,
+  status) that is drawn right after the label. The static parts are only drawn when the screen
+  changes. Each field remembers a hash and the extent of what it last drew, so setting a field to
+  the value it already shows costs no I2C traffic, and a changed field only rewrites its own column
+  span instead of the whole line.
+*/
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include "SSD1306Ascii.h"
+#include "Helpers.h"
+
+// IDs of the fields a screen can contain.
+enum display_fields {DISPLAY_BUZZER_NAME, DISPLAY_PARTY_NAME, DISPLAY_BATTERY, DISPLAY_STATUS,
+                     NUM_DISPLAY_FIELDS};
+
+// Used as the field of a row that only has a static label, and to end a screen declaration.
+#define DISPLAY_NO_FIELD 0xFE
+#define DISPLAY_END_OF_SCREEN 0xFF
+
+// _rows entry of fields that aren't on the current screen.
+#define DISPLAY_FIELD_HIDDEN 0xFF
+
+// One row of a screen declaration. label points to a PROGMEM string or is NULL.
+struct ScreenRow {
+  unsigned char field;
+  unsigned char row;
+  const char *label;
+};
+
+class Display {
+  private:
+    SSD1306Ascii *_oled;
+    const ScreenRow *_curr_screen = NULL;
+    unsigned char _rows[NUM_DISPLAY_FIELDS];
+    // Pixel columns where each field's value starts and where the last value drawn ended.
+    unsigned char _start_cols[NUM_DISPLAY_FIELDS];
+    unsigned char _end_cols[NUM_DISPLAY_FIELDS];
+    unsigned int _hashes[NUM_DISPLAY_FIELDS];
+    // Bit per field, set when the field has to be drawn no matter what its hash is.
+    unsigned char _dirty_fields = 0;
+    void hideAllFields();
+    void drawField(unsigned char field, const char *text, bool is_flash);
+  public:
+    Display(SSD1306Ascii *oled);
+    void SetScreen(const ScreenRow *screen);
+    void SetField(unsigned char field, const char *text);
+    void SetField(unsigned char field, FlashStrPtr text);
+    void ShowMessage(FlashStrPtr message);
+    void Clear();
+};
+
+#endif
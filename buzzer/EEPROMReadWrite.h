@@ -11,8 +11,10 @@
 
 #include <EEPROM.h>
 #include <Arduino.h>
+#include "EEPROMRecordStore.h"
 
 #define LONGEST_BUZZER_NAME 26
+// Where EEPROMData used to be stored before the record store. Only read to migrate old buzzers.
 #define BASE_ADDRESS 0
 #define LONGEST_PARTY_NAME 20
 
@@ -24,6 +26,38 @@ struct EEPROMData {
   char party_name[LONGEST_PARTY_NAME+1];
 };
 
+// Bits of BootSnapshot.modem_flags.
+#define MODEM_GPRS_UP _BV(0)
+
+// What a warm boot needs to know to skip straight to IDLE/HEARTBEAT. The current party (if any)
+// is in EEPROMData, so it isn't repeated here.
+struct BootSnapshot {
+  // Incremented every time the snapshot is written.
+  unsigned int generation;
+  bool is_registered;
+  // Set right before the Buzzer resets itself, cleared by the boot that follows. A snapshot
+  // without it (e.g. after the battery was unplugged) is stale and the Buzzer boots cold.
+  bool is_warm_restart_pending;
+  // State of the FONA when the snapshot was taken. The FONA isn't reset with the Arduino.
+  unsigned char modem_flags;
+};
+
+// EEPROM ranges the EEPROMData, ApiConfig, Outbox and BootSnapshot record stores rotate through.
+// The ApiConfig store only has room for two records, it is rarely written.
+#define EEPROM_BOOT_SNAPSHOT_START (E2END + 1 - 64)
+#define EEPROM_BOOT_SNAPSHOT_END (E2END + 1)
+#define EEPROM_OUTBOX_START (EEPROM_BOOT_SNAPSHOT_START - 128)
+#define EEPROM_OUTBOX_END EEPROM_BOOT_SNAPSHOT_START
+#define EEPROM_API_CONFIG_START (EEPROM_OUTBOX_START - 128)
+#define EEPROM_API_CONFIG_END EEPROM_OUTBOX_START
+#define EEPROM_DATA_STORE_START 0
+#define EEPROM_DATA_STORE_END EEPROM_API_CONFIG_START
+
+extern EEPROMRecordStore eeprom_data_store;
+extern EEPROMRecordStore api_config_store;
+extern EEPROMRecordStore outbox_store;
+extern EEPROMRecordStore boot_snapshot_store;
+
 /*
  * Writes the given char buf to the EEPROM starting at address 0.
  *
@@ -65,11 +99,21 @@ inline bool EEPROMRead(char *buf, int buf_len) {
 }
 
 /*
- * Writes the EEPROMData struct to the EEPROM.
+ * Writes the EEPROMData struct to the next slot of the record store. Does nothing if it hasn't
+ * changed since the last write.
 */
 
 inline void EEPROMWrite(EEPROMData *data) {
-  EEPROM.put(BASE_ADDRESS, *data);
+  eeprom_data_store.Write(data);
+}
+
+/*
+ * Bumps the generation of the BootSnapshot and writes it to the next slot of its record store.
+*/
+
+inline void EEPROMWriteBootSnapshot(BootSnapshot *snapshot) {
+  snapshot->generation++;
+  boot_snapshot_store.Write(snapshot);
 }
 
 #endif
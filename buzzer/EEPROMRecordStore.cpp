@@ -0,0 +1,145 @@
+/*
+  File:
+  EEPROMRecordStore.cpp
+
+  Description:
+  Log-structured, CRC protected record store in EEPROM. See EEPROMRecordStore.h.
+*/
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <util/crc16.h>
+#include "EEPROMRecordStore.h"
+
+// The sequence number and the CRC are both stored as 2 byte words, before and after the record.
+#define SLOT_WORD_LEN 2
+#define SLOT_OVERHEAD (2 * SLOT_WORD_LEN)
+
+/*
+ * @input first EEPROM address of the range the store may use.
+ * @input one past the last EEPROM address of the range.
+ * @input size of the record in bytes.
+*/
+
+EEPROMRecordStore::EEPROMRecordStore(int start_addr, int end_addr, unsigned char record_len) :
+  _start_addr(start_addr), _record_len(record_len),
+  _num_slots((end_addr - start_addr) / (record_len + SLOT_OVERHEAD)) {}
+
+/*
+ * Scans every slot once and remembers the one with the newest valid record. Sequence numbers are
+ * compared with serial number arithmetic so they can wrap around.
+ *
+ * @return true if a valid record was found.
+*/
+
+bool EEPROMRecordStore::Begin() {
+  _latest_slot = NO_RECORD_SLOT;
+  for (int slot = 0; slot < _num_slots; slot++) {
+    unsigned int seq;
+    if (!isSlotValid(slot, &seq)) continue;
+    if (_latest_slot == NO_RECORD_SLOT || (int) (seq - _latest_seq) > 0) {
+      _latest_slot = slot;
+      _latest_seq = seq;
+    }
+  }
+  return _latest_slot != NO_RECORD_SLOT;
+}
+
+/*
+ * Copies the latest record into the given buffer.
+ *
+ * @input a buffer at least record_len bytes long.
+ * @return false if there is no valid record (the buffer is left alone), true otherwise.
+*/
+
+bool EEPROMRecordStore::Read(void *record) {
+  if (_latest_slot == NO_RECORD_SLOT) return false;
+  int addr = slotAddr(_latest_slot) + SLOT_WORD_LEN;
+  for (unsigned char i = 0; i < _record_len; i++) {
+    ((unsigned char *) record)[i] = EEPROM.read(addr + i);
+  }
+  return true;
+}
+
+/*
+ * Writes the given record to the slot after the latest one. Nothing is written if the record is
+ * the same as the latest one. The CRC goes last so a write that is cut short leaves a slot that
+ * fails the CRC check.
+ *
+ * @input a record_len byte record.
+*/
+
+void EEPROMRecordStore::Write(const void *record) {
+  const unsigned char *bytes = (const unsigned char *) record;
+  if (_latest_slot != NO_RECORD_SLOT) {
+    int addr = slotAddr(_latest_slot) + SLOT_WORD_LEN;
+    unsigned char i = 0;
+    while (i < _record_len && EEPROM.read(addr + i) == bytes[i]) i++;
+    if (i == _record_len) return;
+  }
+  int slot = (_latest_slot == NO_RECORD_SLOT) ? 0 : (_latest_slot + 1) % _num_slots;
+  unsigned int seq = _latest_seq + 1;
+  int addr = slotAddr(slot);
+  unsigned int crc = 0xFFFF;
+  crc = _crc16_update(crc, seq & 0xFF);
+  crc = _crc16_update(crc, seq >> 8);
+  updateWord(addr, seq);
+  addr += SLOT_WORD_LEN;
+  for (unsigned char i = 0; i < _record_len; i++) {
+    crc = _crc16_update(crc, bytes[i]);
+    if (EEPROM.read(addr + i) != bytes[i]) EEPROM.write(addr + i, bytes[i]);
+  }
+  updateWord(addr + _record_len, crc);
+  _latest_slot = slot;
+  _latest_seq = seq;
+}
+
+/*
+ * @input a slot index.
+ * @return the EEPROM address of the first byte of the slot.
+*/
+
+int EEPROMRecordStore::slotAddr(int slot) {
+  return _start_addr + slot * (_record_len + SLOT_OVERHEAD);
+}
+
+/*
+ * @input an EEPROM address.
+ * @return the little endian 16 bit word stored there.
+*/
+
+unsigned int EEPROMRecordStore::readWord(int addr) {
+  return EEPROM.read(addr) | (EEPROM.read(addr + 1) << 8);
+}
+
+/*
+ * Writes a little endian 16 bit word, skipping bytes that are already right.
+ *
+ * @input an EEPROM address.
+ * @input the word.
+*/
+
+void EEPROMRecordStore::updateWord(int addr, unsigned int val) {
+  for (unsigned char i = 0; i < SLOT_WORD_LEN; i++) {
+    unsigned char b = (val >> (8 * i)) & 0xFF;
+    if (EEPROM.read(addr + i) != b) EEPROM.write(addr + i, b);
+  }
+}
+
+/*
+ * Checks the CRC of a slot.
+ *
+ * @input a slot index.
+ * @input where to store the slot's sequence number.
+ * @return true if the CRC matches.
+*/
+
+bool EEPROMRecordStore::isSlotValid(int slot, unsigned int *seq) {
+  int addr = slotAddr(slot);
+  unsigned int crc = 0xFFFF;
+  for (unsigned char i = 0; i < SLOT_WORD_LEN + _record_len; i++) {
+    crc = _crc16_update(crc, EEPROM.read(addr + i));
+  }
+  *seq = readWord(addr);
+  return crc == readWord(addr + SLOT_WORD_LEN + _record_len);
+}
@@ -0,0 +1,43 @@
+/*
+  File:
+  EEPROMRecordStore.h
+
+  Description:
+  Log-structured store for a fixed size record (e.g. EEPROMData) that spreads writes across a range
+  of the EEPROM. The range is split into slots of sizeof(seq) + record_len + sizeof(crc) bytes.
+  Every write goes to the slot after the one holding the latest record, with a sequence number one
+  higher and a CRC16 over the sequence number and the record. On boot the slots are scanned once;
+  the valid record with the newest sequence number wins. A write that is cut short by a reset
+  fails its CRC check, so the previous record is used instead.
+
+  Bytes are written with EEPROM.update, so only bytes that differ from what is already in the slot
+  use up a write cycle.
+*/
+
+#ifndef EEPROMRECORDSTORE_H
+#define EEPROMRECORDSTORE_H
+
+#include <Arduino.h>
+
+// Slot index used before a valid record has been found.
+#define NO_RECORD_SLOT -1
+
+class EEPROMRecordStore {
+  private:
+    int _start_addr;
+    unsigned char _record_len;
+    int _num_slots;
+    int _latest_slot = NO_RECORD_SLOT;
+    unsigned int _latest_seq = 0;
+    int slotAddr(int slot);
+    unsigned int readWord(int addr);
+    void updateWord(int addr, unsigned int val);
+    bool isSlotValid(int slot, unsigned int *seq);
+  public:
+    EEPROMRecordStore(int start_addr, int end_addr, unsigned char record_len);
+    bool Begin();
+    bool Read(void *record);
+    void Write(const void *record);
+};
+
+#endif
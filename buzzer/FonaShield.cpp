@@ -11,9 +11,9 @@
 #include <avr/pgmspace.h>
 #include "FonaShield.h"
 #include "Globals.h"
+#include "Board.h"
 
-FonaShield::FonaShield(SoftwareSerial *fona_serial, int rst_pin) : _fona_serial(fona_serial),
-                                                                   _rst_pin(rst_pin) {}
+FonaShield::FonaShield(SoftwareSerial *fona_serial) : _fona_serial(fona_serial) {}
 
 /*
  * Method that initializes the FONA. Begins a serial connection at 4800 baud and attempts to GET
@@ -23,19 +23,70 @@ FonaShield::FonaShield(SoftwareSerial *fona_serial, int rst_pin) : _fona_serial(
  * This method should be called before any of the other methods in this class. The rest of These
  * methods will not work unless the cell radio has been initialized by this method.
  *
+ * If StartReset() was called since the last time, the FONA isn't reset again. It has been booting
+ * since then.
+ *
  * @return true if the cell radio was successfully initialized, false otherwise.
  *
 */
 
 bool FonaShield::initShield() {
-  //init the serial interface
-  _fona_serial->begin(4800);
-  resetShield();
+  if (!_is_reset_started) StartReset();
+  _is_reset_started = false;
+  _is_gprs_up = false;
   if (!retryATCommand(F("AT"), F("AT\xD" NEW_LINE_BYTES "OK" NEW_LINE_BYTES))) return false;
   if (!retryATCommand(F("ATE0"), OK_REPLY)) return false;
+  _power_state = MODEM_ACTIVE;
+  _idle_power_state = MODEM_ACTIVE;
   return true;
 }
 
+/*
+ * Begins the serial connection and resets the FONA without waiting for it to boot, so the boot
+ * (a few seconds, plus registering with the network) can overlap with other work. initShield()
+ * picks it up from there.
+*/
+
+void FonaShield::StartReset() {
+  _fona_serial->begin(4800);
+  resetShield();
+  _is_reset_started = true;
+  _power_state = MODEM_OFF;
+  _link_sample_time = 0;
+  // What the link looked like before says nothing about the FONA after the reset.
+  link_monitor.Reset();
+  _batt_mv = -1;
+}
+
+/*
+ * Asks the FONA whether it has registered with the cell network (AT+CREG?). It does so on its own
+ * some seconds after it boots.
+ *
+ * @return true if the FONA is registered with its home network or roaming, false otherwise.
+*/
+
+bool FonaShield::IsRegistered() {
+  int stat = readRegistration(F("AT+CREG?"));
+  // Stat 1 is the home network, 5 is roaming.
+  return stat == 1 || stat == 5;
+}
+
+/*
+ * Asks the FONA for a registration state.
+ *
+ * @input AT+CREG? or AT+CGREG?.
+ * @return the <stat> of the reply (format: +CREG: <n>,<stat>), or -1 if there wasn't one.
+*/
+
+int FonaShield::readRegistration(FlashStrPtr at_command) {
+  char rep_buf[BUF_LENGTH_SMALL];
+  sendATCommand(at_command);
+  if (!readAvailBytesFromSerial(rep_buf, sizeof(rep_buf), AT_TIMEOUT)) return -1;
+  char *stat_ptr = strchr(rep_buf, ',');
+  if (stat_ptr == NULL) return -1;
+  return atoi(stat_ptr + 1);
+}
+
 /*
  * This method retries at AT command for MAX_RETRIES number of times.
  *
@@ -62,6 +113,7 @@ bool FonaShield::retryATCommand(FlashStrPtr at_command, FlashStrPtr expected_res
 
 
 bool FonaShield::enableGPRS() {
+  _is_gprs_up = false;
   // DEBUG_PRINTLN_FLASH("Attempting to enable GPRS");
   // DEBUG_PRINTLN_FLASH("Shutting down connections");
   if (!sendATCommandCheckReply(F("AT+CIPSHUT"), F(NEW_LINE_BYTES "SHUT OK" NEW_LINE_BYTES), 1000)) return false;
@@ -80,99 +132,375 @@ bool FonaShield::enableGPRS() {
   // DEBUG_PRINTLN_FLASH("Bring up wireless connection");
   if (!sendATCommandCheckReply(F("AT+CIICR"), OK_REPLY, 1000)) return false;
 
+  _is_gprs_up = true;
+  return true;
+}
+
+/*
+ * Picks up a FONA that kept running while the Arduino was reset. Unlike initShield() the FONA
+ * isn't reset, it's only checked that it still has echo off (so it was set up by us) and that its
+ * GPRS bearer is still open. It may have been asleep (see SetPowerState()), so it is woken up
+ * first.
+ *
+ * @return true if the FONA is ready for HTTP requests, false if it needs initShield() and
+ * enableGPRS().
+*/
+
+bool FonaShield::resumeShield() {
+  _fona_serial->begin(4800);
+  _is_gprs_up = false;
+  _power_state = MODEM_SLEEP;
+  wakeSerial();
+  if (!sendATCommandCheckReply(F("AT"), OK_REPLY)) return false;
+  if (!sendATCommandCheckReply(F("AT+CSCLK=0"), OK_REPLY)) return false;
+  _power_state = MODEM_ACTIVE;
+  _idle_power_state = MODEM_ACTIVE;
+  char rep_buf[BUF_LENGTH_MEDIUM];
+  sendATCommand(F("AT+SAPBR=2,1"));
+  if (!readAvailBytesFromSerial(rep_buf, sizeof(rep_buf), 500)) return false;
+  // Format: +SAPBR: <cid>,<status>,<ip>. Status 1 means the bearer is connected.
+  if (strstr_P(rep_buf, PSTR("+SAPBR: 1,1,")) == NULL) return false;
+  _is_gprs_up = true;
+  return true;
+}
+
+/*
+ * @return true if GPRS was brought up by enableGPRS() or resumeShield() and the FONA hasn't been
+ * reset or put to sleep since.
+*/
+
+bool FonaShield::IsGPRSUp() {
+  return _is_gprs_up;
+}
+
+/*
+ * Sets the power state the FONA should be in while no request is being made. It is brought to
+ * MODEM_ACTIVE for every HTTP request and goes back to this state as soon as the request is done.
+ * The FSM states pick it by what they need next:
+ * - MODEM_ACTIVE: awake all the time. For states that talk to it back to back (BUZZ).
+ * - MODEM_SLEEP: registered with the network and the GPRS bearer kept open, but the FONA sleeps
+ *   whenever its serial line is idle (AT+CSCLK=2). Waking it up takes a fraction of a second.
+ * - MODEM_MIN_FUNC: the radio is off as well (AT+CFUN=0). Waking it up means registering with the
+ *   network and bringing GPRS back up, which takes seconds.
+ * MODEM_OFF is where a reset leaves the FONA until initShield(). There is no way back to it: the
+ * FONA's power key isn't wired to the Arduino.
+ *
+ * How long it last took to wake up from each state is kept, see PrintPowerState().
+ *
+ * @input one of modem_power_states other than MODEM_OFF.
+ * @return true if the FONA is in that state now, false if it couldn't be brought there (it stays
+ * in the state it was in, or in MODEM_OFF until initShield()).
+*/
+
+bool FonaShield::SetPowerState(unsigned char power_state) {
+  if (power_state == MODEM_OFF) return false;
+  _idle_power_state = power_state;
+  return changePowerState(power_state);
+}
+
+/*
+ * @return the power state the FONA is in, one of modem_power_states.
+*/
+
+unsigned char FonaShield::PowerState() {
+  return _power_state;
+}
+
+/*
+ * Prints the power state and how long it last took to wake up from each state over USB serial.
+*/
+
+void FonaShield::PrintPowerState() {
+  DEBUG_PRINT_FLASH("FONA power state: ");
+  DEBUG_PRINTLN(_power_state);
+  for (unsigned char i = MODEM_MIN_FUNC; i < MODEM_ACTIVE; i++) {
+    DEBUG_PRINT_FLASH("Resume from ");
+    DEBUG_PRINT(i);
+    DEBUG_PRINT_FLASH(" (ms): ");
+    DEBUG_PRINTLN(_resume_ms[i]);
+  }
+}
+
+/*
+ * Moves the FONA to the given power state. Waking up goes through MODEM_ACTIVE and is timed.
+ *
+ * @input one of modem_power_states other than MODEM_OFF.
+ * @return true if the FONA is in that state now, false otherwise.
+*/
+
+bool FonaShield::changePowerState(unsigned char power_state) {
+  if (power_state == _power_state) return true;
+  // Only initShield() and resumeShield() can bring it up from there.
+  if (_power_state == MODEM_OFF) return false;
+  if (power_state > _power_state) {
+    unsigned char from = _power_state;
+    unsigned long start_time = millis();
+    if (from == MODEM_MIN_FUNC) {
+      if (!wakeShield()) return false;
+    } else {
+      wakeSerial();
+      if (!sendATCommandCheckReply(F("AT+CSCLK=0"), OK_REPLY)) return false;
+      _power_state = MODEM_ACTIVE;
+    }
+    _resume_ms[from] = millis() - start_time;
+  }
+  if (power_state == MODEM_SLEEP) {
+    if (_power_state == MODEM_ACTIVE && !sendATCommandCheckReply(F("AT+CSCLK=2"), OK_REPLY)) return false;
+    _power_state = MODEM_SLEEP;
+  } else if (power_state == MODEM_MIN_FUNC) {
+    wakeSerial();
+    if (!sleepShield()) return false;
+  }
   return true;
 }
 
 /*
- * Returns the current voltage of the FONA lipo in mV.
+ * Turns the radio off (minimum functionality, AT+CFUN=0) and lets the FONA go into its sleep mode
+ * whenever the serial line is idle (AT+CSCLK=2).
+ *
+ * @return true if the FONA acknowledged both commands, false otherwise.
+*/
+
+bool FonaShield::sleepShield() {
+  _is_gprs_up = false;
+  if (!sendATCommandCheckAck(F("AT+CFUN=0"), 1000)) return false;
+  if (!sendATCommandCheckReply(F("AT+CSCLK=2"), OK_REPLY)) return false;
+  _power_state = MODEM_MIN_FUNC;
+  return true;
+}
+
+/*
+ * Undoes sleepShield(). The radio has to reregister with the network after AT+CFUN=1, which tears
+ * down the GPRS context, so GPRS is brought back up as well.
+ *
+ * @return true if the FONA is awake and GPRS is enabled, false otherwise.
+*/
+
+bool FonaShield::wakeShield() {
+  wakeSerial();
+  if (!retryATCommand(F("AT"), OK_REPLY)) return false;
+  if (!sendATCommandCheckReply(F("AT+CSCLK=0"), OK_REPLY)) return false;
+  _power_state = MODEM_ACTIVE;
+  if (!sendATCommandCheckAck(F("AT+CFUN=1"), 1000)) return false;
+  // GPRS can't come up before the radio is registered, retrying enableGPRS() until then only
+  // burns the retries.
+  unsigned long start_time = millis();
+  while (!IsRegistered()) {
+    if (millis() - start_time >= WAKE_REG_TIMEOUT) return false;
+    delay(500);
+    watchdog.Kick();
+  }
+  int num_tries = 0;
+  while (num_tries < MAX_RETRIES && !enableGPRS()) {
+    delay(1000);
+    num_tries++;
+    // All the attempts together take longer than the watchdog budget, one doesn't.
+    watchdog.Kick();
+  }
+  return num_tries < MAX_RETRIES;
+}
+
+/*
+ * The first byte sent to a FONA whose serial line is asleep (AT+CSCLK=2) is lost, and it takes a
+ * moment to wake up. A throw away AT takes care of both. Does nothing if the FONA is awake.
+*/
+
+void FonaShield::wakeSerial() {
+  if (_power_state == MODEM_ACTIVE) return;
+  sendATCommand(F("AT"));
+  delay(100);
+  while (_fona_serial->available()) _fona_serial->read();
+}
+
+/*
+ * Returns the current voltage of the FONA lipo in mV. While the FONA is asleep it is only asked
+ * every ASLEEP_STATUS_MAX_AGE, in between the last reading is returned. Its serial line goes back
+ * to sleep by itself afterwards.
  *
- * @return the current voltage of the FONA lipo in mV, or -1 if something went wrong.
+ * @return the current voltage of the FONA lipo in mV, or -1 if something went wrong or the FONA
+ * hasn't been set up yet.
 */
 
 int FonaShield::GetBatteryVoltage() {
+  if (_power_state == MODEM_OFF) return -1;
+  if (_power_state != MODEM_ACTIVE && _batt_mv != -1 && millis() - _batt_time < ASLEEP_STATUS_MAX_AGE) return _batt_mv;
+  wakeSerial();
   char batt_stat_res_buf[BUF_LENGTH_SMALL];
   sendATCommand(F("AT+CBC"));
   if (!readAvailBytesFromSerial(batt_stat_res_buf, sizeof(batt_stat_res_buf), 500)) return -1;
-  if (batt_stat_res_buf == NULL) return -1;
   char *voltage_ptr = strrchr(batt_stat_res_buf, ',');
   if (voltage_ptr == NULL) return -1;
-  return atoi(++voltage_ptr);
+  _batt_mv = atoi(++voltage_ptr);
+  _batt_time = millis();
+  return _batt_mv;
 }
 
 /*
- * Returns the RSSI (received signal strength indicator, used to measure the strength of a radio
- * signal) of the cell modem.
+ * Takes a link sample for link_monitor: the RSSI (received signal strength indicator) and BER from
+ * AT+CSQ, and the registration state from AT+CREG? and AT+CGREG?. Nothing is sent if the last
+ * sample is younger than the given age (see LinkMonitor::SampleMaxAge()), so this can be called
+ * every loop. A sleeping FONA is woken up for it.
+ *
+ * The FONA could report registration changes on its own (+CREG/+CGREG URCs), but those would turn
+ * up in the middle of the replies this driver compares byte for byte, so they're asked for instead.
  *
- * @return the RSSI value of the cell modem, or -1 if something went wrong.
+ * @input the oldest sample (in ms) that will do. 0 always asks.
+ * @return false if the FONA didn't answer or the radio is off, true otherwise.
 */
 
-int FonaShield::GetRSSIVal() {
+bool FonaShield::SampleLink(unsigned long max_age) {
+  if (_power_state < MODEM_SLEEP) return false;
+  if (_link_sample_time != 0 && millis() - _link_sample_time < max_age) return true;
+  wakeSerial();
   char csq_res_buf[BUF_LENGTH_SMALL];
   sendATCommand(F("AT+CSQ"));
-  if (!readAvailBytesFromSerial(csq_res_buf, sizeof(csq_res_buf), 500)) return -1;
-  if (csq_res_buf == NULL) return -1;
+  if (!readAvailBytesFromSerial(csq_res_buf, sizeof(csq_res_buf), 500)) return false;
   char *rssi_ptr = strchr(csq_res_buf, ':');
-  if (rssi_ptr == NULL) return -1;
-  // Advance from the : to the actual number (format: CSQ: RSSI, BER)
+  if (rssi_ptr == NULL) return false;
+  // Advance from the : to the actual number (format: CSQ: RSSI,BER)
   rssi_ptr += 2;
-  char *rssi_end_ptr = strchr(csq_res_buf, ',');
-  if (rssi_end_ptr == NULL) return -1;
-  *rssi_end_ptr = '\0';
-  return atoi(rssi_ptr);
+  char *ber_ptr = strchr(rssi_ptr, ',');
+  if (ber_ptr == NULL) return false;
+  link_monitor.AddSignal(atoi(rssi_ptr), atoi(ber_ptr + 1));
+  int cs_stat = readRegistration(F("AT+CREG?"));
+  int ps_stat = readRegistration(F("AT+CGREG?"));
+  link_monitor.SetRegistration(cs_stat == 1 || cs_stat == 5, ps_stat == 1 || ps_stat == 5);
+  _link_sample_time = millis();
+  return true;
+}
+
+/*
+ * @return how long ago (in ms) SampleLink() last got a sample, or since boot if it never has.
+*/
+
+unsigned long FonaShield::LinkSampleAge() {
+  return millis() - _link_sample_time;
+}
+
+/*
+ * Fills in what the driver knows about the FONA: its power states, GPRS, and how old the last
+ * battery reading and link sample are (which decides when loop() asks for the next ones).
+ *
+ * @input where to put it.
+*/
+
+void FonaShield::SaveState(FonaState *state) {
+  state->power_state = _power_state;
+  state->idle_power_state = _idle_power_state;
+  state->is_gprs_up = _is_gprs_up;
+  state->batt_mv = _batt_mv;
+  state->batt_age = (_batt_mv == -1) ? FONA_STATE_NEVER : millis() - _batt_time;
+  state->link_sample_age = (_link_sample_time == 0) ? FONA_STATE_NEVER : millis() - _link_sample_time;
+}
+
+/*
+ * Takes the driver back to what SaveState() handed out, without talking to the FONA. The FONA has
+ * to be in that state already. tools/serial_replay uses this to start a recorded run in the middle.
+ *
+ * @input what SaveState() filled in.
+*/
+
+void FonaShield::RestoreState(const FonaState *state) {
+  _power_state = state->power_state;
+  _idle_power_state = state->idle_power_state;
+  _is_gprs_up = state->is_gprs_up;
+  _is_reset_started = false;
+  _batt_mv = (state->batt_age == FONA_STATE_NEVER) ? -1 : state->batt_mv;
+  _batt_time = millis() - state->batt_age;
+  _link_sample_time = (state->link_sample_age == FONA_STATE_NEVER) ? 0 : millis() - state->link_sample_age;
+}
+
+/*
+ * Returns whether the radio has been transmitting recently, i.e. whether an HTTP request ended less
+ * than RADIO_ACTIVE_WINDOW ms ago. Used to account for the load on the FONA lipo when estimating
+ * the battery percentage.
+ *
+ * @return true if the radio has been active in the last RADIO_ACTIVE_WINDOW ms, false otherwise.
+*/
+
+bool FonaShield::IsRadioActive() {
+  return _last_http_time != 0 && millis() - _last_http_time < RADIO_ACTIVE_WINDOW;
+}
+
+/*
+ * Returns whether the server answered the last HTTP request with a 304 (Not Modified). The reply
+ * body isn't read in that case, so the JsonExtractor passed in was never fed.
+ *
+ * @return true if the last HTTP request got a 304, false otherwise.
+*/
+
+bool FonaShield::WasNotModified() {
+  return _is_not_modified;
+}
+
+/*
+ * @return the last AT command sent to the FONA (for the crash record, see Watchdog.h), or NULL if
+ * none has been sent yet.
+*/
+
+FlashStrPtr FonaShield::LastATCommand() {
+  return _last_at_command;
 }
 
 /*
- * Fills the given char buf with one line of an HTTP response. It is assumed that an HTTP request
- * of some sort was initiated before this method was called, otherwise all this method will do is
- * eventually return TIMEOUT.
+ * Feeds the JSON object on the first line of an HTTP response to the given JsonExtractor. It is
+ * assumed that an HTTP request of some sort was initiated before this method was called, otherwise
+ * all this method will do is eventually return TIMEOUT.
  *
  * If something goes wrong in collecting the response (response is there but something else has gone
  * wrong), this method will automatically close the HTTP request. This method will also close the
- * HTTP request if the HTTP status isn't 200.
+ * HTTP request if the HTTP status isn't 200 or 304. A 304 has no body, so AT+HTTPREAD is skipped.
  *
- * @input a char buf to fill with one line of an HTTP response.
- * @input the length of that char buf.
- * @return SUCCESS if http_res_buffer is now filled with one line of an HTTP response, TIMEOUT if
- * now response was received in HTTP_TIMEOUT, or ERROR if something went wrong in collecting the
- * response.
+ * @input a JsonExtractor for the reply.
+ * @return SUCCESS if a whole JSON object was fed to the JsonExtractor, TIMEOUT if no response was
+ * received in HTTP_TIMEOUT, or ERROR if something went wrong in collecting the response.
 */
 
-int FonaShield::GetOneLineHTTPRes(char *http_res_buffer, int http_res_buffer_len) {
-  char at_res_buffer[BUF_LENGTH_LARGE];
+int FonaShield::GetJSONHTTPRes(JsonExtractor *reply) {
+  // Only has to hold the +HTTPACTION line, the body is streamed by readHTTPBody.
+  char at_res_buffer[BUF_LENGTH_MEDIUM];
   unsigned long start_time = millis();
   while(sendATCommandCheckReply(F("AT+HTTPREAD"), at_res_buffer, sizeof(at_res_buffer), OK_REPLY, 1000)) {
     // Deals with millis() overflowing
     unsigned long elapsed_time = (millis() >= start_time) ? millis() - start_time : (ULONG_MAX - start_time) + millis();
-    if (elapsed_time > HTTP_TIMEOUT) return TIMEOUT;
+    if (elapsed_time > HTTP_TIMEOUT) {
+      link_monitor.AddRequest(false, elapsed_time);
+      return TIMEOUT;
+    }
   }
   int status = getHTTPStatusFromRes(at_res_buffer);
+  // The FONA reports its own network errors (no GPRS, DNS failure, ...) as 6xx statuses.
+  link_monitor.AddRequest(status != -1 && status < 600, millis() - start_time);
+  _is_not_modified = status == 304;
+  if (_is_not_modified) return SUCCESS;
   if (status != 200) return HTTPFail();
   sendATCommand(F("AT+HTTPREAD"));
-  readAvailBytesFromSerial(at_res_buffer, sizeof(at_res_buffer), 1000);
-  if (!getOneLineHTTPReplyFromRes(at_res_buffer, sizeof(at_res_buffer), http_res_buffer, http_res_buffer_len)) return HTTPFail();
+  if (!readHTTPBody(reply, 1000)) return HTTPFail();
   return SUCCESS;
 }
 
 /*
- * This method initiates an HTTP POST request for the given URL and collects one line of the HTTP
- * response. It is assumed that the char buf containing the POST data is only one line.
+ * This method initiates an HTTP POST request for the given URL and feeds the JSON reply to a
+ * JsonExtractor. It is assumed that the char buf containing the POST data is only one line.
  *
- * @input a FlashStrPtr representing the URL to POST the data to.
+ * @input a char buf with the start of the URL to POST the data to (e.g. the API base URL).
+ * @input a FlashStrPtr with the rest of the URL (e.g. the endpoint path).
  * @input a char buf with 1 line of POST data.
  * @input the length of the above char buf.
- * @input a char buf to put one line of the HTTP reply in.
- * @input the length of the above char buf.
+ * @input a JsonExtractor for the reply.
  * @return SUCCESS if everything went smoothly and we POSTed one line of data to the given URL
- * and collected one line of the reply, ERROR otherwise.
+ * and extracted the reply (or got a 304), ERROR otherwise, a timeout included.
 */
 
-int FonaShield::HTTPPOSTOneLine(FlashStrPtr URL, char *post_data_buffer, int post_data_buffer_len,
-                                char *http_res_buffer, int http_res_buffer_len) {
-  if (!HTTPInit(URL)) return HTTPFail();
+int FonaShield::HTTPPOSTJSON(const char *url_base, FlashStrPtr url_path, char *post_data_buffer,
+                             int post_data_buffer_len, JsonExtractor *reply) {
+  if (!changePowerState(MODEM_ACTIVE)) return ERROR;
+  if (!HTTPInit(url_base, url_path)) return HTTPFail();
   if (!setHTTPParam(F("CONTENT"), F("application/json"))) return HTTPFail();
   if (!sendHTTPDataCheckReply(post_data_buffer, post_data_buffer_len)) return HTTPFail();
   if (!sendATCommandCheckReply(F("AT+HTTPACTION=1"), OK_REPLY)) return HTTPFail();
-  if (GetOneLineHTTPRes(http_res_buffer, http_res_buffer_len) == ERROR) return HTTPFail();
+  // A 304 has no body, anything else has to have a whole JSON object.
+  if (GetJSONHTTPRes(reply) != SUCCESS || !(reply->IsDone() || _is_not_modified)) return HTTPFail();
   return !HTTPFail();
 }
 
@@ -187,14 +515,12 @@ int FonaShield::HTTPPOSTOneLine(FlashStrPtr URL, char *post_data_buffer, int pos
 bool FonaShield::sendHTTPDataCheckReply(char *post_data_buffer, int post_data_buffer_len) {
   // the 1000 represents how long in ms the cell radio will wait for more bytes of the POST data
   // before moving on.
-  FlashStrPtr command_skeleton = F("AT+HTTPDATA=%d,1000");
-  int num_digits_post_data_buf_len = NUM_DIGITS(post_data_buffer_len);
-  // -2 because the format specifier won't who up in the actual buf
-  char buf[strlen_P((prog_char *)command_skeleton)-2+num_digits_post_data_buf_len+1];
-  snprintf_P(buf, sizeof(buf), (prog_char *)command_skeleton, post_data_buffer_len);
-  DEBUG_PRINT_FLASH("Sent: ");
-  DEBUG_PRINTLN(buf);
-  _fona_serial->println(buf);
+  sendATCommand(F("AT+HTTPDATA="), false);
+  DEBUG_PRINTLN(post_data_buffer_len);
+  _fona_serial->print(post_data_buffer_len);
+  _fona_serial->println(F(",1000"));
+  _is_at_command_done = true;
+  char buf[BUF_LENGTH_SMALL];
   readAvailBytesFromSerial(buf, sizeof(buf), 500);
   if (!isEqual(buf, F(NEW_LINE_BYTES "DOWNLOAD" NEW_LINE_BYTES))) return false;
   _fona_serial->println(post_data_buffer);
@@ -218,69 +544,96 @@ bool FonaShield::setHTTPParam(FlashStrPtr param_name, FlashStrPtr param_val) {
 }
 
 /*
- * This method performs an HTTP GET request. One line of the response will be placed in the given
- * char buf.
+ * This method performs an HTTP GET request and feeds the JSON reply to a JsonExtractor.
  *
- * @input a FlashStrPtr representing the URL that we will be GETing from.
- * @input a char buf where one line of the response will be placed.
- * @input the length of the above char buf.
- * @return SUCCESS if everything went fine, ERROR otherwise.
+ * @input a char buf with the start of the URL that we will be GETing from.
+ * @input a FlashStrPtr with the rest of the URL.
+ * @input a JsonExtractor for the reply.
+ * @return SUCCESS if a whole JSON reply (or a 304) came back, ERROR otherwise, a timeout included.
 */
 
-int FonaShield::HTTPGETOneLine(FlashStrPtr URL, char *http_res_buffer, int http_res_buffer_len) {
-  if (!HTTPInit(URL)) return HTTPFail();
+int FonaShield::HTTPGETJSON(const char *url_base, FlashStrPtr url_path, JsonExtractor *reply) {
+  if (!changePowerState(MODEM_ACTIVE)) return ERROR;
+  if (!HTTPInit(url_base, url_path)) return HTTPFail();
   if (!sendATCommandCheckReply(F("AT+HTTPACTION=0"), OK_REPLY)) return HTTPFail();
-  if (GetOneLineHTTPRes(http_res_buffer, http_res_buffer_len) == ERROR) return HTTPFail();
+  // A 304 has no body, anything else has to have a whole JSON object.
+  if (GetJSONHTTPRes(reply) != SUCCESS || !(reply->IsDone() || _is_not_modified)) return HTTPFail();
   return !HTTPFail();
 }
 
 /*
  * This method terminates an HTTP request and returns ERROR. Used as a helper method by the various
- * other methods that make HTTP requests.
+ * other methods that make HTTP requests, and at the end of every request, so the FONA goes back to
+ * the power state the FSM asked for (see SetPowerState()) from here.
  *
  * @return ERROR.
 */
 
 int FonaShield::HTTPFail() {
   sendATCommandCheckReply(F("AT+HTTPTERM"), OK_REPLY);
+  _last_http_time = millis();
+  changePowerState(_idle_power_state);
   return ERROR;
 }
 
 /*
  * Initializes an HTTP request. Can be used to initialize either a POST or GET request.
  *
- * @input a FlashStrPtr representing the destination URL of the request.
+ * @input a char buf with the start of the destination URL of the request.
+ * @input a FlashStrPtr with the rest of the destination URL.
  * @return true if everything went according to plan, false otherwise.
 */
 
-bool FonaShield::HTTPInit(FlashStrPtr URL) {
+bool FonaShield::HTTPInit(const char *url_base, FlashStrPtr url_path) {
+  _last_http_time = millis();
+  _is_not_modified = false;
   if (!sendATCommandCheckAck(F("AT+HTTPTERM"), 500)) return false;
   if (!sendATCommandCheckReply(F("AT+HTTPINIT"), OK_REPLY)) return false;
   if (!setHTTPParam(F("CID"), F("1"))) return false;
-  if (!setHTTPParam(F("URL"), URL)) return false;
+  if (!setHTTPURL(url_base, url_path)) return false;
   return true;
 }
 
 /*
- * This method performs the actual dirty work of extracting one line of an HTTP response from the
- * raw bytes received from the radio.
+ * Sets the URL HTTP parameter. The URL is written to the cell radio in two parts so it never has
+ * to be put together in RAM.
  *
- * @input a char buf with the raw bytes received from the radio.
- * @input the length of that char buf.
- * @input a char buf where one line of the HTTP response will go.
- * @input the length of the above char buf.
- * @return true if one line of the HTTP response was successfully extracted, false otherwise.
+ * @input a char buf with the start of the URL.
+ * @input a FlashStrPtr with the rest of the URL.
+ * @return true if the cell radio accepted the URL, false otherwise.
 */
 
-bool FonaShield::getOneLineHTTPReplyFromRes(char *at_res_buffer, int at_res_buffer_len, char *http_res_buffer, int http_res_buffer_len) {
-  if (!at_res_buffer || !http_res_buffer) return false;
-  char *line = strtok(at_res_buffer, "\r\xA");
-  if (!line) return false;
-  line = strtok(NULL, "\r\xA");
-  int num_bytes_to_copy = (strlen(line) +1 <= http_res_buffer_len) ? strlen(line) : http_res_buffer_len-1;
-  memcpy(http_res_buffer, line, num_bytes_to_copy);
-  http_res_buffer[num_bytes_to_copy] = '\0';
-  return true;
+bool FonaShield::setHTTPURL(const char *url_base, FlashStrPtr url_path) {
+  sendATCommand(F("AT+HTTPPARA=\"URL\",\""), false);
+  DEBUG_PRINTLN(url_base);
+  _fona_serial->print(url_base);
+  sendATCommand(url_path, false);
+  sendATCommand(F("\""));
+  return checkATCommandReply(OK_REPLY, AT_TIMEOUT);
+}
+
+/*
+ * Reads the reply to AT+HTTPREAD straight from serial and feeds the body to a JsonExtractor. The
+ * reply looks like \r\n+HTTPREAD: <len>\r\n<body>\r\nOK\r\n and the body is the second line.
+ * Like readAvailBytesFromSerial, this keeps reading until no bytes have come in for the timeout
+ * so the trailing OK doesn't end up in the reply to the next command.
+ *
+ * @input a JsonExtractor for the body.
+ * @input how long to wait (in ms) after the last byte before giving up.
+ * @return true if a whole JSON object was fed to the JsonExtractor.
+*/
+
+bool FonaShield::readHTTPBody(JsonExtractor *reply, unsigned long timeout) {
+  unsigned char num_lines_read = 0;
+  unsigned long last_time_since_bytes = millis();
+  while (millis() - last_time_since_bytes < timeout) {
+    if (!_fona_serial->available()) continue;
+    last_time_since_bytes = millis();
+    char c = _fona_serial->read();
+    if (c == '\n') num_lines_read++;
+    else if (c != '\r' && num_lines_read == 2) reply->Feed(c);
+  }
+  return reply->IsDone();
 }
 
 /*
@@ -444,6 +797,9 @@ int FonaShield::isEqual(char *buf1, FlashStrPtr buf2) {
 */
 
 void FonaShield::sendATCommand(FlashStrPtr command, bool use_newline) {
+  // A command sent in pieces (see setHTTPURL()) is remembered by its first piece.
+  if (_is_at_command_done) _last_at_command = command;
+  _is_at_command_done = use_newline;
   DEBUG_PRINT_FLASH("Sent: ");
   DEBUG_PRINT(command);
   DEBUG_PRINTLN_FLASH("");
@@ -465,7 +821,6 @@ bool FonaShield::readAvailBytesFromSerial(char *buffer, int buffer_len, unsigned
   int i=0;
 
   unsigned long last_time_since_bytes = millis();
-  int num_lines_read = 0;
   while (millis() - last_time_since_bytes < timeout) {
     if (_fona_serial->available()) {
       last_time_since_bytes = millis();
@@ -482,15 +837,16 @@ bool FonaShield::readAvailBytesFromSerial(char *buffer, int buffer_len, unsigned
 }
 
 /*
- * This method resets the FONA back to factory configuration.
+ * This method resets the FONA back to factory configuration. The reset line is
+ * ThisBoard::FonaRst (see Board.h).
  *
 */
 
 void FonaShield::resetShield() {
-  digitalWrite(_rst_pin, HIGH);
+  ThisBoard::FonaRst::SetHigh();
   delay(100);
-  digitalWrite(_rst_pin, LOW);
+  ThisBoard::FonaRst::SetLow();
   delay(100);
-  digitalWrite(_rst_pin, HIGH);
+  ThisBoard::FonaRst::SetHigh();
   sendATCommand(F("ATZ"));
 }
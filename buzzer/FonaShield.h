@@ -12,6 +12,7 @@
 
 #include <SoftwareSerial.h>
 #include "Helpers.h"
+#include "JsonExtractor.h"
 
 // Baud rate of cell radio.
 #define _baud_rate 4800
@@ -29,11 +30,59 @@
 // assume no new bytes are coming.
 #define AT_TIMEOUT 100
 
+// How long (in ms) after the end of an HTTP request the radio is still considered to be active.
+// The FONA keeps the GPRS link in its high power state for a while after a transfer.
+#define RADIO_ACTIVE_WINDOW 10000
+
+// How long (in ms) wakeShield() waits for the radio to register with the network again.
+#define WAKE_REG_TIMEOUT 30000
+
+// Oldest battery reading or link sample (in ms) that will do while the FONA is asleep. Waking it
+// up to ask costs more than a fresh reading is worth.
+#define ASLEEP_STATUS_MAX_AGE 60000
+
+// Power states of the FONA, from least to most ready. See SetPowerState().
+enum modem_power_states {MODEM_OFF, MODEM_MIN_FUNC, MODEM_SLEEP, MODEM_ACTIVE, NUM_MODEM_POWER_STATES};
+
+// Age SaveState() gives for a battery reading or link sample that was never taken.
+#define FONA_STATE_NEVER 0xFFFFFFFFUL
+
+// What SaveState() hands out and RestoreState() takes back: enough of the driver's state to pick up
+// where it was without talking to the FONA.
+struct FonaState {
+  unsigned char power_state;
+  unsigned char idle_power_state;
+  bool is_gprs_up;
+  // Last battery reading, -1 if there is none.
+  int batt_mv;
+  // How long ago (in ms) the battery reading and the link sample were taken, or FONA_STATE_NEVER.
+  unsigned long batt_age;
+  unsigned long link_sample_age;
+};
+
 // Main class that serves as the FONA 800 driver.
 class FonaShield {
   private:
     SoftwareSerial *_fona_serial;
-    int _rst_pin;
+    // One of modem_power_states. The FONA is brought to MODEM_ACTIVE for every request and goes
+    // back to _idle_power_state (what the FSM asked for) afterwards.
+    unsigned char _power_state = MODEM_OFF;
+    unsigned char _idle_power_state = MODEM_ACTIVE;
+    // How long (in ms) it last took to get from each power state to MODEM_ACTIVE.
+    unsigned int _resume_ms[NUM_MODEM_POWER_STATES] = {0};
+    // When the last link sample was taken, 0 if there hasn't been one.
+    unsigned long _link_sample_time = 0;
+    // Last battery reading and when it was taken, -1 if there is none.
+    int _batt_mv = -1;
+    unsigned long _batt_time = 0;
+    bool _is_gprs_up = false;
+    // Set by StartReset(), cleared by the initShield() that picks the reset up.
+    bool _is_reset_started = false;
+    bool _is_not_modified = false;
+    // Last AT command sent and whether it has been ended with a newline yet.
+    FlashStrPtr _last_at_command = NULL;
+    bool _is_at_command_done = true;
+    unsigned long _last_http_time = 0;
     bool readAvailBytesFromSerial(char *buffer, int buffer_len, unsigned long timeout);
     void resetShield();
     void sendATCommand(FlashStrPtr command, bool use_newline = true);
@@ -45,22 +94,41 @@ class FonaShield {
     bool checkATCommandReply(FlashStrPtr expected_reply, char *rep_buffer, int buffer_len, unsigned long timeout);
     int getHTTPStatusFromRes(char *rep_buffer);
     int isEqual(char *buf1, FlashStrPtr buf2);
-    bool getOneLineHTTPReplyFromRes(char *at_res_buffer, int at_res_buffer_len, char *http_res_buffer, int http_res_buffer_len);
-    bool HTTPInit(FlashStrPtr URL);
+    bool readHTTPBody(JsonExtractor *reply, unsigned long timeout);
+    bool HTTPInit(const char *url_base, FlashStrPtr url_path);
+    bool setHTTPURL(const char *url_base, FlashStrPtr url_path);
     int HTTPFail();
     bool setHTTPParam(FlashStrPtr param_name, FlashStrPtr param_val);
     bool sendHTTPDataCheckReply(char *post_data_buffer, int post_data_buffer_len);
-    int GetOneLineHTTPRes(char *http_res_buffer, int http_res_buffer_len);
+    int GetJSONHTTPRes(JsonExtractor *reply);
     bool retryATCommand(FlashStrPtr at_command, FlashStrPtr expected_response);
+    bool changePowerState(unsigned char power_state);
+    bool sleepShield();
+    bool wakeShield();
+    void wakeSerial();
+    int readRegistration(FlashStrPtr at_command);
   public:
-    FonaShield(SoftwareSerial *fona_serial, int rst_pin);
+    FonaShield(SoftwareSerial *fona_serial);
+    void StartReset();
     bool initShield();
+    bool IsRegistered();
     bool enableGPRS();
-    int HTTPGETOneLine(FlashStrPtr URL, char *http_res_buffer, int http_res_buffer_len);
-    int HTTPPOSTOneLine(FlashStrPtr URL, char *post_data_buffer, int post_data_buffer_len,
-                         char *http_res_buffer, int http_res_buffer_len);
+    bool resumeShield();
+    bool IsGPRSUp();
+    bool SetPowerState(unsigned char power_state);
+    unsigned char PowerState();
+    void PrintPowerState();
+    int HTTPGETJSON(const char *url_base, FlashStrPtr url_path, JsonExtractor *reply);
+    int HTTPPOSTJSON(const char *url_base, FlashStrPtr url_path, char *post_data_buffer,
+                     int post_data_buffer_len, JsonExtractor *reply);
     int GetBatteryVoltage();
-    int GetRSSIVal();
+    bool SampleLink(unsigned long max_age);
+    unsigned long LinkSampleAge();
+    void SaveState(FonaState *state);
+    void RestoreState(const FonaState *state);
+    bool IsRadioActive();
+    bool WasNotModified();
+    FlashStrPtr LastATCommand();
 };
 
 #endif
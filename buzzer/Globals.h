@@ -10,28 +10,51 @@
 #define GLOBALS_H
 
 #include <SoftwareSerial.h>
+#include "SerialLog.h"
 #include "BuzzerFSM.h"
 #include "FonaShield.h"
 #include "SSD1306Ascii.h"
-#include "SSD1306AsciiAvrI2c.h"
+#include "SSD1306AsciiAsyncI2c.h"
 #include "EEPROMReadWrite.h"
+#include "PowerManager.h"
+#include "ADCSampler.h"
+#include "Display.h"
+#include "RequestBodies.h"
+#include "Outbox.h"
+#include "ApiEndpoints.h"
+#include "StackMonitor.h"
+#include "Haptics.h"
+#include "Watchdog.h"
+#include "LinkMonitor.h"
 
 #define MAX_RETRIES 10
 #define BUF_LENGTH_LARGE 90
 #define BUF_LENGTH_MEDIUM 64
 #define BUF_LENGTH_SMALL 32
 #define NO_PARTY -1
-#define LOW_SIGNAL_THRESHOLD 5
 
 extern BuzzerFSM buzzer_fsm;
-extern SoftwareSerial fona_serial;
+extern FonaSerial fona_serial;
 extern FonaShield fona_shield;
-extern SSD1306AsciiAvrI2c oled;
+extern SSD1306AsciiAsyncI2c oled;
+extern Display display;
+extern PowerManager power_manager;
+extern ADCSampler adc_sampler;
+extern RequestBodies request_bodies;
+extern Outbox outbox;
+extern ApiEndpoints api_endpoints;
+extern StackMonitor stack_monitor;
+extern Haptics haptics;
+extern Watchdog watchdog;
+extern LinkMonitor link_monitor;
 enum ret_vals {SUCCESS, ERROR, REPEAT, TIMEOUT};
 extern EEPROMData eeprom_data;
+extern BootSnapshot boot_snapshot;
+extern bool is_warm_boot;
 extern short batt_percentage;
 extern bool has_system_been_initialized;
 extern unsigned long button_press_start;
+extern unsigned long last_batt_update;
 extern bool usb_cabled_plugged_in;
 
 #endif
@@ -0,0 +1,143 @@
+/*
+  File:
+  Haptics.cpp
+
+  Description:
+  Plays vibration patterns on the motor in the background from the Timer3 compare interrupt. See
+  Haptics.h.
+*/
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "Haptics.h"
+
+// The ISR needs to know which engine to hand ticks to.
+static Haptics *active_haptics = NULL;
+
+ISR(TIMER3_COMPA_vect) {
+  if (active_haptics != NULL) active_haptics->handleTick();
+}
+
+/*
+ * @input the pin the vibration motor is on. Must be a PWM pin for intensities other than 0/255.
+*/
+
+Haptics::Haptics(unsigned char motor_pin) : _motor_pin(motor_pin) {}
+
+/*
+ * Sets Timer3 up to tick every HAPTIC_TICK_MS (CTC mode, prescaler 64). The compare interrupt is
+ * only enabled while a pattern plays. Must be called once from setup() before Play().
+*/
+
+void Haptics::begin() {
+  active_haptics = this;
+  TIMSK3 &= ~_BV(OCIE3A);
+  TCCR3A = 0;
+  TCCR3B = _BV(WGM32) | _BV(CS31) | _BV(CS30);
+  OCR3A = F_CPU / 64 / (1000 / HAPTIC_TICK_MS) - 1;
+}
+
+/*
+ * Called from the Timer3 compare ISR every HAPTIC_TICK_MS while a pattern plays. Moves a ramp along
+ * and goes to the next step once the current one is done.
+*/
+
+void Haptics::handleTick() {
+  if (_step == NULL) return;
+  _ticks_left--;
+  if (_is_ramp) {
+    unsigned char ticks_done = _step_ticks - _ticks_left;
+    setLevel(_ramp_from + ((int) _ramp_to - _ramp_from) * ticks_done / _step_ticks);
+  }
+  if (_ticks_left == 0) {
+    _step++;
+    loadStep();
+  }
+}
+
+/*
+ * Starts playing a pattern, replacing whatever was playing. Returns straight away.
+ *
+ * @input a PROGMEM pattern, ended by a step with 0 ticks.
+ * @input true to play the pattern over and over until Stop() or the next Play().
+*/
+
+void Haptics::Play(const HapticStep *pattern, bool is_looping) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    _pattern = pattern;
+    _is_looping = is_looping;
+    _step = pattern;
+    loadStep();
+    if (_step != NULL) {
+      TCNT3 = 0;
+      TIFR3 = _BV(OCF3A);
+      TIMSK3 |= _BV(OCIE3A);
+    }
+  }
+}
+
+/*
+ * Stops the pattern that is playing, if any, and turns the motor off.
+*/
+
+void Haptics::Stop() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    TIMSK3 &= ~_BV(OCIE3A);
+    _step = NULL;
+    setLevel(0);
+  }
+}
+
+/*
+ * @return true if a pattern is still playing.
+*/
+
+bool Haptics::IsPlaying() {
+  return _step != NULL;
+}
+
+/*
+ * @return true if a looping pattern is playing. It plays until Stop() is called.
+*/
+
+bool Haptics::IsLooping() {
+  return _is_looping && _step != NULL;
+}
+
+/*
+ * Starts the step _step points to. The end of the pattern turns the motor and the tick off, or
+ * starts a looping pattern over. Called with interrupts off.
+*/
+
+void Haptics::loadStep() {
+  HapticStep step;
+  memcpy_P(&step, _step, sizeof(step));
+  // A looping pattern that is only an end step would never get past here, so it just ends.
+  if (step.ticks == 0 && _is_looping && _step != _pattern) {
+    _step = _pattern;
+    memcpy_P(&step, _step, sizeof(step));
+  }
+  if (step.ticks == 0) {
+    TIMSK3 &= ~_BV(OCIE3A);
+    _step = NULL;
+    setLevel(0);
+    return;
+  }
+  _ramp_from = _level;
+  _ramp_to = step.intensity;
+  _is_ramp = step.is_ramp;
+  _step_ticks = step.ticks;
+  _ticks_left = step.ticks;
+  if (!_is_ramp) setLevel(step.intensity);
+}
+
+/*
+ * @input the PWM duty to drive the motor at.
+*/
+
+void Haptics::setLevel(unsigned char level) {
+  if (level == _level && level != 0) return;
+  _level = level;
+  analogWrite(_motor_pin, level);
+}
@@ -0,0 +1,62 @@
+/*
+  File:
+  Haptics.h
+
+  Description:
+  Plays vibration patterns on the motor in the background. A pattern is a PROGMEM list of steps,
+  each holding the motor at an intensity (or ramping to it) for a number of HAPTIC_TICK_MS ticks.
+  Play() starts a pattern and returns straight away. The Timer3 compare interrupt then walks the
+  steps, so the caller can talk to the FONA or redraw the screen while the motor is going.
+
+  Timer3 isn't used by anything else. The motor PWM itself is still analogWrite() (Timer4). Timer3
+  stops in power-down, so PowerManager waits for a pattern to finish before powering down, or stops
+  a looping one, which never finishes.
+*/
+
+#ifndef HAPTICS_H
+#define HAPTICS_H
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+// Length of one pattern step tick.
+#define HAPTIC_TICK_MS 10
+
+// One step of a pattern. A step with 0 ticks ends the pattern: the motor is turned off, or a
+// looping pattern starts over.
+struct HapticStep {
+  // PWM duty (0-255) the motor is at by the end of the step.
+  unsigned char intensity;
+  // How long the step lasts, in HAPTIC_TICK_MS ticks.
+  unsigned char ticks;
+  // false: jump to intensity at the start of the step. true: ramp linearly from the previous
+  // intensity.
+  bool is_ramp;
+};
+
+class Haptics {
+  private:
+    unsigned char _motor_pin;
+    const HapticStep *_pattern = NULL;
+    bool _is_looping = false;
+    // Step being played, NULL if nothing is.
+    const HapticStep * volatile _step = NULL;
+    volatile unsigned char _level = 0;
+    unsigned char _ramp_from = 0;
+    unsigned char _ramp_to = 0;
+    bool _is_ramp = false;
+    unsigned char _step_ticks = 0;
+    unsigned char _ticks_left = 0;
+    void loadStep();
+    void setLevel(unsigned char level);
+  public:
+    Haptics(unsigned char motor_pin);
+    void begin();
+    void handleTick();
+    void Play(const HapticStep *pattern, bool is_looping = false);
+    void Stop();
+    bool IsPlaying();
+    bool IsLooping();
+};
+
+#endif
@@ -0,0 +1,161 @@
+/*
+  File:
+  HeartbeatCadence.h
+
+  Description:
+  Decides how often HEARTBEAT should ping the API. Early in the party's quoted wait the table is
+  nowhere near ready, so polling is slow. As the expected ready time gets closer the interval
+  shrinks down to HEARTBEAT_MIN_INTERVAL. A retry after hint from the heartbeat reply overrides
+  the computed interval.
+
+  A heartbeat that failed (or couldn't be sent because the outbox couldn't be drained) is retried
+  after HEARTBEAT_MIN_INTERVAL, doubled with every failure in a row up to HEARTBEAT_MAX_BACKOFF, so
+  a fleet doesn't hammer the API while it is down and comes back spread out.
+*/
+
+#ifndef HEARTBEATCADENCE_H
+#define HEARTBEATCADENCE_H
+
+// Bounds on the time (in ms) between the end of one heartbeat and the start of the next. The max
+// bounds how late a table that is ready earlier than quoted can be noticed.
+#define HEARTBEAT_MIN_INTERVAL 5000
+#define HEARTBEAT_MAX_INTERVAL 60000
+
+// Upper bound (in ms) on the wait after failed heartbeats.
+#define HEARTBEAT_MAX_BACKOFF 60000
+
+// The interval is the time left until the expected ready time divided by this.
+#define HEARTBEAT_INTERVAL_DIVISOR 4
+
+// Upper bound (in ms) on a retry after hint from the API, in case the API sends something silly.
+#define HEARTBEAT_MAX_RETRY_AFTER 600000
+
+class HeartbeatCadence {
+  private:
+    bool _has_accept_time = false;
+    unsigned long _accepted_at = 0;
+    unsigned long _quoted_wait = 0;
+    unsigned long _next_poll_at = 0;
+    bool _is_poll_due = true;
+    // Failed heartbeats in a row.
+    unsigned char _num_failures = 0;
+
+    /*
+     * Works out how long to wait before the next heartbeat based on how much of the quoted wait is
+     * left.
+     *
+     * @input the current time in ms.
+     * @return the interval in ms.
+    */
+
+    unsigned long nextInterval(unsigned long now) {
+      if (!_has_accept_time) return HEARTBEAT_MIN_INTERVAL;
+      unsigned long elapsed = now - _accepted_at;
+      if (elapsed >= _quoted_wait) return HEARTBEAT_MIN_INTERVAL;
+      unsigned long interval = (_quoted_wait - elapsed) / HEARTBEAT_INTERVAL_DIVISOR;
+      if (interval < HEARTBEAT_MIN_INTERVAL) return HEARTBEAT_MIN_INTERVAL;
+      if (interval > HEARTBEAT_MAX_INTERVAL) return HEARTBEAT_MAX_INTERVAL;
+      return interval;
+    }
+
+    /*
+     * Schedules the next heartbeat.
+     *
+     * @input the current time in ms.
+     * @input the time (in ms) until then.
+    */
+
+    void schedule(unsigned long now, unsigned long interval) {
+      _next_poll_at = now + interval;
+      _is_poll_due = false;
+    }
+
+  public:
+
+    /*
+     * Called when a party has just been accepted.
+     *
+     * @input the current time in ms.
+     * @input the quoted wait time of the party in minutes. <= 0 means unknown.
+    */
+
+    void PartyAccepted(unsigned long now, short wait_time) {
+      _has_accept_time = wait_time > 0;
+      _accepted_at = now;
+      _quoted_wait = (wait_time > 0) ? wait_time * 60000UL : 0;
+      _is_poll_due = true;
+    }
+
+    /*
+     * Called when the party is gone (seated or deleted). Until the next PartyAccepted() every
+     * heartbeat comes HEARTBEAT_MIN_INTERVAL after the last one, which is also what happens after a
+     * reboot with a party in the EEPROM since there's no way to know how much of the wait has
+     * already passed.
+    */
+
+    void PartyCleared() {
+      _has_accept_time = false;
+      _is_poll_due = true;
+    }
+
+    /*
+     * Called after a successful heartbeat to schedule the next one.
+     *
+     * @input the current time in ms.
+     * @input the retry after hint from the heartbeat reply in seconds, or <= 0 if there wasn't one.
+    */
+
+    void PollDone(unsigned long now, long retry_after) {
+      unsigned long interval = nextInterval(now);
+      if (retry_after > 0) {
+        interval = (unsigned long) retry_after * 1000;
+        if (interval > HEARTBEAT_MAX_RETRY_AFTER) interval = HEARTBEAT_MAX_RETRY_AFTER;
+      }
+      _num_failures = 0;
+      schedule(now, interval);
+    }
+
+    /*
+     * Called after a heartbeat failed, or couldn't be sent, to schedule the retry.
+     *
+     * @input the current time in ms.
+    */
+
+    void PollFailed(unsigned long now) {
+      unsigned long interval = HEARTBEAT_MIN_INTERVAL;
+      for (unsigned char i = 0; i < _num_failures && interval < HEARTBEAT_MAX_BACKOFF; i++) interval *= 2;
+      if (interval > HEARTBEAT_MAX_BACKOFF) interval = HEARTBEAT_MAX_BACKOFF;
+      if (_num_failures < 255) _num_failures++;
+      schedule(now, interval);
+    }
+
+    /*
+     * Makes the next IsPollDue() return true, e.g. when HEARTBEAT is entered.
+    */
+
+    void PollNow() {
+      _is_poll_due = true;
+    }
+
+    /*
+     * @input the current time in ms.
+     * @return true if it is time for the next heartbeat, false otherwise.
+    */
+
+    bool IsPollDue(unsigned long now) {
+      if (!_is_poll_due && (long) (now - _next_poll_at) >= 0) _is_poll_due = true;
+      return _is_poll_due;
+    }
+
+    /*
+     * @input the current time in ms.
+     * @return how long (in ms) until the next heartbeat is due, 0 if it is due now.
+    */
+
+    unsigned long TimeUntilPoll(unsigned long now) {
+      if (IsPollDue(now)) return 0;
+      return _next_poll_at - now;
+    }
+};
+
+#endif
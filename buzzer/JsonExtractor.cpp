@@ -0,0 +1,257 @@
+/*
+  File:
+  JsonExtractor.cpp
+
+  Description:
+  Single pass JSON field extractor for API replies. See JsonExtractor.h.
+*/
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include "JsonExtractor.h"
+
+/*
+ * Sets up the extractor and zeroes every wanted member of the reply struct.
+ *
+ * @input a PROGMEM array of JsonFields.
+ * @input the length of the above array.
+ * @input the struct the JsonFields describe.
+*/
+
+JsonExtractor::JsonExtractor(const JsonField *fields, unsigned char num_fields, void *dest) :
+  _fields(fields), _num_fields(num_fields), _dest((unsigned char *) dest) {
+  for (unsigned char i = 0; i < num_fields; i++) {
+    _curr_field = i;
+    memset(fieldDest(), 0, fieldSize());
+  }
+  _curr_field = JSON_NO_FIELD;
+}
+
+/*
+ * Feeds a chunk of the reply.
+ *
+ * @input a char buf, doesn't have to be null terminated.
+ * @input how many chars of the buf to feed.
+*/
+
+void JsonExtractor::Feed(const char *buf, int buf_len) {
+  for (int i = 0; i < buf_len; i++) Feed(buf[i]);
+}
+
+/*
+ * Feeds the next char of the reply. Anything after the end of the top level object is ignored.
+ *
+ * @input the next char.
+*/
+
+void JsonExtractor::Feed(char c) {
+  switch (_state) {
+    case EXPECT_OBJECT:
+      if (c == '{') _state = EXPECT_KEY;
+      else if (!isWhitespace(c)) _state = FAILED;
+      return;
+    case EXPECT_KEY:
+      if (c == '"') {
+        _state = IN_KEY;
+        _len = 0;
+        _is_escaped = false;
+      } else if (c == '}') {
+        _state = DONE;
+      } else if (!isWhitespace(c)) {
+        _state = FAILED;
+      }
+      return;
+    case IN_KEY:
+      if (!_is_escaped && c == '"') {
+        _key[_len] = '\0';
+        findField();
+        _state = EXPECT_COLON;
+        return;
+      }
+      _is_escaped = !_is_escaped && c == '\\';
+      // Keys that are too long keep _len past JSON_MAX_KEY_LEN so they never match.
+      if (!_is_escaped && _len <= JSON_MAX_KEY_LEN) _key[_len++] = c;
+      return;
+    case EXPECT_COLON:
+      if (c == ':') _state = EXPECT_VALUE;
+      else if (!isWhitespace(c)) _state = FAILED;
+      return;
+    case EXPECT_VALUE:
+      if (isWhitespace(c)) return;
+      if (c == '"') {
+        _state = IN_STRING;
+        _len = 0;
+        _is_escaped = false;
+      } else if (c == '{' || c == '[') {
+        _state = IN_NESTED;
+        _nested_depth = 1;
+        _is_in_nested_string = false;
+      } else {
+        _state = IN_PRIMITIVE;
+        _value = 0;
+        _is_negative = false;
+        _is_past_digits = false;
+        feedPrimitive(c);
+      }
+      return;
+    case IN_STRING:
+      feedString(c);
+      return;
+    case IN_PRIMITIVE:
+      if (c != ',' && c != '}' && !isWhitespace(c)) {
+        feedPrimitive(c);
+        return;
+      }
+      finishPrimitive();
+      _state = EXPECT_COMMA;
+      Feed(c);
+      return;
+    case IN_NESTED:
+      feedNested(c);
+      return;
+    case EXPECT_COMMA:
+      if (c == ',') _state = EXPECT_KEY;
+      else if (c == '}') _state = DONE;
+      else if (!isWhitespace(c)) _state = FAILED;
+      return;
+  }
+}
+
+/*
+ * @return true once the closing brace of the reply object has been fed.
+*/
+
+bool JsonExtractor::IsDone() {
+  return _state == DONE;
+}
+
+/*
+ * @return true if the reply isn't a JSON object.
+*/
+
+bool JsonExtractor::HasFailed() {
+  return _state == FAILED;
+}
+
+/*
+ * @input a char.
+ * @return true if the char is JSON whitespace.
+*/
+
+bool JsonExtractor::isWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/*
+ * Looks the key that was just read up in the list of wanted fields and sets _curr_field.
+*/
+
+void JsonExtractor::findField() {
+  _curr_field = JSON_NO_FIELD;
+  if (_len > JSON_MAX_KEY_LEN) return;
+  for (unsigned char i = 0; i < _num_fields; i++) {
+    if (strcmp_P(_key, _fields[i].key) == 0) {
+      _curr_field = i;
+      return;
+    }
+  }
+}
+
+/*
+ * @return where the member of the current field is in the reply struct.
+*/
+
+unsigned char *JsonExtractor::fieldDest() {
+  return _dest + pgm_read_byte(&_fields[_curr_field].offset);
+}
+
+/*
+ * @return the json_field_kinds value of the current field.
+*/
+
+unsigned char JsonExtractor::fieldKind() {
+  return pgm_read_byte(&_fields[_curr_field].kind);
+}
+
+/*
+ * @return the size in bytes of the member of the current field.
+*/
+
+unsigned char JsonExtractor::fieldSize() {
+  return pgm_read_byte(&_fields[_curr_field].size);
+}
+
+/*
+ * Handles a char of a string value. Wanted strings are copied as they come in. Escapes other than
+ * \" and \\ are copied as the escaped char, which is good enough for names.
+ *
+ * @input the next char.
+*/
+
+void JsonExtractor::feedString(char c) {
+  if (!_is_escaped && c == '"') {
+    _state = EXPECT_COMMA;
+    return;
+  }
+  _is_escaped = !_is_escaped && c == '\\';
+  if (_is_escaped || _curr_field == JSON_NO_FIELD || fieldKind() != JSON_STRING) return;
+  if (_len + 1 >= fieldSize()) return;
+  unsigned char *dest = fieldDest();
+  dest[_len++] = c;
+  dest[_len] = '\0';
+}
+
+/*
+ * Handles a char of a number, true, false or null. Fractions and exponents are dropped.
+ *
+ * @input the next char.
+*/
+
+void JsonExtractor::feedPrimitive(char c) {
+  if (_is_past_digits) return;
+  if (c == '-') {
+    _is_negative = true;
+  } else if (c >= '0' && c <= '9') {
+    _value = _value * 10 + (c - '0');
+  } else {
+    // '.', 'e', or the first letter of true/false/null.
+    if (c == 't') _value = 1;
+    _is_past_digits = true;
+  }
+}
+
+/*
+ * Stores the number that was just read if its key is wanted.
+*/
+
+void JsonExtractor::finishPrimitive() {
+  if (_curr_field == JSON_NO_FIELD) return;
+  if (_is_negative) _value = -_value;
+  unsigned char *dest = fieldDest();
+  if (fieldKind() == JSON_BOOL) *dest = _value != 0;
+  // AVR is little endian, so the low bytes of the long are the value of a shorter int.
+  else if (fieldKind() == JSON_INT) memcpy(dest, &_value, fieldSize());
+}
+
+/*
+ * Skips over a nested object or array, keeping track of strings so brackets inside them don't
+ * count.
+ *
+ * @input the next char.
+*/
+
+void JsonExtractor::feedNested(char c) {
+  if (_is_in_nested_string) {
+    if (!_is_escaped && c == '"') _is_in_nested_string = false;
+    _is_escaped = !_is_escaped && c == '\\';
+    return;
+  }
+  if (c == '"') {
+    _is_in_nested_string = true;
+    _is_escaped = false;
+  } else if (c == '{' || c == '[') {
+    _nested_depth++;
+  } else if ((c == '}' || c == ']') && --_nested_depth == 0) {
+    _state = EXPECT_COMMA;
+  }
+}
@@ -0,0 +1,91 @@
+/*
+  File:
+  JsonExtractor.h
+
+  Description:
+  Single pass JSON field extractor for API replies. Instead of building an object tree and then
+  looking keys up in it, the wanted keys are declared up front as a PROGMEM list of JsonFields and
+  their values are written straight into a plain struct as the reply streams in, one char at a
+  time. Nothing is allocated and the reply never has to be in a buffer, so it can be fed straight
+  from the cell radio's serial port.
+
+  Only the top level of the reply object is looked at. Unwanted values (including nested objects
+  and arrays) are skipped. Fields that aren't in the reply are left at 0/"".
+
+  Example:
+    struct Reply { bool error; int party_id; char party_name[21]; };
+    static const JsonField reply_fields[] PROGMEM = {
+      JSON_FIELD(Reply, error, "e", JSON_BOOL),
+      JSON_FIELD(Reply, party_id, "id", JSON_INT),
+      JSON_FIELD(Reply, party_name, "n", JSON_STRING)
+    };
+    Reply reply;
+    JsonExtractor extractor(reply_fields, JSON_NUM_FIELDS(reply_fields), &reply);
+    extractor.Feed(chunk, chunk_len); // as many times as needed
+    if (extractor.IsDone()) ...
+*/
+
+#ifndef JSONEXTRACTOR_H
+#define JSONEXTRACTOR_H
+
+#include <Arduino.h>
+#include <stddef.h>
+
+// Longest key that can be matched. All the API keys are shorter.
+#define JSON_MAX_KEY_LEN 5
+
+// What kind of struct member a field is written to.
+enum json_field_kinds {JSON_BOOL, JSON_INT, JSON_STRING};
+
+// One wanted key. Declared with JSON_FIELD in a PROGMEM array.
+struct JsonField {
+  char key[JSON_MAX_KEY_LEN+1];
+  unsigned char kind;
+  unsigned char offset;
+  unsigned char size;
+};
+
+// JSON_INT members can be any signed integer type, JSON_STRING members must be char arrays (long
+// strings are truncated) and JSON_BOOL members must be bools.
+#define JSON_FIELD(reply_type, member, key, kind) \
+  {key, kind, offsetof(reply_type, member), sizeof(((reply_type *) 0)->member)}
+#define JSON_NUM_FIELDS(fields) (sizeof(fields) / sizeof(fields[0]))
+
+// _curr_field when the value being read isn't wanted.
+#define JSON_NO_FIELD 0xFF
+
+class JsonExtractor {
+  private:
+    enum parse_states {EXPECT_OBJECT, EXPECT_KEY, IN_KEY, EXPECT_COLON, EXPECT_VALUE, IN_STRING,
+                       IN_PRIMITIVE, IN_NESTED, EXPECT_COMMA, DONE, FAILED};
+    const JsonField *_fields;
+    unsigned char _num_fields;
+    unsigned char *_dest;
+    unsigned char _state = EXPECT_OBJECT;
+    unsigned char _curr_field = JSON_NO_FIELD;
+    char _key[JSON_MAX_KEY_LEN+2];
+    unsigned char _len = 0;
+    unsigned char _nested_depth = 0;
+    bool _is_escaped = false;
+    bool _is_in_nested_string = false;
+    bool _is_negative = false;
+    bool _is_past_digits = false;
+    long _value = 0;
+    bool isWhitespace(char c);
+    void findField();
+    unsigned char *fieldDest();
+    unsigned char fieldKind();
+    unsigned char fieldSize();
+    void feedString(char c);
+    void feedPrimitive(char c);
+    void feedNested(char c);
+    void finishPrimitive();
+  public:
+    JsonExtractor(const JsonField *fields, unsigned char num_fields, void *dest);
+    void Feed(char c);
+    void Feed(const char *buf, int buf_len);
+    bool IsDone();
+    bool HasFailed();
+};
+
+#endif
@@ -3,7 +3,8 @@
   LPF.h
 
   Description:
-  Methods for implementing a low pass filter.
+  Fixed-point low pass filter. Each LPF object keeps its own state, so there can be as many
+  filters as needed, each with its own shift.
   Implementation from :  http://webcache.googleusercontent.com/search?q=cache:MoOD_M0gNtMJ:www.edn.com/design/systems-design/4320010/A-simple-software-lowpass-filter-suits-embedded-system-applications+&cd=8&hl=en&ct=clnk&gl=us
 */
 
@@ -14,18 +15,32 @@
 // shift here corresponds to lower weight.
 #define LPF_FILTER_SHIFT 7
 
-static signed long filter = 0;
-
-inline void seed_lpf(int seed_val) {
-  filter = seed_val << LPF_FILTER_SHIFT;
-}
-
-inline void add_val_to_lpf(int val_to_add) {
-  filter = filter - (filter >> LPF_FILTER_SHIFT) + val_to_add;
-}
-
-inline signed long get_curr_lpf_val() {
-  return filter >> LPF_FILTER_SHIFT;
-}
+// The filter state is the filtered value scaled up by 2^shift, so |values| have to stay below
+// 2^(31-shift) (16777216 for the default shift).
+template <unsigned char shift = LPF_FILTER_SHIFT>
+class LPF {
+  private:
+    signed long _filter = 0;
+    bool _is_seeded = false;
+  public:
+    void Seed(long seed_val) {
+      _filter = seed_val << shift;
+      _is_seeded = true;
+    }
+
+    // The first value added seeds the filter so the output doesn't have to climb up from 0.
+    void Add(long val_to_add) {
+      if (!_is_seeded) Seed(val_to_add);
+      _filter = _filter - (_filter >> shift) + val_to_add;
+    }
+
+    bool IsSeeded() {
+      return _is_seeded;
+    }
+
+    signed long Get() {
+      return _filter >> shift;
+    }
+};
 
 #endif
@@ -0,0 +1,160 @@
+/*
+  File:
+  LinkMonitor.cpp
+
+  Description:
+  Filtered cell link quality with hysteresis. See LinkMonitor.h.
+*/
+
+#include <Arduino.h>
+#include "Helpers.h"
+#include "FonaShield.h"
+#include "LinkMonitor.h"
+
+// What AT+CSQ reports when it doesn't know.
+#define CSQ_UNKNOWN 99
+
+/*
+ * Forgets everything, for a FONA that is being reset.
+*/
+
+void LinkMonitor::Reset() {
+  *this = LinkMonitor();
+}
+
+/*
+ * Adds a signal sample from AT+CSQ.
+ *
+ * @input the RSSI (0-31). 99 (not known) is left out: it is what a FONA that is still registering
+ * reports, and seeding the filter with it would make the link look low for several samples after
+ * every boot. Losing the network altogether shows up in the registration instead.
+ * @input the BER as RXQUAL (0-7). 99 (not known) is left out.
+*/
+
+void LinkMonitor::AddSignal(int rssi, int ber) {
+  if (rssi == CSQ_UNKNOWN) {
+    // Sampled again soon, so a real answer comes quickly.
+    _is_last_sample_bad = true;
+    return;
+  }
+  _rssi.Add(rssi);
+  if (ber != CSQ_UNKNOWN) _ber.Add(ber);
+  _is_last_sample_bad = rssi < LINK_LOW_ENTER_RSSI || (ber != CSQ_UNKNOWN && ber >= LINK_LOW_ENTER_BER);
+  update();
+}
+
+/*
+ * Sets the registration state from AT+CREG? and AT+CGREG?.
+ *
+ * @input true if the FONA is registered for calls and SMS (home network or roaming).
+ * @input true if it is registered for GPRS, which is what requests need.
+*/
+
+void LinkMonitor::SetRegistration(bool is_cs_registered, bool is_ps_registered) {
+  _is_cs_registered = is_cs_registered;
+  _is_ps_registered = is_ps_registered;
+  if (is_ps_registered) _num_unregistered = 0;
+  else if (_num_unregistered < LINK_UNREGISTERED_SAMPLES) _num_unregistered++;
+  update();
+}
+
+/*
+ * Adds the outcome of an HTTP request.
+ *
+ * @input true if a server answered (any HTTP status), false if the request never got there.
+ * @input how long (in ms) the request took from AT+HTTPACTION to the answer or the timeout.
+*/
+
+void LinkMonitor::AddRequest(bool is_answered, unsigned long latency) {
+  _request_ok.Add(is_answered ? 100 : 0);
+  if (is_answered) _latency.Add(latency);
+  update();
+}
+
+/*
+ * @return true if the link is bad enough for LOW_CELL_RECEPTION. Cached, doesn't talk to the FONA.
+*/
+
+bool LinkMonitor::IsLow() {
+  return _is_low;
+}
+
+/*
+ * @return a rough link quality from 0 (no link) to 100, cached: the RSSI scaled to 0-100, less 10
+ * for every RXQUAL step, times the share of requests that got an answer.
+*/
+
+unsigned char LinkMonitor::Quality() {
+  return _quality;
+}
+
+/*
+ * @input true if the FONA is asleep, so it has to be woken up for a sample.
+ * @return how old (in ms) the last signal sample can be before a new one is due.
+*/
+
+unsigned long LinkMonitor::SampleMaxAge(bool is_asleep) {
+  if (_is_low || _is_last_sample_bad) return LINK_SUSPECT_SAMPLE_MAX_AGE;
+  return is_asleep ? ASLEEP_STATUS_MAX_AGE : LINK_SAMPLE_MAX_AGE;
+}
+
+/*
+ * @return true if the FONA was registered for GPRS at the last sample.
+*/
+
+bool LinkMonitor::IsRegistered() {
+  return _is_ps_registered;
+}
+
+/*
+ * Prints the filtered link stats over USB serial.
+*/
+
+void LinkMonitor::Print() {
+  DEBUG_PRINT_FLASH("Link quality: ");
+  DEBUG_PRINTLN(_quality);
+  DEBUG_PRINT_FLASH("Low: ");
+  DEBUG_PRINTLN(_is_low ? 1 : 0);
+  DEBUG_PRINT_FLASH("RSSI: ");
+  DEBUG_PRINTLN(_rssi.Get());
+  DEBUG_PRINT_FLASH("BER: ");
+  DEBUG_PRINTLN(_ber.Get());
+  DEBUG_PRINT_FLASH("Registered (CS, GPRS): ");
+  DEBUG_PRINT(_is_cs_registered ? 1 : 0);
+  DEBUG_PRINT_FLASH(", ");
+  DEBUG_PRINTLN(_is_ps_registered ? 1 : 0);
+  DEBUG_PRINT_FLASH("Requests answered (%): ");
+  DEBUG_PRINTLN(_request_ok.Get());
+  DEBUG_PRINT_FLASH("Request latency (ms): ");
+  DEBUG_PRINTLN(_latency.Get());
+}
+
+/*
+ * Works out IsLow() and Quality() again after new input.
+*/
+
+void LinkMonitor::update() {
+  bool is_unregistered = _num_unregistered >= LINK_UNREGISTERED_SAMPLES;
+  // Only the registration to go by until the first signal sample. A FONA with no signal at all
+  // (CSQ 99) never gives one.
+  if (!_rssi.IsSeeded()) {
+    _is_low = is_unregistered;
+    _quality = 0;
+    return;
+  }
+  long rssi = _rssi.Get();
+  long ber = _ber.Get();
+  if (_is_low) {
+    _is_low = is_unregistered || rssi < LINK_LOW_EXIT_RSSI || ber > LINK_LOW_EXIT_BER;
+  } else {
+    _is_low = is_unregistered || rssi < LINK_LOW_ENTER_RSSI || ber >= LINK_LOW_ENTER_BER;
+  }
+  if (!_is_ps_registered) {
+    _quality = 0;
+    return;
+  }
+  long quality = (rssi >= 31) ? 100 : rssi * 100 / 31;
+  quality -= ber * 10;
+  if (_request_ok.IsSeeded()) quality = quality * _request_ok.Get() / 100;
+  _quality = (quality < 0) ? 0 : quality;
+}
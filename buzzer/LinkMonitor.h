@@ -0,0 +1,75 @@
+/*
+  File:
+  LinkMonitor.h
+
+  Description:
+  Keeps track of how good the cell link is, so nothing has to ask the FONA to find out. FonaShield
+  feeds it: signal samples (RSSI and BER from AT+CSQ), registration (AT+CREG? and AT+CGREG?) and
+  the outcome and latency of every HTTP request. RSSI, BER and the request stats go through low pass
+  filters, so one noisy sample doesn't move much.
+
+  IsLow() is what LOW_CELL_RECEPTION goes by. It has separate thresholds for becoming low and for
+  getting out of it, so a link that hovers around one threshold doesn't flap in and out of the
+  state. Only the signal and registration count towards it: a backend that is down fails requests
+  just like a bad link does, and LOW_CELL_RECEPTION can't do anything about that. Quality() rolls
+  everything up into a single number for logging and display.
+
+  Send "link" over USB serial to print it all.
+*/
+
+#ifndef LINKMONITOR_H
+#define LINKMONITOR_H
+
+#include "LPF.h"
+
+// Oldest signal sample (in ms) loop() goes by. While the FONA is asleep ASLEEP_STATUS_MAX_AGE
+// (FonaShield.h) is used instead.
+#define LINK_SAMPLE_MAX_AGE 30000
+
+// Same, asleep or not, while the link is low or the last sample looked bad, so a real change shows
+// up quickly.
+#define LINK_SUSPECT_SAMPLE_MAX_AGE 5000
+
+// Filtered RSSI (AT+CSQ, 0-31) below which the link becomes low, and at or above which it stops
+// being low.
+#define LINK_LOW_ENTER_RSSI 5
+#define LINK_LOW_EXIT_RSSI 8
+
+// Same for the filtered BER (AT+CSQ RXQUAL, 0-7, lower is better).
+#define LINK_LOW_ENTER_BER 6
+#define LINK_LOW_EXIT_BER 4
+
+// Samples in a row without GPRS registration before the link is low.
+#define LINK_UNREGISTERED_SAMPLES 2
+
+// Filter shifts. A signal sample has 1/4 of the weight, a request 1/8.
+#define LINK_SIGNAL_SHIFT 2
+#define LINK_REQUEST_SHIFT 3
+
+class LinkMonitor {
+  private:
+    LPF<LINK_SIGNAL_SHIFT> _rssi;
+    LPF<LINK_SIGNAL_SHIFT> _ber;
+    // Percentage of requests that got an answer from a server, and how long (in ms) that took.
+    LPF<LINK_REQUEST_SHIFT> _request_ok;
+    LPF<LINK_REQUEST_SHIFT> _latency;
+    bool _is_cs_registered = false;
+    bool _is_ps_registered = false;
+    unsigned char _num_unregistered = 0;
+    bool _is_last_sample_bad = false;
+    bool _is_low = false;
+    unsigned char _quality = 0;
+    void update();
+  public:
+    void Reset();
+    void AddSignal(int rssi, int ber);
+    void SetRegistration(bool is_cs_registered, bool is_ps_registered);
+    void AddRequest(bool is_answered, unsigned long latency);
+    bool IsLow();
+    unsigned char Quality();
+    unsigned long SampleMaxAge(bool is_asleep);
+    bool IsRegistered();
+    void Print();
+};
+
+#endif
@@ -0,0 +1,119 @@
+/*
+  File:
+  Outbox.cpp
+
+  Description:
+  Persistent queue of API operations that haven't reached the backend yet. See Outbox.h.
+*/
+
+#include <Arduino.h>
+#include "Outbox.h"
+
+/*
+ * @input the record store the outbox is kept in.
+*/
+
+Outbox::Outbox(EEPROMRecordStore *store) : _store(store) {
+  memset(&_record, 0, sizeof(_record));
+}
+
+/*
+ * Loads the outbox from the EEPROM. An empty store gives an empty outbox.
+*/
+
+void Outbox::Begin() {
+  if (!_store->Begin() || !_store->Read(&_record)) memset(&_record, 0, sizeof(_record));
+  if (_record.num_entries > OUTBOX_LEN) _record.num_entries = 0;
+}
+
+/*
+ * Queues an operation with a new idempotency key. A queued operation of the same kind is replaced
+ * and keeps its place in the queue.
+ *
+ * @input an op from the outbox_ops enum.
+ * @input the party the operation is about.
+*/
+
+void Outbox::Add(unsigned char op, int party_id) {
+  unsigned char i = 0;
+  while (i < _record.num_entries && _record.entries[i].op != op) i++;
+  if (i == OUTBOX_LEN) {
+    removeEntry(0);
+    i = OUTBOX_LEN - 1;
+  }
+  if (i == _record.num_entries) _record.num_entries++;
+  _record.entries[i].op = op;
+  _record.entries[i].key = _record.next_key++;
+  _record.entries[i].party_id = party_id;
+  save();
+}
+
+/*
+ * Drops every queued operation about the given party. Used when the party goes away locally so
+ * nothing is sent for it later.
+ *
+ * @input a party ID.
+*/
+
+void Outbox::RemoveParty(int party_id) {
+  bool is_changed = false;
+  unsigned char i = 0;
+  while (i < _record.num_entries) {
+    if (_record.entries[i].party_id == party_id) {
+      removeEntry(i);
+      is_changed = true;
+    } else {
+      i++;
+    }
+  }
+  if (is_changed) save();
+}
+
+/*
+ * @return true if nothing is waiting to be sent.
+*/
+
+bool Outbox::IsEmpty() {
+  return _record.num_entries == 0;
+}
+
+/*
+ * @return the oldest queued operation, or NULL if the outbox is empty.
+*/
+
+OutboxEntry *Outbox::Peek() {
+  if (IsEmpty()) return NULL;
+  return &_record.entries[0];
+}
+
+/*
+ * Removes the oldest queued operation. Call once the API has answered it.
+*/
+
+void Outbox::Pop() {
+  if (IsEmpty()) return;
+  removeEntry(0);
+  save();
+}
+
+/*
+ * Removes an entry from the in memory queue, keeping the rest in order.
+ *
+ * @input the index of the entry.
+*/
+
+void Outbox::removeEntry(unsigned char i) {
+  memmove(&_record.entries[i], &_record.entries[i + 1],
+          (_record.num_entries - i - 1) * sizeof(OutboxEntry));
+  _record.num_entries--;
+  // Keeps unused entries zeroed so they don't make otherwise equal records differ.
+  memset(&_record.entries[_record.num_entries], 0, sizeof(OutboxEntry));
+}
+
+/*
+ * Writes the outbox to the EEPROM.
+*/
+
+void Outbox::save() {
+  _store->Write(&_record);
+}
@@ -0,0 +1,59 @@
+/*
+  File:
+  Outbox.h
+
+  Description:
+  Persistent queue of API operations that haven't reached the backend yet. An operation is added
+  to the outbox before it is sent and only removed once the API has answered it, so a failed
+  request (low reception, FONA hiccup, reset) just leaves it queued. The queue is drained in order
+  the next time the Buzzer talks to the API.
+
+  Every operation gets an idempotency key that is sent along with it, so the backend can tell a
+  resend apart from a new request. Adding an operation of a kind that is already queued replaces
+  the queued one (there is only ever one party to accept, for example).
+
+  The whole outbox is one record in an EEPROMRecordStore, so it survives resets and its writes are
+  spread over the store's slots.
+*/
+
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include "EEPROMRecordStore.h"
+
+// Kinds of operation the outbox can hold.
+enum outbox_ops {OUTBOX_ACCEPT_PARTY};
+
+// Most operations that can be queued at once. Adding to a full outbox drops the oldest operation.
+#define OUTBOX_LEN 4
+
+struct OutboxEntry {
+  unsigned char op;
+  unsigned int key;
+  int party_id;
+};
+
+struct OutboxRecord {
+  // Idempotency key the next operation gets.
+  unsigned int next_key;
+  unsigned char num_entries;
+  OutboxEntry entries[OUTBOX_LEN];
+};
+
+class Outbox {
+  private:
+    EEPROMRecordStore *_store;
+    OutboxRecord _record;
+    void removeEntry(unsigned char i);
+    void save();
+  public:
+    Outbox(EEPROMRecordStore *store);
+    void Begin();
+    void Add(unsigned char op, int party_id);
+    void RemoveParty(int party_id);
+    bool IsEmpty();
+    OutboxEntry *Peek();
+    void Pop();
+};
+
+#endif
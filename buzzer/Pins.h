@@ -11,14 +11,8 @@
 
 #include "Version.h"
 
-
-#if BOARD_TYPE == V2 || BOARD_TYPE == V1
-  #define BUTTON_LOGIC_HIGH LOW
-  #define BUTTON_LOGIC_LOW HIGH
-#elif BOARD_TYPE == JANKBOARD
-  #define BUTTON_LOGIC_HIGH HIGH
-  #define BUTTON_LOGIC_LOW LOW
-#endif
+// The button and the reset lines are also described in Board.h (with the button's polarity), which
+// is how the firmware reads and drives them. Keep the two in sync.
 
 #define BUZZER_PIN 6
 #define FONA_RX_PIN 12
@@ -0,0 +1,102 @@
+/*
+  File:
+  PowerManager.cpp
+
+  Description:
+  Puts the Arduino into AVR power-down sleep between FSM iterations. The MCU is woken up again by
+  the watchdog timer or by a pin change on the button pin. Timer0 is stopped while powered down so
+  millis() is advanced by the time spent asleep after every wakeup.
+*/
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "PowerManager.h"
+#include "Globals.h"
+
+// Defined in the Arduino core (wiring.c). This is what millis() returns.
+extern volatile unsigned long timer0_millis;
+
+PowerManager::PowerManager(int wake_pin) : _wake_pin(wake_pin) {}
+
+/*
+ * Powers down the Arduino for the given duration or until the button pin changes, whichever comes
+ * first. The motor, ADC, TWI and the timers all stop while powered down, so the caller should have
+ * turned the motor off first. Waits for queued OLED writes to go out and for a vibration pattern
+ * to finish before powering down.
+ *
+ * The watchdog oscillator is only accurate to ~10%, so millis() will drift by about that much for
+ * the time spent asleep. If the button wakes us up in the middle of a chunk, half a chunk is
+ * credited to millis().
+ *
+ * @input how long (in ms) to power down for. Rounded up to a multiple of SLEEP_CHUNK_MS.
+ * @return how long (in ms) millis() was advanced by.
+*/
+
+unsigned long PowerManager::PowerDown(unsigned long duration) {
+  unsigned long time_asleep = 0;
+  // The TWI clock stops in power-down, so let the OLED queue go out first (or drop it if the OLED
+  // is stuck, see SSD1306AsciiAsyncI2c::flush()).
+  oled.flush();
+  // Same for a vibration pattern (see Haptics.h). Its tick interrupt is only on while one plays. A
+  // looping one never ends and the motor has to be off anyway, so it is stopped.
+  if (haptics.IsLooping()) haptics.Stop();
+  while (TIMSK3 & _BV(OCIE3A));
+  // The ADC keeps drawing current in power-down unless it is disabled.
+  uint8_t old_adcsra = ADCSRA;
+  ADCSRA &= ~_BV(ADEN);
+  enableWakePin();
+  bool woken_by_watchdog = true;
+  while (time_asleep < duration && woken_by_watchdog) {
+    woken_by_watchdog = powerDownOneChunk();
+    time_asleep += (woken_by_watchdog) ? SLEEP_CHUNK_MS : SLEEP_CHUNK_MS / 2;
+  }
+  disableWakePin();
+  // Hands the watchdog back to the supervisor. The nap doesn't count against its budget.
+  watchdog.Resume();
+  ADCSRA = old_adcsra;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    timer0_millis += time_asleep;
+  }
+  return time_asleep;
+}
+
+/*
+ * Borrows the watchdog (interrupt mode only, see Watchdog.h) for one SLEEP_CHUNK_MS period and
+ * powers down until something wakes us up.
+ *
+ * @return true if the watchdog woke us up, false if it was something else (the button).
+*/
+
+bool PowerManager::powerDownOneChunk() {
+  cli();
+  watchdog.WakeAfter(WDTO_250MS);
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  // sei() always executes the next instruction before servicing interrupts, so no wakeup can be
+  // missed between here and sleep_cpu().
+  sei();
+  sleep_cpu();
+  sleep_disable();
+  return watchdog.HasWoken();
+}
+
+/*
+ * Enables the pin change interrupt for the wake pin. SoftwareSerial already owns the PCINT ISRs,
+ * so there is no ISR of our own; the interrupt firing is enough to wake the MCU.
+*/
+
+void PowerManager::enableWakePin() {
+  *digitalPinToPCMSK(_wake_pin) |= _BV(digitalPinToPCMSKbit(_wake_pin));
+  *digitalPinToPCICR(_wake_pin) |= _BV(digitalPinToPCICRbit(_wake_pin));
+}
+
+/*
+ * Disables the pin change interrupt for the wake pin again.
+*/
+
+void PowerManager::disableWakePin() {
+  *digitalPinToPCMSK(_wake_pin) &= ~_BV(digitalPinToPCMSKbit(_wake_pin));
+}
@@ -0,0 +1,43 @@
+/*
+  File:
+  PowerManager.h
+
+  Description:
+  Puts the Arduino into AVR power-down sleep between FSM iterations. The MCU is woken up again by
+  the watchdog timer or by a pin change on the button pin. Timer0 is stopped while powered down so
+  millis() is advanced by the time spent asleep after every wakeup.
+*/
+
+#ifndef POWERMANAGER_H
+#define POWERMANAGER_H
+
+#include <Arduino.h>
+
+// How long one watchdog sleep chunk lasts (WDTO_250MS). Longer naps are made out of several of
+// these so that a button wakeup loses at most half a chunk of millis() accuracy.
+#define SLEEP_CHUNK_MS 250
+
+// How long SLEEP powers down the Arduino between FSM iterations.
+#define SLEEP_NAP_MS 1000
+
+// How long IDLE powers down the Arduino between FSM iterations once the screen has been dimmed.
+#define IDLE_NAP_MS 500
+
+// How long LOW_CELL_RECEPTION powers down the Arduino between looks at the link.
+#define LOW_CELL_NAP_MS 1000
+
+// Longest HEARTBEAT powers down the Arduino for while waiting for the next heartbeat to be due.
+#define HEARTBEAT_NAP_MS 1000UL
+
+class PowerManager {
+  private:
+    int _wake_pin;
+    bool powerDownOneChunk();
+    void enableWakePin();
+    void disableWakePin();
+  public:
+    PowerManager(int wake_pin);
+    unsigned long PowerDown(unsigned long duration);
+};
+
+#endif
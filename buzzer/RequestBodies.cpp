@@ -0,0 +1,145 @@
+/*
+  File:
+  RequestBodies.cpp
+
+  Description:
+  POST bodies for the API calls, built once when the buzzer name, the party ID or the party state
+  version changes. See RequestBodies.h.
+*/
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include "RequestBodies.h"
+
+/*
+ * Rebuilds every body that contains the buzzer name.
+ *
+ * @input the null terminated buzzer name.
+*/
+
+void RequestBodies::SetBuzzerName(const char *buzzer_name) {
+  strcpy_P(_buzzer_name_body, PSTR(BUZZER_NAME_BODY_PREFIX));
+  strncat(_buzzer_name_body, buzzer_name, LONGEST_BUZZER_NAME);
+  strcat_P(_buzzer_name_body, PSTR("\"}"));
+  _buzzer_name_body_size = strlen(_buzzer_name_body) + 1;
+  buildAcceptPartyBody();
+  buildHeartbeatBody();
+}
+
+/*
+ * Rebuilds the accept party body if the party or the idempotency key changed.
+ *
+ * @input the ID of the party the Buzzer is accepting.
+ * @input the idempotency key of the accept operation (see Outbox.h).
+*/
+
+void RequestBodies::SetAcceptParty(int party_id, unsigned int key) {
+  if (party_id == _party_id && key == _key && _accept_party_body_size != 0) return;
+  _party_id = party_id;
+  _key = key;
+  buildAcceptPartyBody();
+}
+
+/*
+ * Rebuilds the heartbeat body if the version changed.
+ *
+ * @input the version of the party state the API last sent, or 0 if the Buzzer doesn't know it
+ * (the API always answers 0 with the full state).
+*/
+
+void RequestBodies::SetStateVersion(unsigned int state_version) {
+  if (state_version == _state_version && _heartbeat_body_size != 0) return;
+  _state_version = state_version;
+  buildHeartbeatBody();
+}
+
+/*
+ * @return the version in the heartbeat body.
+*/
+
+unsigned int RequestBodies::StateVersion() {
+  return _state_version;
+}
+
+/*
+ * @return the {"bn":"<name>"} body.
+*/
+
+char *RequestBodies::BuzzerNameBody() {
+  return _buzzer_name_body;
+}
+
+/*
+ * @return the size of the above body, null terminator included (what HTTPPOSTJSON expects).
+*/
+
+unsigned char RequestBodies::BuzzerNameBodySize() {
+  return _buzzer_name_body_size;
+}
+
+/*
+ * @return the {"bn":"<name>","id":<party id>,"k":<idempotency key>} body.
+*/
+
+char *RequestBodies::AcceptPartyBody() {
+  return _accept_party_body;
+}
+
+/*
+ * @return the size of the above body, null terminator included.
+*/
+
+unsigned char RequestBodies::AcceptPartyBodySize() {
+  return _accept_party_body_size;
+}
+
+/*
+ * @return the {"bn":"<name>","v":<party state version>} body.
+*/
+
+char *RequestBodies::HeartbeatBody() {
+  return _heartbeat_body;
+}
+
+/*
+ * @return the size of the above body, null terminator included.
+*/
+
+unsigned char RequestBodies::HeartbeatBodySize() {
+  return _heartbeat_body_size;
+}
+
+/*
+ * Builds the accept party body from the buzzer name body (minus its closing brace), the party ID
+ * and the idempotency key.
+*/
+
+void RequestBodies::buildAcceptPartyBody() {
+  if (_buzzer_name_body_size == 0) return;
+  unsigned char len = _buzzer_name_body_size - 2;
+  memcpy(_accept_party_body, _buzzer_name_body, len);
+  strcpy_P(_accept_party_body + len, PSTR(PARTY_ID_BODY_INFIX));
+  len += sizeof(PARTY_ID_BODY_INFIX) - 1;
+  itoa(_party_id, _accept_party_body + len, 10);
+  strcat_P(_accept_party_body, PSTR(IDEMPOTENCY_KEY_BODY_INFIX));
+  len = strlen(_accept_party_body);
+  utoa(_key, _accept_party_body + len, 10);
+  strcat_P(_accept_party_body, PSTR("}"));
+  _accept_party_body_size = strlen(_accept_party_body) + 1;
+}
+
+/*
+ * Builds the heartbeat body from the buzzer name body (minus its closing brace) and the party state
+ * version.
+*/
+
+void RequestBodies::buildHeartbeatBody() {
+  if (_buzzer_name_body_size == 0) return;
+  unsigned char len = _buzzer_name_body_size - 2;
+  memcpy(_heartbeat_body, _buzzer_name_body, len);
+  strcpy_P(_heartbeat_body + len, PSTR(STATE_VERSION_BODY_INFIX));
+  len += sizeof(STATE_VERSION_BODY_INFIX) - 1;
+  utoa(_state_version, _heartbeat_body + len, 10);
+  strcat_P(_heartbeat_body, PSTR("}"));
+  _heartbeat_body_size = strlen(_heartbeat_body) + 1;
+}
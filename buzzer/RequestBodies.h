@@ -0,0 +1,59 @@
+/*
+  File:
+  RequestBodies.h
+
+  Description:
+  POST bodies for the API calls, built once when the buzzer name, the party ID or the party state
+  version changes instead of being formatted on every request. Each body is kept together with its
+  size so it can be handed straight to FonaShield::HTTPPOSTJSON.
+*/
+
+#ifndef REQUESTBODIES_H
+#define REQUESTBODIES_H
+
+#include "EEPROMReadWrite.h"
+#include "BuzzerFSMCallbacks.h"
+
+// {"bn":"<name>"}
+#define BUZZER_NAME_BODY_PREFIX "{\"" BUZZER_NAME_FIELD "\":\""
+#define BUZZER_NAME_BODY_MAX_LEN (sizeof(BUZZER_NAME_BODY_PREFIX "\"}") - 1 + LONGEST_BUZZER_NAME)
+
+// {"bn":"<name>","id":<party id>,"k":<idempotency key>}
+#define PARTY_ID_BODY_INFIX ",\"" PARTY_ID_FIELD "\":"
+#define IDEMPOTENCY_KEY_BODY_INFIX ",\"" IDEMPOTENCY_KEY_FIELD "\":"
+// A party ID is an int, so at most 6 chars ("-32768"). A key is an unsigned int, so at most 5.
+#define ACCEPT_PARTY_BODY_MAX_LEN (BUZZER_NAME_BODY_MAX_LEN + sizeof(PARTY_ID_BODY_INFIX) - 1 + 6 + \
+                                   sizeof(IDEMPOTENCY_KEY_BODY_INFIX) - 1 + 5)
+
+// {"bn":"<name>","v":<party state version>}
+#define STATE_VERSION_BODY_INFIX ",\"" STATE_VERSION_FIELD "\":"
+// A version is an unsigned int, so at most 5 chars.
+#define HEARTBEAT_BODY_MAX_LEN (BUZZER_NAME_BODY_MAX_LEN + sizeof(STATE_VERSION_BODY_INFIX) - 1 + 5)
+
+class RequestBodies {
+  private:
+    char _buzzer_name_body[BUZZER_NAME_BODY_MAX_LEN+1];
+    unsigned char _buzzer_name_body_size = 0;
+    char _accept_party_body[ACCEPT_PARTY_BODY_MAX_LEN+1];
+    unsigned char _accept_party_body_size = 0;
+    int _party_id = 0;
+    unsigned int _key = 0;
+    char _heartbeat_body[HEARTBEAT_BODY_MAX_LEN+1];
+    unsigned char _heartbeat_body_size = 0;
+    unsigned int _state_version = 0;
+    void buildAcceptPartyBody();
+    void buildHeartbeatBody();
+  public:
+    void SetBuzzerName(const char *buzzer_name);
+    void SetAcceptParty(int party_id, unsigned int key);
+    void SetStateVersion(unsigned int state_version);
+    unsigned int StateVersion();
+    char *BuzzerNameBody();
+    unsigned char BuzzerNameBodySize();
+    char *AcceptPartyBody();
+    unsigned char AcceptPartyBodySize();
+    char *HeartbeatBody();
+    unsigned char HeartbeatBodySize();
+};
+
+#endif
@@ -0,0 +1,198 @@
+/*
+  File:
+  SSD1306AsciiAsyncI2c.cpp
+
+  Description:
+  Interrupt driven I2C back end for SSD1306Ascii. See SSD1306AsciiAsyncI2c.h.
+*/
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "SSD1306AsciiAsyncI2c.h"
+
+// TWI status codes for a master transmitter (TWSR with the prescaler bits masked off).
+#define TWI_START 0x08
+#define TWI_REP_START 0x10
+#define TWI_SLA_ACK 0x18
+#define TWI_DATA_ACK 0x28
+
+// First byte of every SSD1306 transaction: says whether the rest are commands or display RAM.
+#define SSD1306_CONTROL_CMD 0x00
+#define SSD1306_CONTROL_RAM 0x40
+
+// TWCR values. TWIE stays set for as long as a transfer is in progress.
+#define TWCR_NEXT (_BV(TWINT) | _BV(TWEN) | _BV(TWIE))
+#define TWCR_START (_BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE))
+#define TWCR_STOP (_BV(TWINT) | _BV(TWSTO) | _BV(TWEN))
+
+// The ISR needs to know which display to hand TWI events to.
+static SSD1306AsciiAsyncI2c *active_display = NULL;
+
+ISR(TWI_vect) {
+  if (active_display != NULL) active_display->handleTWI();
+}
+
+/*
+ * Sets up the TWI hardware and sends the SSD1306 init sequence for the given device type.
+ *
+ * @input the SSD1306Ascii device type, e.g. &Adafruit128x64.
+ * @input the 7 bit I2C address of the OLED.
+*/
+
+void SSD1306AsciiAsyncI2c::begin(const DevType *dev, uint8_t i2c_addr) {
+  _i2c_addr = i2c_addr;
+  active_display = this;
+  TWSR = 0;
+  TWBR = ((F_CPU / OLED_I2C_CLOCK) - 16) / 2;
+  TWCR = _BV(TWEN);
+  init(dev);
+}
+
+/*
+ * Pulses the OLED reset pin.
+ *
+ * @input the pin connected to the OLED reset line.
+*/
+
+void SSD1306AsciiAsyncI2c::reset(uint8_t rst) {
+  pinMode(rst, OUTPUT);
+  digitalWrite(rst, LOW);
+  delay(10);
+  digitalWrite(rst, HIGH);
+  delay(10);
+}
+
+/*
+ * Waits until every queued byte has gone out over I2C, or drops them if that takes longer than
+ * OLED_WAIT_TIMEOUT_MS.
+*/
+
+void SSD1306AsciiAsyncI2c::flush() {
+  unsigned long start_time = millis();
+  while (isBusy()) {
+    if (millis() - start_time >= OLED_WAIT_TIMEOUT_MS) {
+      dropQueue();
+      return;
+    }
+  }
+}
+
+/*
+ * @return true if there are bytes waiting to go out or a transaction is still in progress.
+*/
+
+bool SSD1306AsciiAsyncI2c::isBusy() {
+  return _is_busy || _head != _tail;
+}
+
+/*
+ * Called by SSD1306Ascii for every command and display RAM byte. Queues the byte and starts a
+ * transfer if the bus is idle. Waits for the ISR to make room if the queue is full, and drops
+ * the queue if no room is made within OLED_WAIT_TIMEOUT_MS.
+ *
+ * @input the byte.
+ * @input SSD1306_MODE_CMD for a command, SSD1306_MODE_RAM or SSD1306_MODE_RAM_BUF for display RAM.
+*/
+
+void SSD1306AsciiAsyncI2c::writeDisplay(uint8_t b, uint8_t mode) {
+  uint8_t next_head = (_head + 1) & (OLED_QUEUE_LEN - 1);
+  unsigned long start_time = millis();
+  while (next_head == _tail) {
+    if (millis() - start_time >= OLED_WAIT_TIMEOUT_MS) dropQueue();
+  }
+  _data[_head] = b;
+  if (mode == SSD1306_MODE_CMD) _is_cmd[_head >> 3] |= _BV(_head & 7);
+  else _is_cmd[_head >> 3] &= ~_BV(_head & 7);
+  _head = next_head;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (!_is_busy) startTransfer();
+  }
+}
+
+/*
+ * @input a queue slot.
+ * @return true if the byte in that slot is a command.
+*/
+
+bool SSD1306AsciiAsyncI2c::isSlotCmd(uint8_t slot) {
+  return _is_cmd[slot >> 3] & _BV(slot & 7);
+}
+
+/*
+ * Sends a (repeated) start for a new transaction carrying the kind of byte at the tail of the
+ * queue. A start written while a stop (from the ISR or dropQueue()) is still on the bus would be
+ * lost, so this waits for the stop to finish first. Must be called with interrupts off or from the
+ * ISR.
+*/
+
+void SSD1306AsciiAsyncI2c::startTransfer() {
+  while (TWCR & _BV(TWSTO));
+  _is_busy = true;
+  _is_run_cmd = isSlotCmd(_tail);
+  _run_len = 0;
+  _needs_control_byte = true;
+  TWCR = TWCR_START;
+}
+
+/*
+ * Abandons the transaction in progress and everything queued. What the OLED shows is out of date
+ * until the screen is next redrawn.
+*/
+
+void SSD1306AsciiAsyncI2c::dropQueue() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    TWCR = TWCR_STOP;
+    _tail = _head;
+    _is_busy = false;
+  }
+}
+
+/*
+ * Called from the TWI ISR every time the hardware finishes a step of the transaction. Sends the
+ * address, then the control byte, then bytes from the queue for as long as they're the same kind
+ * and the run is shorter than OLED_MAX_RUN_LEN. After that it either sends a repeated start for
+ * the next run or a stop if the queue is empty.
+ *
+ * If the OLED doesn't ACK (or the bus is lost), the transaction is stopped and the queue is
+ * dropped rather than retried: an OLED that doesn't answer would otherwise keep the bus busy and
+ * the queue full for good. The next byte queued starts a new transaction.
+*/
+
+void SSD1306AsciiAsyncI2c::handleTWI() {
+  switch (TWSR & 0xF8) {
+    case TWI_START:
+    case TWI_REP_START:
+      TWDR = _i2c_addr << 1;
+      TWCR = TWCR_NEXT;
+      return;
+    case TWI_SLA_ACK:
+    case TWI_DATA_ACK:
+      if (_needs_control_byte) {
+        _needs_control_byte = false;
+        TWDR = (_is_run_cmd) ? SSD1306_CONTROL_CMD : SSD1306_CONTROL_RAM;
+        TWCR = TWCR_NEXT;
+        return;
+      }
+      if (_head != _tail && isSlotCmd(_tail) == _is_run_cmd && _run_len < OLED_MAX_RUN_LEN) {
+        TWDR = _data[_tail];
+        _tail = (_tail + 1) & (OLED_QUEUE_LEN - 1);
+        _run_len++;
+        TWCR = TWCR_NEXT;
+        return;
+      }
+      if (_head != _tail) {
+        startTransfer();
+        return;
+      }
+      break;
+    default:
+      // NACK or lost arbitration.
+      _tail = _head;
+      break;
+  }
+  TWCR = TWCR_STOP;
+  _is_busy = false;
+  // A byte may have been queued while the bus was busy and this was the last step.
+  if (_head != _tail) startTransfer();
+}
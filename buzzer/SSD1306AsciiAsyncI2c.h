@@ -0,0 +1,62 @@
+/*
+  File:
+  SSD1306AsciiAsyncI2c.h
+
+  Description:
+  Interrupt driven I2C back end for SSD1306Ascii. SSD1306AsciiAvrI2c waits for every byte to go
+  out over TWI. This back end puts each command/data byte in a ring buffer and returns straight
+  away; the TWI interrupt sends the bytes in the background, grouping consecutive bytes of the same
+  kind (command or display RAM) into one I2C transaction. Drawing to the OLED then overlaps with
+  whatever the state callbacks do next (mostly talking to the cell radio).
+
+  It has the same begin()/reset() interface as SSD1306AsciiAvrI2c so the rest of SSD1306Ascii
+  (clear, print, setCursor, setContrast, ...) is used exactly like before.
+*/
+
+#ifndef SSD1306ASCIIASYNCI2C_H
+#define SSD1306ASCIIASYNCI2C_H
+
+#include "SSD1306Ascii.h"
+
+// Number of bytes that can be waiting to go out. Must be a power of 2. If the queue is full the
+// caller waits for the ISR to make room, so this only bounds how much of a redraw can overlap.
+#define OLED_QUEUE_LEN 64
+
+// Longest (in ms) anything waits for the queue to move. A full queue goes out in about 2ms, so
+// after this the OLED (or the bus) is taken to be stuck and the queue is dropped.
+#define OLED_WAIT_TIMEOUT_MS 20
+
+// Most bytes sent in a single I2C transaction before a repeated start.
+#define OLED_MAX_RUN_LEN 32
+
+// I2C clock the SSD1306 is driven at.
+#define OLED_I2C_CLOCK 400000L
+
+class SSD1306AsciiAsyncI2c : public SSD1306Ascii {
+  public:
+    void begin(const DevType *dev, uint8_t i2c_addr);
+    void reset(uint8_t rst);
+    void flush();
+    bool isBusy();
+    void handleTWI();
+  protected:
+    void writeDisplay(uint8_t b, uint8_t mode);
+  private:
+    uint8_t _i2c_addr;
+    volatile uint8_t _data[OLED_QUEUE_LEN];
+    // 1 bit per queue slot, set if the byte is a command.
+    volatile uint8_t _is_cmd[OLED_QUEUE_LEN / 8];
+    volatile uint8_t _head = 0;
+    volatile uint8_t _tail = 0;
+    volatile bool _is_busy = false;
+    // Whether the transaction in progress carries commands, and how many bytes it has carried.
+    volatile bool _is_run_cmd = false;
+    volatile uint8_t _run_len = 0;
+    // Whether the control byte of the current transaction still has to be sent.
+    volatile bool _needs_control_byte = false;
+    bool isSlotCmd(uint8_t slot);
+    void startTransfer();
+    void dropQueue();
+};
+
+#endif
@@ -0,0 +1,266 @@
+/*
+  File:
+  SerialLog.cpp
+
+  Description:
+  Ring log of the FONA serial traffic. See SerialLog.h.
+*/
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "Helpers.h"
+#include "SerialLog.h"
+#include "Globals.h"
+
+#if SERIAL_LOG
+
+#define SERIAL_LOG_MAGIC 0x5E71
+
+// No entry is being added to.
+#define NO_RUN SERIAL_LOG_SIZE
+
+// Not cleared by the startup code, so the log survives the reset.
+static SerialLogRing ring __attribute__((section(".noinit")));
+
+/*
+ * Prints a byte as two hex digits over USB serial.
+*/
+
+static void printHexByte(unsigned char b) {
+  static const char digits[] = "0123456789ABCDEF";
+  DEBUG_PRINT(digits[b >> 4]);
+  DEBUG_PRINT(digits[b & 0x0F]);
+}
+
+/*
+ * @input an age in ms, or FONA_STATE_NEVER.
+ * @return it in SERIAL_LOG_AGE_UNIT_MS, SERIAL_LOG_AGE_NEVER for FONA_STATE_NEVER. Longer ages are
+ * cut down to the longest one that fits.
+*/
+
+static unsigned int ageToLog(unsigned long age) {
+  if (age == FONA_STATE_NEVER) return SERIAL_LOG_AGE_NEVER;
+  age /= SERIAL_LOG_AGE_UNIT_MS;
+  return (age < SERIAL_LOG_AGE_NEVER) ? age : SERIAL_LOG_AGE_NEVER - 1;
+}
+
+/*
+ * Prints an age from a SerialLogState in ms over USB serial, -1 for SERIAL_LOG_AGE_NEVER.
+*/
+
+static void printAge(unsigned int age) {
+  if (age == SERIAL_LOG_AGE_NEVER) DEBUG_PRINT(-1);
+  else DEBUG_PRINT((unsigned long) age * SERIAL_LOG_AGE_UNIT_MS);
+}
+
+LoggedSerial::LoggedSerial(uint8_t rx_pin, uint8_t tx_pin) : SoftwareSerial(rx_pin, tx_pin) {}
+
+/*
+ * Keeps the log of the last run if it holds together, otherwise starts an empty one, then marks
+ * the boot. Must be called from setup() before the FONA is talked to.
+*/
+
+void LoggedSerial::StartLog() {
+  bool is_valid = ring.magic == SERIAL_LOG_MAGIC && ring.start < SERIAL_LOG_SIZE && ring.used <= SERIAL_LOG_SIZE;
+  // The entries have to add up to exactly what is in use.
+  unsigned int walked = 0;
+  while (is_valid && walked < ring.used) walked += entryLength((ring.start + walked) % SERIAL_LOG_SIZE);
+  if (!is_valid || walked != ring.used) Clear();
+  ring.magic = SERIAL_LOG_MAGIC;
+  _last_entry_time = 0;
+  startEntry((SERIAL_LOG_MARKER << 6) | SERIAL_LOG_BOOT);
+  _run_header = NO_RUN;
+}
+
+/*
+ * Marks the FSM entering a state, with what tools/serial_replay needs to start the replay from
+ * here. Called by BuzzerFSM right before the enter_func of the state.
+ *
+ * @input the ID of the state.
+*/
+
+void LoggedSerial::MarkState(unsigned char state_id) {
+  FonaState fona;
+  fona_shield.SaveState(&fona);
+  SerialLogState state;
+  state.state_id = state_id;
+  state.power_state = fona.power_state;
+  state.idle_power_state = fona.idle_power_state;
+  state.is_gprs_up = fona.is_gprs_up;
+  state.batt_mv = fona.batt_mv;
+  state.batt_age = ageToLog(fona.batt_age);
+  state.link_sample_age = ageToLog(fona.link_sample_age);
+  state.batt_update_age = ageToLog((last_batt_update == 0) ? FONA_STATE_NEVER : millis() - last_batt_update);
+  startEntry((SERIAL_LOG_MARKER << 6) | SERIAL_LOG_STATE);
+  const unsigned char *bytes = (const unsigned char *) &state;
+  for (unsigned char i = 0; i < sizeof(state); i++) put(bytes[i]);
+  _run_header = NO_RUN;
+}
+
+size_t LoggedSerial::write(uint8_t c) {
+  logByte(SERIAL_LOG_TO_FONA, c);
+  return SoftwareSerial::write(c);
+}
+
+int LoggedSerial::read() {
+  int c = SoftwareSerial::read();
+  if (c != -1) logByte(SERIAL_LOG_FROM_FONA, c);
+  return c;
+}
+
+/*
+ * Prints the EEPROM and the log over USB serial, one line each per 32 EEPROM bytes and per entry:
+ *   E <address> <hex bytes>
+ *   B <ms since the previous entry>
+ *   S <ms since the previous entry> <state id> <power state> <idle power state> <GPRS up>
+ *     <battery mV> <battery reading age> <link sample age> <loop() battery age>
+ *   > <ms since the previous entry> <hex bytes sent to the FONA>
+ *   < <ms since the previous entry> <hex bytes read from the FONA>
+ * tools/serial_replay reads this as is.
+*/
+
+void LoggedSerial::Dump() {
+  DEBUG_PRINTLN_FLASH("SERIAL LOG BEGIN");
+  for (unsigned int addr = 0; addr < EEPROM.length(); addr += 32) {
+    DEBUG_PRINT_FLASH("E ");
+    printHexByte(addr >> 8);
+    printHexByte(addr & 0xFF);
+    DEBUG_PRINT(' ');
+    for (unsigned char i = 0; i < 32; i++) printHexByte(EEPROM.read(addr + i));
+    DEBUG_PRINTLN();
+  }
+  unsigned int done = 0;
+  while (done < ring.used) {
+    unsigned int at = (ring.start + done) % SERIAL_LOG_SIZE;
+    unsigned char header = ring.bytes[at];
+    unsigned char kind = header >> 6;
+    unsigned long delta = 0;
+    unsigned char shift = 0;
+    unsigned int n = 1;
+    unsigned char b;
+    do {
+      b = ring.bytes[(at + n++) % SERIAL_LOG_SIZE];
+      delta |= (unsigned long) (b & 0x7F) << shift;
+      shift += 7;
+    } while (b & 0x80);
+    if (kind == SERIAL_LOG_MARKER) DEBUG_PRINT(((header & 0x3F) == SERIAL_LOG_STATE) ? 'S' : 'B');
+    else DEBUG_PRINT((kind == SERIAL_LOG_TO_FONA) ? '>' : '<');
+    DEBUG_PRINT(' ');
+    DEBUG_PRINT(delta);
+    if (kind == SERIAL_LOG_MARKER && (header & 0x3F) == SERIAL_LOG_STATE) {
+      SerialLogState state;
+      unsigned char *bytes = (unsigned char *) &state;
+      for (unsigned char i = 0; i < sizeof(state); i++) bytes[i] = ring.bytes[(at + n++) % SERIAL_LOG_SIZE];
+      DEBUG_PRINT(' ');
+      DEBUG_PRINT(state.state_id);
+      DEBUG_PRINT(' ');
+      DEBUG_PRINT(state.power_state);
+      DEBUG_PRINT(' ');
+      DEBUG_PRINT(state.idle_power_state);
+      DEBUG_PRINT(' ');
+      DEBUG_PRINT(state.is_gprs_up ? 1 : 0);
+      DEBUG_PRINT(' ');
+      DEBUG_PRINT(state.batt_mv);
+      DEBUG_PRINT(' ');
+      printAge(state.batt_age);
+      DEBUG_PRINT(' ');
+      printAge(state.link_sample_age);
+      DEBUG_PRINT(' ');
+      printAge(state.batt_update_age);
+    } else if (kind != SERIAL_LOG_MARKER) {
+      DEBUG_PRINT(' ');
+      for (unsigned char i = 0; i <= (header & 0x3F); i++) printHexByte(ring.bytes[(at + n++) % SERIAL_LOG_SIZE]);
+    }
+    DEBUG_PRINTLN();
+    done += n;
+  }
+  DEBUG_PRINTLN_FLASH("SERIAL LOG END");
+}
+
+/*
+ * Empties the log.
+*/
+
+void LoggedSerial::Clear() {
+  ring.start = 0;
+  ring.used = 0;
+  _run_header = NO_RUN;
+}
+
+/*
+ * Adds one byte to the log, to the entry being added to if it can go there.
+ *
+ * @input one of serial_log_kinds other than SERIAL_LOG_MARKER.
+ * @input the byte.
+*/
+
+void LoggedSerial::logByte(unsigned char kind, unsigned char c) {
+  unsigned long now = millis();
+  if (_run_header == NO_RUN || kind != _run_kind || now - _last_byte_time > SERIAL_LOG_RUN_GAP_MS ||
+      (ring.bytes[_run_header] & 0x3F) == SERIAL_LOG_MAX_RUN - 1) {
+    // The count starts at 0 for 1 data byte.
+    startEntry(kind << 6);
+    _run_kind = kind;
+    put(c);
+  } else {
+    put(c);
+    ring.bytes[_run_header]++;
+  }
+  _last_byte_time = now;
+}
+
+/*
+ * Adds the header and the time of a new entry.
+ *
+ * @input the header byte.
+*/
+
+void LoggedSerial::startEntry(unsigned char header) {
+  unsigned long now = millis();
+  unsigned long delta = now - _last_entry_time;
+  _last_entry_time = now;
+  _run_header = put(header);
+  do {
+    unsigned char b = delta & 0x7F;
+    delta >>= 7;
+    put(delta ? (b | 0x80) : b);
+  } while (delta);
+}
+
+/*
+ * Adds a byte at the end of the ring, dropping the oldest entries if there's no room. The ring is
+ * at least twice as big as the biggest entry, so the entry being added to is never dropped.
+ *
+ * @input the byte.
+ * @return where it went.
+*/
+
+unsigned int LoggedSerial::put(unsigned char c) {
+  while (ring.used >= SERIAL_LOG_SIZE) {
+    unsigned int n = entryLength(ring.start);
+    ring.start = (ring.start + n) % SERIAL_LOG_SIZE;
+    ring.used -= n;
+  }
+  unsigned int at = (ring.start + ring.used) % SERIAL_LOG_SIZE;
+  ring.bytes[at] = c;
+  ring.used++;
+  return at;
+}
+
+/*
+ * @input where an entry starts.
+ * @return how many bytes the entry takes up.
+*/
+
+unsigned int LoggedSerial::entryLength(unsigned int at) {
+  unsigned char header = ring.bytes[at];
+  unsigned int n = 1;
+  // Bounded, so a garbled ring after a power cycle can't hang StartLog().
+  while (n < SERIAL_LOG_SIZE && (ring.bytes[(at + n) % SERIAL_LOG_SIZE] & 0x80)) n++;
+  n++;
+  if ((header >> 6) != SERIAL_LOG_MARKER) n += (header & 0x3F) + 1;
+  else if ((header & 0x3F) == SERIAL_LOG_STATE) n += sizeof(SerialLogState);
+  return n;
+}
+
+#endif
@@ -0,0 +1,116 @@
+/*
+  File:
+  SerialLog.h
+
+  Description:
+  Compile-time option that records every byte exchanged with the FONA, with timestamps, for
+  tools/serial_replay. With SERIAL_LOG set to 1, fona_serial is a LoggedSerial: a SoftwareSerial
+  that also appends what goes through write() and read() to a ring log in RAM. Send "log" over USB
+  serial to dump it (and the EEPROM, which the replay starts from), "log clear" to start over.
+
+  The log is made of entries. A byte is added to the entry before it if it goes the same way and
+  comes within SERIAL_LOG_RUN_GAP_MS of the previous byte, so a reply is one entry rather than one
+  per byte. An entry is:
+  - a header byte: the kind (serial_log_kinds) in the top 2 bits, the number of data bytes minus 1
+    (or the marker for SERIAL_LOG_MARKER) in the low 6 bits,
+  - the ms since the previous entry started, 7 bits per byte, low bits first, the top bit set on
+    every byte but the last,
+  - the data bytes (a SerialLogState for a SERIAL_LOG_STATE marker, none for SERIAL_LOG_BOOT).
+  Once the ring is full the oldest entries are dropped to make room.
+
+  Bytes from the FONA are stamped when read() hands them over, not when they come in, so the
+  timestamps include however long the firmware took to get to them.
+
+  The ring lives in .noinit RAM, so it survives a watchdog (or FatalErrorFunc) reset, which is
+  usually what is worth looking at. Every boot adds a SERIAL_LOG_BOOT marker, and every FSM state
+  entry a SERIAL_LOG_STATE marker with what the replay needs to start from there: a long run drops
+  its boot out of the ring (WAIT_NETWORK alone polls the FONA for a while), but not its last few
+  states. A state marker takes about 15 bytes of the ring. The log takes SERIAL_LOG_SIZE bytes of
+  SRAM, check the headroom with "stack" before making it bigger.
+*/
+
+#ifndef SERIALLOG_H
+#define SERIALLOG_H
+
+#include <SoftwareSerial.h>
+
+// Set to 1 to record the FONA serial traffic.
+#ifndef SERIAL_LOG
+#define SERIAL_LOG 0
+#endif
+
+// Size of the ring log in bytes.
+#define SERIAL_LOG_SIZE 512
+
+// Bytes going the same way that come further apart than this (in ms) start a new entry.
+#define SERIAL_LOG_RUN_GAP_MS 20
+
+// Most data bytes one entry holds.
+#define SERIAL_LOG_MAX_RUN 64
+
+enum serial_log_kinds {SERIAL_LOG_MARKER, SERIAL_LOG_FROM_FONA, SERIAL_LOG_TO_FONA};
+
+// Markers, in the low bits of a SERIAL_LOG_MARKER header.
+#define SERIAL_LOG_BOOT 0
+#define SERIAL_LOG_STATE 1
+
+// Unit (in ms) of the ages in a SerialLogState, and the age of something that never happened.
+#define SERIAL_LOG_AGE_UNIT_MS 100
+#define SERIAL_LOG_AGE_NEVER 0xFFFF
+
+#if SERIAL_LOG
+
+// What a SERIAL_LOG_STATE marker holds: the FSM state that was entered and what decides what the
+// firmware sends the FONA next (FonaState, see FonaShield.h, with shorter ages).
+struct SerialLogState {
+  unsigned char state_id;
+  unsigned char power_state;
+  unsigned char idle_power_state;
+  bool is_gprs_up;
+  int batt_mv;
+  unsigned int batt_age;
+  unsigned int link_sample_age;
+  // Since loop() last read the battery.
+  unsigned int batt_update_age;
+};
+
+struct SerialLogRing {
+  // SERIAL_LOG_MAGIC once the ring has been set up. Anything else means a power cycle.
+  unsigned int magic;
+  // Where the oldest entry starts and how many bytes are in use from there on, wrapping around.
+  unsigned int start;
+  unsigned int used;
+  unsigned char bytes[SERIAL_LOG_SIZE];
+};
+
+class LoggedSerial : public SoftwareSerial {
+  private:
+    // Where the header of the entry being added to is, SERIAL_LOG_SIZE if there isn't one.
+    unsigned int _run_header = SERIAL_LOG_SIZE;
+    unsigned char _run_kind = SERIAL_LOG_MARKER;
+    unsigned long _last_byte_time = 0;
+    unsigned long _last_entry_time = 0;
+    void logByte(unsigned char kind, unsigned char c);
+    void startEntry(unsigned char header);
+    unsigned int put(unsigned char c);
+    unsigned int entryLength(unsigned int at);
+  public:
+    LoggedSerial(uint8_t rx_pin, uint8_t tx_pin);
+    void StartLog();
+    void MarkState(unsigned char state_id);
+    size_t write(uint8_t c);
+    int read();
+    using Print::write;
+    void Dump();
+    void Clear();
+};
+
+typedef LoggedSerial FonaSerial;
+
+#else
+
+typedef SoftwareSerial FonaSerial;
+
+#endif
+
+#endif
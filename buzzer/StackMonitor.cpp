@@ -0,0 +1,148 @@
+/*
+  File:
+  StackMonitor.cpp
+
+  Description:
+  Stack painting and per state high-water marks. See StackMonitor.h.
+*/
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <avr/io.h>
+#include <util/crc16.h>
+#include "Helpers.h"
+#include "StackMonitor.h"
+
+#define STACK_STATS_MAGIC 0x57AC
+
+// End of the heap (set by the linker and malloc).
+extern char __heap_start, *__brkval;
+
+// Not cleared by the startup code, so the stats survive a reset that doesn't cut the power.
+static StackStats stack_stats __attribute__((section(".noinit")));
+
+/*
+ * @return the first byte past the heap, where the painted area starts.
+*/
+
+static unsigned char *heapEnd() {
+  return (unsigned char *) (__brkval == 0 ? &__heap_start : __brkval);
+}
+
+/*
+ * Paints from the given address up to STACK_PAINT_MARGIN bytes below the stack pointer.
+ *
+ * @input the lowest address to paint.
+*/
+
+static void paint(unsigned char *from) {
+  unsigned char *top = (unsigned char *) SP - STACK_PAINT_MARGIN;
+  while (from < top) *from++ = STACK_CANARY;
+}
+
+/*
+ * @return the crc16 of the stats, crc field excluded.
+*/
+
+static unsigned int statsCrc() {
+  unsigned int crc = 0xFFFF;
+  const unsigned char *bytes = (const unsigned char *) &stack_stats;
+  for (unsigned char i = 0; i < offsetof(StackStats, crc); i++) crc = _crc16_update(crc, bytes[i]);
+  return crc;
+}
+
+/*
+ * Keeps the stats from the last run if they made it through the reset, then paints the free SRAM.
+ * Meant to be the first thing setup() does, while the stack is still shallow.
+*/
+
+void StackMonitor::Begin() {
+  if (stack_stats.magic != STACK_STATS_MAGIC || stack_stats.crc != statsCrc()) {
+    Clear();
+  } else {
+    stack_stats.num_resets++;
+    seal();
+  }
+  paint(heapEnd());
+}
+
+/*
+ * Hands the stack use since the last call to the slot that was being measured, and starts
+ * measuring the given one.
+ *
+ * @input the slot to measure from now on: an FSM state ID, STACK_SLOT_FONA or STACK_SLOT_LOOP.
+ * @return the slot that was being measured, so a caller can hand back to it when it is done.
+*/
+
+unsigned char StackMonitor::Attribute(unsigned char slot) {
+  unsigned char *deepest = scan();
+  unsigned int used = RAMEND + 1 - (unsigned int) deepest;
+  unsigned int headroom = deepest - heapEnd();
+  if (used > stack_stats.peaks[_slot] || headroom < stack_stats.min_headroom) {
+    if (used > stack_stats.peaks[_slot]) stack_stats.peaks[_slot] = used;
+    if (headroom < stack_stats.min_headroom) stack_stats.min_headroom = headroom;
+    seal();
+  }
+  paint(deepest);
+  unsigned char prev_slot = _slot;
+  _slot = slot;
+  return prev_slot;
+}
+
+/*
+ * Forgets all the peaks.
+*/
+
+void StackMonitor::Clear() {
+  memset(&stack_stats, 0, sizeof(stack_stats));
+  stack_stats.magic = STACK_STATS_MAGIC;
+  stack_stats.min_headroom = UINT_MAX;
+  seal();
+}
+
+/*
+ * Prints the peak of every slot that has been measured, and the least headroom, over USB serial.
+*/
+
+void StackMonitor::Print() {
+  DEBUG_PRINT_FLASH("Stack peaks (bytes), kept across ");
+  DEBUG_PRINT(stack_stats.num_resets);
+  DEBUG_PRINTLN_FLASH(" resets:");
+  for (unsigned char i = 0; i < NUM_STACK_SLOTS; i++) {
+    if (stack_stats.peaks[i] == 0) continue;
+    if (i == STACK_SLOT_FONA) {
+      DEBUG_PRINT_FLASH("FONA HTTP");
+    } else if (i == STACK_SLOT_LOOP) {
+      DEBUG_PRINT_FLASH("loop");
+    } else {
+      DEBUG_PRINT_FLASH("state ");
+      DEBUG_PRINT(i);
+    }
+    DEBUG_PRINT_FLASH(": ");
+    DEBUG_PRINTLN(stack_stats.peaks[i]);
+  }
+  DEBUG_PRINT_FLASH("Least headroom: ");
+  DEBUG_PRINTLN(stack_stats.min_headroom);
+}
+
+/*
+ * Finds the deepest byte the stack has written to since the area was last painted. Bytes that
+ * happen to be written with the canary value are missed, which at worst hides a few bytes.
+ *
+ * @return the lowest address that doesn't hold the canary anymore.
+*/
+
+unsigned char *StackMonitor::scan() {
+  unsigned char *p = heapEnd();
+  unsigned char *top = (unsigned char *) SP;
+  while (p < top && *p == STACK_CANARY) p++;
+  return p;
+}
+
+/*
+ * Updates the crc after the stats changed.
+*/
+
+void StackMonitor::seal() {
+  stack_stats.crc = statsCrc();
+}
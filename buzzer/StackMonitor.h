@@ -0,0 +1,64 @@
+/*
+  File:
+  StackMonitor.h
+
+  Description:
+  Measures how deep the stack really gets. At boot the free SRAM between the end of the heap and
+  the stack is painted with a canary byte. Each time the attribution changes (an FSM state starts or
+  ends, a FONA HTTP call starts or ends), the painted area is scanned upward from the heap. The
+  first byte that isn't the canary anymore is the deepest point the stack reached since the last
+  scan. That depth goes to the state or call being measured, and the area below the current stack
+  pointer is painted again so the next one starts fresh.
+
+  The peaks are kept in .noinit RAM, so they survive a watchdog (or FatalErrorFunc) reset and add
+  up over a whole day. A power cycle clears them, and so does a bootloader that overwrites that RAM.
+  Send "stack" over USB serial to print them and "stack clear" to start over.
+
+  Interrupts use whatever stack is current, so an ISR's depth goes to the state it interrupted.
+  Depths are accurate to within STACK_PAINT_MARGIN bytes.
+*/
+
+#ifndef STACKMONITOR_H
+#define STACKMONITOR_H
+
+#include "BuzzerFSM.h"
+
+// What the free SRAM is painted with.
+#define STACK_CANARY 0xC5
+
+// Bytes right below the stack pointer that are left unpainted, so the painting never overwrites
+// its own frame.
+#define STACK_PAINT_MARGIN 32
+
+// The stack use the FSM states don't account for. Slots 0 to NUM_STATES-1 are the FSM states, in
+// state_ids order.
+#define STACK_SLOT_FONA NUM_STATES
+#define STACK_SLOT_LOOP (NUM_STATES + 1)
+#define NUM_STACK_SLOTS (NUM_STATES + 2)
+
+struct StackStats {
+  // STACK_STATS_MAGIC once the stats have been set up. Anything else means a power cycle.
+  unsigned int magic;
+  // Deepest stack use (in bytes below RAMEND) seen in each slot.
+  unsigned int peaks[NUM_STACK_SLOTS];
+  // Fewest unused bytes seen between the heap and the stack.
+  unsigned int min_headroom;
+  // Resets the stats have been kept across.
+  unsigned char num_resets;
+  // crc16 of everything above, so RAM garbage that happens to hold the magic isn't trusted.
+  unsigned int crc;
+};
+
+class StackMonitor {
+  private:
+    unsigned char _slot = STACK_SLOT_LOOP;
+    unsigned char *scan();
+    void seal();
+  public:
+    void Begin();
+    unsigned char Attribute(unsigned char slot);
+    void Clear();
+    void Print();
+};
+
+#endif
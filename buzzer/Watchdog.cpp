@@ -0,0 +1,205 @@
+/*
+  File:
+  Watchdog.cpp
+
+  Description:
+  Hardware watchdog supervisor and crash record. See Watchdog.h.
+*/
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <avr/wdt.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+#include "Globals.h"
+#include "Watchdog.h"
+
+#define CRASH_RECORD_MAGIC 0xC4A5
+
+// WDTCSR prescaler bits for a WDTO_* value. WDP3 isn't next to the other three.
+#define WDT_PRESCALER(wdto) ((((wdto) & 0x08) ? _BV(WDP3) : 0) | ((wdto) & 0x07))
+
+// Not cleared by the startup code, so the record survives the reset.
+static CrashRecord crash_record __attribute__((section(".noinit")));
+
+// The ISR needs to know which supervisor to hand timeouts to.
+static Watchdog *active_watchdog = NULL;
+
+ISR(WDT_vect) {
+  if (active_watchdog != NULL) active_watchdog->handleTimeout();
+}
+
+/*
+ * @return the crc16 of the crash record, crc field excluded.
+*/
+
+static unsigned int recordCrc() {
+  unsigned int crc = 0xFFFF;
+  const unsigned char *bytes = (const unsigned char *) &crash_record;
+  for (unsigned char i = 0; i < offsetof(CrashRecord, crc); i++) crc = _crc16_update(crc, bytes[i]);
+  return crc;
+}
+
+/*
+ * Keeps the crash record of the last run if there is one and starts supervising. Meant to be the
+ * first thing setup() does: a watchdog reset leaves the watchdog running with its shortest timeout.
+*/
+
+void Watchdog::begin() {
+  active_watchdog = this;
+  arm(0);
+  if (crash_record.magic == CRASH_RECORD_MAGIC && crash_record.crc == recordCrc()) {
+    _last_crash = crash_record;
+  } else {
+    memset(&_last_crash, 0, sizeof(_last_crash));
+  }
+  // Only the boot right after a crash gets to see it.
+  crash_record.magic = 0;
+  Resume();
+}
+
+/*
+ * Called from the watchdog ISR at the end of every period. Wakes PowerManager up, lets another
+ * supervision period start, or records the crash and resets the Arduino once the budget is used up.
+*/
+
+void Watchdog::handleTimeout() {
+  if (_is_waking) {
+    _has_woken = true;
+    return;
+  }
+  if (++_ticks < WATCHDOG_BUDGET_TICKS) {
+    // Running the ISR put the watchdog in reset mode, this puts it back in interrupt mode.
+    WDTCSR |= _BV(WDIE);
+    return;
+  }
+  RecordCrash(CRASH_WATCHDOG);
+  // Reset in 15ms rather than after one more full period.
+  WDTCSR = _BV(WDCE) | _BV(WDE);
+  WDTCSR = _BV(WDE);
+  while (true);
+}
+
+/*
+ * Tells the watchdog things are still moving. Called once per loop() iteration and before each of
+ * the long but bounded steps (an HTTP request, a FONA wakeup attempt).
+ *
+ * The Arduino core resets into the bootloader through the watchdog when a new sketch is uploaded.
+ * It sets the watchdog to reset mode only, so a watchdog without WDIE isn't kicked.
+*/
+
+void Watchdog::Kick() {
+  if (_is_waking || !(WDTCSR & _BV(WDIE))) return;
+  wdt_reset();
+  _ticks = 0;
+}
+
+/*
+ * Writes the crash record for the reset that is about to happen.
+ *
+ * @input one of crash_reasons.
+*/
+
+void Watchdog::RecordCrash(unsigned char reason) {
+  crash_record.magic = CRASH_RECORD_MAGIC;
+  crash_record.reason = reason;
+  crash_record.state_id = buzzer_fsm.CurrentStateId();
+  crash_record.last_at_command = fona_shield.LastATCommand();
+  crash_record.uptime = millis();
+  crash_record.modem_flags = (fona_shield.IsGPRSUp()) ? MODEM_GPRS_UP : 0;
+  crash_record.num_watchdog_crashes = (reason == CRASH_WATCHDOG) ? _last_crash.num_watchdog_crashes + 1 : 0;
+  crash_record.crc = recordCrc();
+}
+
+/*
+ * @return the crash record left by the last run. Its reason is CRASH_NONE if the last run didn't
+ * crash (or the Buzzer was power cycled).
+*/
+
+const CrashRecord *Watchdog::LastCrash() {
+  return &_last_crash;
+}
+
+/*
+ * Starts counting watchdog resets in a row from 0 again. Called when the Buzzer boots cold.
+*/
+
+void Watchdog::ClearCrashCount() {
+  _last_crash.num_watchdog_crashes = 0;
+}
+
+/*
+ * Prints the crash record left by the last run over USB serial, if there is one.
+*/
+
+void Watchdog::PrintLastCrash() {
+  if (_last_crash.reason == CRASH_NONE) {
+    DEBUG_PRINTLN_FLASH("No crash recorded.");
+    return;
+  }
+  DEBUG_PRINT_FLASH("Last reset: ");
+  if (_last_crash.reason == CRASH_WATCHDOG) DEBUG_PRINTLN_FLASH("watchdog");
+  else DEBUG_PRINTLN_FLASH("fatal error");
+  DEBUG_PRINT_FLASH("State: ");
+  DEBUG_PRINTLN(_last_crash.state_id);
+  if (_last_crash.last_at_command != NULL) {
+    DEBUG_PRINT_FLASH("Last AT command: ");
+    DEBUG_PRINTLN(_last_crash.last_at_command);
+  }
+  DEBUG_PRINT_FLASH("Uptime (ms): ");
+  DEBUG_PRINTLN(_last_crash.uptime);
+  DEBUG_PRINT_FLASH("GPRS up: ");
+  DEBUG_PRINTLN((_last_crash.modem_flags & MODEM_GPRS_UP) ? 1 : 0);
+  DEBUG_PRINT_FLASH("Watchdog resets in a row: ");
+  DEBUG_PRINTLN(_last_crash.num_watchdog_crashes);
+}
+
+/*
+ * Hands the watchdog to PowerManager: it fires the interrupt once after the given time, without
+ * resetting and without counting against the budget. Call Resume() when done.
+ *
+ * @input a WDTO_* value.
+*/
+
+void Watchdog::WakeAfter(unsigned char wdto) {
+  _is_waking = true;
+  _has_woken = false;
+  arm(_BV(WDIE) | WDT_PRESCALER(wdto));
+}
+
+/*
+ * @return true if the watchdog fired since the last WakeAfter().
+*/
+
+bool Watchdog::HasWoken() {
+  return _has_woken;
+}
+
+/*
+ * Starts supervising again with a full budget, in interrupt and reset mode.
+*/
+
+void Watchdog::Resume() {
+  _is_waking = false;
+  _ticks = 0;
+  arm(_BV(WDIE) | _BV(WDE) | WDT_PRESCALER(WDTO_8S));
+}
+
+/*
+ * Writes the watchdog control register.
+ *
+ * @input the new WDTCSR value. 0 turns the watchdog off.
+*/
+
+void Watchdog::arm(unsigned char wdtcsr) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    wdt_reset();
+    // The watchdog can't be turned off while WDRF is set.
+    MCUSR &= ~_BV(WDRF);
+    // Timed sequence: WDCE must be set in the same write as WDE before the mode or the prescaler
+    // can be changed.
+    WDTCSR = _BV(WDCE) | _BV(WDE);
+    WDTCSR = wdtcsr;
+  }
+}
@@ -0,0 +1,83 @@
+/*
+  File:
+  Watchdog.h
+
+  Description:
+  Hardware watchdog supervisor. loop() kicks the watchdog every iteration. If a kick doesn't come
+  for WATCHDOG_BUDGET_TICKS watchdog periods (e.g. a FONA reply loop that never ends), the
+  watchdog interrupt writes a crash record and the watchdog resets the Arduino. FatalErrorFunc
+  writes one too before it resets the Arduino itself.
+
+  The record holds why the Buzzer reset, the FSM state it was in, the last AT command sent to the
+  FONA, the uptime and whether GPRS was up. It lives in .noinit RAM with a crc16, so it survives
+  the reset but not a power cycle (or a bootloader that overwrites that RAM). The boot that follows
+  uses it to pick the fast recovery path (see load_boot_snapshot() in buzzer.ino), unless the
+  watchdog has reset the Arduino more than WATCHDOG_WARM_BOOT_CRASHES times in a row.
+
+  The AVR watchdog times out after 8s at most, which is shorter than one HTTP request can
+  legitimately block for. So the watchdog runs in interrupt and reset mode: every period ends in
+  the interrupt, which only lets the reset happen once the budget is used up.
+
+  PowerManager borrows the watchdog to wake up from power-down (see WakeAfter()).
+*/
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <Arduino.h>
+#include "Helpers.h"
+
+// How long one supervision period lasts (WDTO_8S).
+#define WATCHDOG_PERIOD_MS 8000
+
+// Periods in a row without a kick before the Arduino is reset. 40s is more than the longest
+// single blocking step (one HTTP request with its 20s HTTP_TIMEOUT, one FONA wakeup attempt, the
+// 10s delays before giving up) plus the rest of one loop() iteration.
+#define WATCHDOG_BUDGET_TICKS 5
+
+// Watchdog resets in a row that still get a warm boot. A hang that comes back after a warm boot
+// (e.g. a FONA that stopped answering in IDLE) then gets a cold boot, which resets the FONA.
+#define WATCHDOG_WARM_BOOT_CRASHES 1
+
+enum crash_reasons {CRASH_NONE, CRASH_WATCHDOG, CRASH_FATAL_ERROR};
+
+struct CrashRecord {
+  // CRASH_RECORD_MAGIC once a crash has been recorded. Anything else means a power cycle.
+  unsigned int magic;
+  // One of crash_reasons.
+  unsigned char reason;
+  // FSM state the Buzzer was in.
+  unsigned char state_id;
+  // Last AT command sent to the FONA, NULL if none was.
+  FlashStrPtr last_at_command;
+  // millis() at the time of the crash.
+  unsigned long uptime;
+  // MODEM_* bits (see EEPROMReadWrite.h).
+  unsigned char modem_flags;
+  // Watchdog resets in a row since the last cold boot, this one included. 0 for CRASH_FATAL_ERROR.
+  unsigned char num_watchdog_crashes;
+  // crc16 of everything above, so RAM garbage that happens to hold the magic isn't trusted.
+  unsigned int crc;
+};
+
+class Watchdog {
+  private:
+    CrashRecord _last_crash;
+    volatile unsigned char _ticks = 0;
+    volatile bool _is_waking = false;
+    volatile bool _has_woken = false;
+    void arm(unsigned char wdtcsr);
+  public:
+    void begin();
+    void handleTimeout();
+    void Kick();
+    void RecordCrash(unsigned char reason);
+    const CrashRecord *LastCrash();
+    void ClearCrashCount();
+    void PrintLastCrash();
+    void WakeAfter(unsigned char wdto);
+    bool HasWoken();
+    void Resume();
+};
+
+#endif
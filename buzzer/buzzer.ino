@@ -13,24 +13,44 @@
 #include "BuzzerFSMCallbacks.h"
 #include "Globals.h"
 #include "Pins.h"
+#include "Board.h"
 #include "EEPROMReadWrite.h"
 #include "LPF.h"
+#include "Battery.h"
 #include "Version.h"
 
 // Initializations of global variables definied in "Globals.h".
-BuzzerFSM buzzer_fsm({INIT_FONA, INIT, INIT, InitFunc}, INIT);
-SoftwareSerial fona_serial = SoftwareSerial(FONA_TX_PIN, FONA_RX_PIN);
-FonaShield fona_shield(&fona_serial, FONA_RST_PIN);
-SSD1306AsciiAvrI2c oled;
+BuzzerFSM buzzer_fsm({INIT_FONA, INIT, RESUME_FONA, InitFunc, InitEnterFunc}, INIT);
+FonaSerial fona_serial(FONA_TX_PIN, FONA_RX_PIN);
+FonaShield fona_shield(&fona_serial);
+SSD1306AsciiAsyncI2c oled;
+Display display(&oled);
+PowerManager power_manager(BUTTON_PIN);
+ADCSampler adc_sampler;
+Haptics haptics(BUZZER_PIN);
+Watchdog watchdog;
+LinkMonitor link_monitor;
+RequestBodies request_bodies;
+StackMonitor stack_monitor;
+EEPROMRecordStore eeprom_data_store(EEPROM_DATA_STORE_START, EEPROM_DATA_STORE_END, sizeof(EEPROMData));
+EEPROMRecordStore api_config_store(EEPROM_API_CONFIG_START, EEPROM_API_CONFIG_END, sizeof(ApiConfig));
+ApiEndpoints api_endpoints(&api_config_store);
+EEPROMRecordStore outbox_store(EEPROM_OUTBOX_START, EEPROM_OUTBOX_END, sizeof(OutboxRecord));
+Outbox outbox(&outbox_store);
+EEPROMRecordStore boot_snapshot_store(EEPROM_BOOT_SNAPSHOT_START, EEPROM_BOOT_SNAPSHOT_END, sizeof(BootSnapshot));
 // char eeprom_data.buzzer_name[30];
 // int party_id = NO_PARTY;
 EEPROMData eeprom_data;
+BootSnapshot boot_snapshot;
+bool is_warm_boot = false;
 short wait_time = NO_PARTY;
 char party_name[20];
 short batt_percentage = 100;
 bool has_system_been_initialized = false;
 unsigned long button_press_start = 0;
 unsigned long last_batt_update = 0;
+// Filters the combined voltage of both lipos (in mV).
+LPF<> batt_voltage_lpf;
 bool usb_cabled_plugged_in = false;
 
 /*
@@ -38,69 +58,153 @@ bool usb_cabled_plugged_in = false;
 */
 
 void init_fsm() {
-  buzzer_fsm.AddState({INIT_GPRS, INIT, INIT, InitFonaShieldFunc}, INIT_FONA);
+  buzzer_fsm.AddState({WAIT_NETWORK, INIT, INIT, InitFonaShieldFunc, InitFonaShieldEnterFunc}, INIT_FONA);
+  buzzer_fsm.AddState({INIT_GPRS, INIT, INIT_GPRS, WaitNetworkFunc, WaitNetworkEnterFunc}, WAIT_NETWORK);
   int init_gprs_next_state = CHECK_BUZZER_REGISTRATION;
-  if (strlen(eeprom_data.buzzer_name) == 0 || eeprom_data.buzzer_name[0] == 0xFFFFFFFF) init_gprs_next_state = GET_BUZZER_NAME;
+  if (strlen(eeprom_data.buzzer_name) == 0) init_gprs_next_state = GET_BUZZER_NAME;
   int check_buzzer_reg_next_state = (eeprom_data.curr_party_id != NO_PARTY && eeprom_data.curr_party_id != 0) ? HEARTBEAT : IDLE;
-  buzzer_fsm.AddState({init_gprs_next_state, INIT, INIT, InitGPRSFunc}, INIT_GPRS);
-  buzzer_fsm.AddState({check_buzzer_reg_next_state, FATAL_ERROR, WAIT_BUZZER_REGISTRATION, CheckBuzzerRegFunc}, CHECK_BUZZER_REGISTRATION);
-  buzzer_fsm.AddState({WAIT_BUZZER_REGISTRATION, FATAL_ERROR, FATAL_ERROR, GetBuzzerNameFunc}, GET_BUZZER_NAME);
-  buzzer_fsm.AddState({GET_AVAILABLE_PARTY, FATAL_ERROR, FATAL_ERROR, IdleFunc}, IDLE);
-  buzzer_fsm.AddState({IDLE, FATAL_ERROR, FATAL_ERROR, WaitBuzzerRegFunc}, WAIT_BUZZER_REGISTRATION);
-  buzzer_fsm.AddState({ACCEPT_AVAILABLE_PARTY, FATAL_ERROR, IDLE, GetAvailPartyFunc}, GET_AVAILABLE_PARTY);
+  buzzer_fsm.AddState({init_gprs_next_state, INIT, INIT, InitGPRSFunc, InitGPRSEnterFunc}, INIT_GPRS);
+  buzzer_fsm.AddState({check_buzzer_reg_next_state, INIT_FONA, INIT_FONA, ResumeFonaShieldFunc, ResumeFonaShieldEnterFunc}, RESUME_FONA);
+  buzzer_fsm.AddState({check_buzzer_reg_next_state, FATAL_ERROR, WAIT_BUZZER_REGISTRATION, CheckBuzzerRegFunc, CheckBuzzerRegEnterFunc}, CHECK_BUZZER_REGISTRATION);
+  buzzer_fsm.AddState({WAIT_BUZZER_REGISTRATION, FATAL_ERROR, FATAL_ERROR, GetBuzzerNameFunc, GetBuzzerNameEnterFunc}, GET_BUZZER_NAME);
+  buzzer_fsm.AddState({GET_AVAILABLE_PARTY, FATAL_ERROR, WAIT_BUZZER_REGISTRATION, IdleFunc, IdleEnterFunc, IdleExitFunc}, IDLE);
+  buzzer_fsm.AddState({IDLE, FATAL_ERROR, FATAL_ERROR, WaitBuzzerRegFunc, WaitBuzzerRegEnterFunc}, WAIT_BUZZER_REGISTRATION);
+#if CLAIM_PARTY_MODE
+  // One round trip picks and accepts the party, so ACCEPT_AVAILABLE_PARTY is never entered.
+  buzzer_fsm.AddState({HEARTBEAT, FATAL_ERROR, IDLE, ClaimPartyFunc, GetAvailPartyEnterFunc}, GET_AVAILABLE_PARTY);
+#else
+  buzzer_fsm.AddState({ACCEPT_AVAILABLE_PARTY, FATAL_ERROR, IDLE, GetAvailPartyFunc, GetAvailPartyEnterFunc}, GET_AVAILABLE_PARTY);
   buzzer_fsm.AddState({HEARTBEAT, FATAL_ERROR, IDLE, AcceptAvailPartyFunc}, ACCEPT_AVAILABLE_PARTY);
-  buzzer_fsm.AddState({BUZZ, FATAL_ERROR, IDLE, HeartbeatFunc}, HEARTBEAT);
-  buzzer_fsm.AddState({IDLE, FATAL_ERROR, BUZZ, BuzzFunc}, BUZZ);
+#endif
+  buzzer_fsm.AddState({BUZZ, FATAL_ERROR, IDLE, HeartbeatFunc, HeartbeatEnterFunc}, HEARTBEAT);
+  buzzer_fsm.AddState({IDLE, FATAL_ERROR, BUZZ, BuzzFunc, BuzzEnterFunc, BuzzExitFunc}, BUZZ);
   buzzer_fsm.AddState({IDLE, INIT, HEARTBEAT, WakeupFunc}, WAKEUP);
   buzzer_fsm.AddState({SLEEP, FATAL_ERROR, FATAL_ERROR, ShutdownFunc}, SHUTDOWN);
-  buzzer_fsm.AddState({IDLE, FATAL_ERROR, FATAL_ERROR, SleepFunc}, SLEEP);
-  buzzer_fsm.AddState({IDLE, FATAL_ERROR, FATAL_ERROR, ChargeFunc}, CHARGING);
+  buzzer_fsm.AddState({IDLE, FATAL_ERROR, FATAL_ERROR, SleepFunc, SleepEnterFunc, SleepExitFunc}, SLEEP);
+  buzzer_fsm.AddState({IDLE, FATAL_ERROR, FATAL_ERROR, ChargeFunc, ChargeEnterFunc}, CHARGING);
   buzzer_fsm.AddState({INIT, INIT, INIT, FatalErrorFunc}, FATAL_ERROR);
-  buzzer_fsm.AddState({HEARTBEAT, FATAL_ERROR, IDLE, LowCellReceptionFunc}, LOW_CELL_RECEPTION);
+  buzzer_fsm.AddState({HEARTBEAT, FATAL_ERROR, IDLE, LowCellReceptionFunc, LowCellReceptionEnterFunc}, LOW_CELL_RECEPTION);
 }
 
 /*
- * The name of the Buzzer is stored in EEPROM. This function reads the bytes at the location
- * where the name should be stored (0x0) and stores it in a global variable.
+ * The name of the Buzzer and the current party are stored in the EEPROM record store. This
+ * function finds the latest record and stores it in a global variable. If the store is empty the
+ * data is read from where it used to live (0x0), so buzzers that were set up before the store
+ * existed keep their name.
 */
 
 void get_buzzer_name_from_eeprom() {
-  EEPROM.get(0, eeprom_data);
+  if (!eeprom_data_store.Begin() || !eeprom_data_store.Read(&eeprom_data)) {
+    EEPROM.get(BASE_ADDRESS, eeprom_data);
+    // A blank EEPROM reads as 0xFF.
+    if ((unsigned char) eeprom_data.buzzer_name[0] == 0xFF) {
+      eeprom_data.buzzer_name[0] = '\0';
+      eeprom_data.curr_party_id = NO_PARTY;
+    }
+    eeprom_data.buzzer_name[LONGEST_BUZZER_NAME] = '\0';
+    eeprom_data.party_name[LONGEST_PARTY_NAME] = '\0';
+  }
   DEBUG_PRINTLN_FLASH("Stored in eeprom: ");
   DEBUG_PRINTLN(eeprom_data.buzzer_name);
   DEBUG_PRINTLN(eeprom_data.curr_party_id);
 }
 
 /*
- * Buzzes the vibration motor twice. Used in the setup sequence to verify that the buzzer is
- * working.
+ * Reads the boot snapshot and decides whether this is a warm boot: the Buzzer reset itself (see
+ * FatalErrorFunc) or was reset by the watchdog while it was registered and had a name. Warm boots
+ * skip the splash, the motor test, the FONA reset and the registration check. The pending flag is
+ * cleared straight away so only the boot right after the reset is warm.
+ *
+ * A watchdog reset in RESUME_FONA means the warm boot itself hung, so that one boots cold. So does
+ * a watchdog reset that follows WATCHDOG_WARM_BOOT_CRASHES others in a row: whatever hung came back
+ * after the warm boot, and only resetting the FONA might clear it.
+*/
+
+void load_boot_snapshot() {
+  boot_snapshot_store.Begin();
+  if (!boot_snapshot_store.Read(&boot_snapshot)) memset(&boot_snapshot, 0, sizeof(boot_snapshot));
+  bool is_restart_pending = boot_snapshot.is_warm_restart_pending;
+  const CrashRecord *crash = watchdog.LastCrash();
+  if (crash->reason == CRASH_WATCHDOG && crash->state_id != RESUME_FONA &&
+      crash->num_watchdog_crashes <= WATCHDOG_WARM_BOOT_CRASHES) {
+    is_restart_pending = true;
+    // The watchdog can't write the EEPROM, the crash record knows what the FONA was up to.
+    boot_snapshot.modem_flags = crash->modem_flags;
+  }
+  is_warm_boot = is_restart_pending && boot_snapshot.is_registered && strlen(eeprom_data.buzzer_name) != 0;
+  if (!is_warm_boot) watchdog.ClearCrashCount();
+  if (boot_snapshot.is_warm_restart_pending) {
+    boot_snapshot.is_warm_restart_pending = false;
+    EEPROMWriteBootSnapshot(&boot_snapshot);
+  }
+  DEBUG_PRINT_FLASH("Boot snapshot generation: ");
+  DEBUG_PRINTLN(boot_snapshot.generation);
+}
+
+/*
+ * Reads commands sent over USB serial one char at a time, so loop() never waits on the serial
+ * port. A command is a line:
+ * - "url <base URL>" points the Buzzer at another backend (e.g. tools/mock_buzzer_api.cpp). "url"
+ *   on its own goes back to the production backend. The base URL is stored in the EEPROM and used
+ *   from the next request on.
+ * - "stack" prints the stack peaks (see StackMonitor.h), "stack clear" forgets them.
+ * - "crash" prints why the Buzzer last reset itself (see Watchdog.h).
+ * - "modem" prints the FONA's power state and how long it last took to wake up from each one.
+ * - "link" prints the cell link stats (see LinkMonitor.h).
+ * - "log" dumps the FONA serial log, "log clear" empties it. Only with SERIAL_LOG (see
+ *   SerialLog.h).
 */
 
-void buzz_twice() {
-  analogWrite(BUZZER_PIN, 255);
-  delay(300);
-  analogWrite(BUZZER_PIN, 0);
-  delay(300);
-  analogWrite(BUZZER_PIN, 255);
-  delay(300);
-  analogWrite(BUZZER_PIN, 0);
+void read_serial_commands() {
+  static char line[LONGEST_API_BASE_URL + 5];
+  static unsigned char line_len = 0;
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c != '\n' && c != '\r') {
+      // Overlong lines are cut off, which makes a too long URL fail below.
+      if (line_len < sizeof(line) - 1) line[line_len++] = c;
+      continue;
+    }
+    line[line_len] = '\0';
+    if (strncmp_P(line, PSTR("url"), 3) == 0 && (line[3] == '\0' || line[3] == ' ')) {
+      bool is_set = line_len < sizeof(line) - 1 && api_endpoints.SetBaseURL(line + ((line[3] == ' ') ? 4 : 3));
+      DEBUG_PRINT_FLASH("API base URL: ");
+      DEBUG_PRINTLN(is_set ? api_endpoints.BaseURL() : "too long");
+    } else if (strcmp_P(line, PSTR("stack")) == 0) {
+      stack_monitor.Print();
+    } else if (strcmp_P(line, PSTR("stack clear")) == 0) {
+      stack_monitor.Clear();
+    } else if (strcmp_P(line, PSTR("crash")) == 0) {
+      watchdog.PrintLastCrash();
+    } else if (strcmp_P(line, PSTR("modem")) == 0) {
+      fona_shield.PrintPowerState();
+    } else if (strcmp_P(line, PSTR("link")) == 0) {
+      link_monitor.Print();
+#if SERIAL_LOG
+    } else if (strcmp_P(line, PSTR("log")) == 0) {
+      fona_serial.Dump();
+    } else if (strcmp_P(line, PSTR("log clear")) == 0) {
+      fona_serial.Clear();
+#endif
+    }
+    line_len = 0;
+  }
 }
 
 /*
- * Sets up all the various peripheral pins.
+ * Sets up all the various peripheral pins. The ones in Board.h are set up through their FastPins.
 */
 
 void setup_pins() {
-  digitalWrite(ARDUINO_RST_PIN, HIGH);
+  ThisBoard::ArduinoRst::SetHigh();
+  ThisBoard::ArduinoRst::SetOutput();
   pinMode(LED_BUILTIN, OUTPUT);
-  pinMode(FONA_RST_PIN, OUTPUT);
-  pinMode(BUTTON_PIN, INPUT);
+  ThisBoard::FonaRst::SetOutput();
+  ThisBoard::Button::SetInput();
   pinMode(BUZZER_PIN, OUTPUT);
-  pinMode(ARDUINO_RST_PIN, OUTPUT);
-  #if BOARD_TYPE == V1 || BOARD_TYPE == V2
-  // enable internal pull up resistor in arduino
-  digitalWrite(BUTTON_PIN, HIGH);
-  #endif
+  // An active low button needs the internal pull up resistor in the arduino.
+  if (ThisBoard::Button::IS_ACTIVE_LOW) ThisBoard::Button::SetHigh();
+  else ThisBoard::Button::SetLow();
 }
 
 /*
@@ -118,19 +222,40 @@ void init_oled() {
 }
 
 /*
- * Called on reset. Sets up the GPIO pins in the right modes, initializes the OLED, tests the
- * vibration motor, gets the buzzer name from the EEPROM (if there is one), and Initializes
- * the FSM.
+ * Called on reset. Starts the watchdog supervisor, paints the free SRAM for the stack monitor,
+ * sets up the GPIO pins in the right modes, gets the buzzer name and the boot snapshot from the
+ * EEPROM (if there are any), and Initializes the FSM.
+ *
+ * On a cold boot the slow parts run side by side: the FONA reset is started first, so the FONA
+ * boots and registers with the network while the OLED is initialized and INIT shows the splash.
+ * The vibration motor test plays in the background meanwhile.
 */
 
 void setup() {
+  watchdog.begin();
+  stack_monitor.Begin();
+#if SERIAL_LOG
+  fona_serial.StartLog();
+#endif
   Serial.begin(115200);
+  if (watchdog.LastCrash()->reason != CRASH_NONE) watchdog.PrintLastCrash();
   // ClearEEPROM();
   setup_pins();
-  init_oled();
-  buzz_twice();
+  adc_sampler.begin();
+  haptics.begin();
   get_buzzer_name_from_eeprom();
-  if (eeprom_data.buzzer_name[0] == 0xFFFFFFFF) eeprom_data.curr_party_id = -1;
+  request_bodies.SetBuzzerName(eeprom_data.buzzer_name);
+  outbox.Begin();
+  api_endpoints.Begin();
+  DEBUG_PRINT_FLASH("API base URL: ");
+  DEBUG_PRINTLN(api_endpoints.BaseURL());
+  load_boot_snapshot();
+  if (!is_warm_boot) {
+    fona_shield.StartReset();
+    // Buzzes twice to show the motor works.
+    haptics.Play(double_buzz_pattern);
+  }
+  init_oled();
   init_fsm();
 }
 
@@ -138,54 +263,65 @@ void setup() {
  * The core method of Buzzer. After setup has completed, this method is called repeatedly in an
  * endless loop.
  *
- * This method processes the current FSM state and feeds the current battery voltage into a low
- * pass filter (to reduce noise) every 15 seconds. If something has happened with one of the
- * peripherals (USB cable plugged in, button pressed), this method will tell the FSM about that
- * event.
+ * This method kicks the watchdog, processes the current FSM state and feeds the current battery
+ * voltage into a low pass filter (to reduce noise) every 7.5 seconds. If something has happened
+ * with one of the peripherals (USB cable plugged in, button pressed, cell link low), this method
+ * will tell the FSM about that event.
 */
 
 void loop() {
+  watchdog.Kick();
+
   // Do the work of the current FSM state.
   buzzer_fsm.ProcessState();
 
+  // Latest Vcc sample taken in the background by adc_sampler.
+  long vcc = adc_sampler.GetVcc();
+
   // Feed the current battery voltage (the battery voltage of the FONA lipo and the battery voltage
-  // of the arduino lipo combined) into a LPF every 7.5 seconds.
+  // of the arduino lipo combined) into a LPF every 7.5 seconds and look the filtered voltage up on
+  // the LiPo discharge curve.
   if (last_batt_update == 0 || millis() - last_batt_update >= 7500) {
     int fona_batt_voltage = fona_shield.GetBatteryVoltage();
 
-    // If readVcc > 4.3V (4300mV), that means the USB cable is plugged in and we should read the
+    // If Vcc > 4.3V (4300mV), that means the USB cable is plugged in and we should read the
     // Arduino lipo voltage from A0. The -400 at the end is a fudge factor because the ADC on the
     // Arduino has an inherent bias. When the Arduino is running of the lipo the battery voltage
     // is just Vcc. We can't measure the lipo voltage accurately from A0 because the reference
     // voltage isn't constant when running of the battery (the battery is draining).
-    int arduino_batt_voltage = (readVcc() >= 4300) ? ((analogRead(A0)/1023.0*5.0)*1000)-400 : readVcc();
+    int arduino_batt_voltage = (vcc >= 4300) ? (adc_sampler.GetRaw(ADC_CHANNEL_A0)*5000L)/1023-400 : vcc;
     if (fona_batt_voltage != -1) {
-      int total_batt_voltage = fona_batt_voltage + arduino_batt_voltage;
-      int instantaneous_total_batt_voltage = ((total_batt_voltage-7400)/(float)(8400-7400))*100;
-      if (get_curr_lpf_val() == 0) seed_lpf(instantaneous_total_batt_voltage);
-      add_val_to_lpf(instantaneous_total_batt_voltage);
-      batt_percentage = get_curr_lpf_val();
+      // Only the FONA lipo powers the radio. Its sample is compensated before it goes into the
+      // filter, so the filtered voltage doesn't step when the radio goes quiet or busy.
+      fona_batt_voltage = CompensateBatteryMVForLoad(fona_batt_voltage, fona_shield.IsRadioActive());
+      batt_voltage_lpf.Add(fona_batt_voltage + arduino_batt_voltage);
+      // The curve is for a single cell, so look up the average of the two lipos.
+      batt_percentage = BatteryCellMVToPercentage(batt_voltage_lpf.Get() / 2);
     }
     last_batt_update = millis();
   }
 
+  read_serial_commands();
+
   // Poke the FSM if the the USB cable has been plugged in or unplugged.
-  if (readVcc() >= 4300 && !usb_cabled_plugged_in) {
+  if (vcc >= 4300 && !usb_cabled_plugged_in) {
     usb_cabled_plugged_in = true;
     buzzer_fsm.USBCablePluggedIn();
   }
-  if (readVcc() < 4300 && usb_cabled_plugged_in) {
+  if (vcc < 4300 && usb_cabled_plugged_in) {
     usb_cabled_plugged_in = false;
     buzzer_fsm.USBCableUnplugged();
   }
 
   // Poke the FSM if the cell reception gets low. Might not result in a state transition if the FSM
-  // isn't in IDLE or HEARTBEAT
-  int rssi_val = fona_shield.GetRSSIVal();
-  if (rssi_val != -1 && rssi_val < LOW_SIGNAL_THRESHOLD) buzzer_fsm.LowCellReception();
+  // isn't in IDLE or HEARTBEAT. The FONA is only sampled every so often (less often while it is
+  // asleep), so this doesn't keep it awake.
+  fona_shield.SampleLink(link_monitor.SampleMaxAge(fona_shield.PowerState() != MODEM_ACTIVE));
+  if (link_monitor.IsLow()) buzzer_fsm.LowCellReception();
 
-  // Record the start time of a button press.
-  if (digitalRead(BUTTON_PIN) == BUTTON_LOGIC_HIGH && button_press_start == 0) button_press_start = millis();
+  // Record the start time of a button press. The button is read once per loop.
+  bool is_button_down = ThisBoard::Button::IsActive();
+  if (is_button_down && button_press_start == 0) button_press_start = millis();
 
   // If a button press duration is longer than 5 seconds (5000 ms), poke the FSM.
   if (button_press_start != 0) {
@@ -198,7 +334,7 @@ void loop() {
   }
 
   // If it was a short button press and the button has now been released, poke the FSM.
-  if (digitalRead(BUTTON_PIN) == BUTTON_LOGIC_LOW && button_press_start != 0) {
+  if (!is_button_down && button_press_start != 0) {
     unsigned long button_press_duration = get_button_press_duration(button_press_start);
     if (button_press_duration > 0 && button_press_duration < 5000) {
       DEBUG_PRINTLN_FLASH("Short button press registered.");
@@ -0,0 +1,164 @@
+/*
+  File:
+  energy_model.cpp
+
+  Description:
+  Host-side (Linux) energy model for the Buzzer. Uses per-component current estimates and the
+  fraction of time each component spends in each of its power states to work out the average
+  current drawn from each lipo in a given FSM mode, then reports the projected battery life.
+
+  The Arduino (plus OLED and motor) and the FONA run off separate lipos, so the projected life of
+  a mode is whichever of the two runs out first.
+
+  The cadences follow the firmware: IDLE naps IDLE_NAP_MS per iteration with the FONA in
+  MODEM_SLEEP and turns the radio off (MODEM_MIN_FUNC) after IDLE_RADIO_OFF_MS. HEARTBEAT naps
+  between heartbeats that come HEARTBEAT_MIN_INTERVAL to HEARTBEAT_MAX_INTERVAL apart. While the
+  FONA sleeps, loop() only wakes it for a link sample or a battery reading every
+  ASLEEP_STATUS_MAX_AGE. The "delay loop", "busy loop", "AT+CSQ loop" and "b2b" rows are how those
+  states used to run.
+
+  Build and run:
+    g++ -O2 -o energy_model tools/energy_model.cpp
+    ./energy_model [arduino_lipo_mAh] [fona_lipo_mAh]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Default lipo capacities in mAh.
+#define DEFAULT_ARDUINO_LIPO_MAH 1200.0
+#define DEFAULT_FONA_LIPO_MAH 1200.0
+
+// Current estimates in mA. These come from datasheets (ATmega32U4, SSD1306, SIM800) and are meant
+// to be replaced with bench measurements as they become available.
+#define MCU_ACTIVE_MA 9.0        // 8MHz, 3.3V, busy-waiting in delay()/serial reads.
+#define MCU_POWER_DOWN_MA 0.01   // Power-down with only the watchdog running.
+#define BOARD_OVERHEAD_MA 1.1    // Regulator quiescent current plus the power LED. Always on.
+#define OLED_ON_MA 8.0           // A few lines of text at default contrast.
+#define OLED_DIM_MA 4.0          // Same text at contrast 0.
+#define OLED_BLANK_MA 2.0        // Cleared but the panel/charge pump is still on.
+#define OLED_OFF_MA 0.01         // SSD1306_DISPLAYOFF.
+#define FONA_REGISTERED_MA 20.0  // Registered on the network, serial awake, no data.
+#define FONA_GPRS_MA 100.0       // Averaged over an HTTP transaction.
+#define FONA_MODEM_SLEEP_MA 1.5  // MODEM_SLEEP: registered, GPRS kept, AT+CSCLK=2 sleep.
+#define FONA_MIN_FUNC_MA 0.8     // MODEM_MIN_FUNC: AT+CFUN=0 plus AT+CSCLK=2 sleep.
+
+// How long the Arduino is awake per wakeup in SLEEP after power management, i.e. one loop()
+// iteration. Vcc comes from the ADCSampler cache so there is no ADC settle time in here.
+#define SLEEP_AWAKE_MS_PER_WAKEUP 2.0
+#define SLEEP_NAP_MS 1000.0
+
+// What one loop() iteration costs without talking to the FONA (the OLED, the ADC cache, USB
+// serial). The same estimate fleet_sim uses.
+#define LOOP_AWAKE_MS 20.0
+
+// IDLE used to read AT+CSQ (500ms) every iteration. Now it naps IDLE_NAP_MS (PowerManager.h)
+// between iterations and turns the radio off after IDLE_RADIO_OFF_MS (BuzzerFSMCallbacks.h).
+#define OLD_IDLE_AWAKE_MS_PER_ITERATION 520.0
+#define IDLE_NAP_MS 500.0
+
+// A sleeping FONA is only asked for a link sample and a battery reading every
+// ASLEEP_STATUS_MAX_AGE (FonaShield.h). The serial wakeup costs 100ms, AT+CSQ and AT+CBC wait
+// 500ms for the reply to end, AT+CREG? and AT+CGREG? 100ms each. The radio is off in
+// MODEM_MIN_FUNC, so only the battery is read there.
+#define STATUS_PERIOD_MS 60000.0
+#define LINK_SAMPLE_MS 800.0
+#define BATT_READING_MS 600.0
+
+// HEARTBEAT naps HEARTBEAT_NAP_MS (PowerManager.h) at a time between heartbeats, which come
+// HEARTBEAT_MIN_INTERVAL to HEARTBEAT_MAX_INTERVAL apart (HeartbeatCadence.h). One heartbeat wakes
+// the FONA from MODEM_SLEEP and sends the POST, usually answered with a 304.
+#define HEARTBEAT_NAP_MS 1000.0
+#define HEARTBEAT_MIN_INTERVAL_MS 5000.0
+#define HEARTBEAT_MAX_INTERVAL_MS 60000.0
+#define HEARTBEAT_REQUEST_MS 2500.0
+
+// Average current (mA) drawn from each lipo in one mode.
+struct Mode {
+  const char *name;
+  double arduino_lipo_ma;
+  double fona_lipo_ma;
+};
+
+/*
+ * Average current of something that is in state a for fraction_a of the time and in state b the
+ * rest of the time.
+*/
+
+static double duty_cycle(double fraction_a, double ma_a, double ma_b) {
+  return fraction_a * ma_a + (1.0 - fraction_a) * ma_b;
+}
+
+/*
+ * IDLE once the screen has been dimmed.
+ *
+ * @input whether the radio has been turned off (MODEM_MIN_FUNC) rather than asleep (MODEM_SLEEP).
+*/
+
+static Mode idle_mode(const char *name, bool is_radio_off) {
+  double status_ms = is_radio_off ? BATT_READING_MS : LINK_SAMPLE_MS + BATT_READING_MS;
+  double status_fraction = status_ms / STATUS_PERIOD_MS;
+  double awake_fraction = LOOP_AWAKE_MS / (LOOP_AWAKE_MS + IDLE_NAP_MS) + status_fraction;
+  Mode mode = {name,
+               BOARD_OVERHEAD_MA + duty_cycle(awake_fraction, MCU_ACTIVE_MA, MCU_POWER_DOWN_MA) + OLED_DIM_MA,
+               duty_cycle(status_fraction, FONA_REGISTERED_MA, is_radio_off ? FONA_MIN_FUNC_MA : FONA_MODEM_SLEEP_MA)};
+  return mode;
+}
+
+/*
+ * HEARTBEAT with the party screen up.
+ *
+ * @input the time (in ms) between the end of one heartbeat and the start of the next.
+*/
+
+static Mode heartbeat_mode(const char *name, double interval_ms) {
+  double cycle_ms = HEARTBEAT_REQUEST_MS + interval_ms;
+  double request_fraction = HEARTBEAT_REQUEST_MS / cycle_ms;
+  double status_fraction = (LINK_SAMPLE_MS + BATT_READING_MS) / STATUS_PERIOD_MS;
+  double nap_awake_fraction = (interval_ms / cycle_ms) * LOOP_AWAKE_MS / (LOOP_AWAKE_MS + HEARTBEAT_NAP_MS);
+  double awake_fraction = request_fraction + status_fraction + nap_awake_fraction;
+  double fona_sleep_fraction = 1.0 - request_fraction - status_fraction;
+  Mode mode = {name,
+               BOARD_OVERHEAD_MA + duty_cycle(awake_fraction, MCU_ACTIVE_MA, MCU_POWER_DOWN_MA) + OLED_ON_MA,
+               request_fraction * FONA_GPRS_MA + status_fraction * FONA_REGISTERED_MA +
+               fona_sleep_fraction * FONA_MODEM_SLEEP_MA};
+  return mode;
+}
+
+int main(int argc, char **argv) {
+  double arduino_lipo_mah = (argc > 1) ? atof(argv[1]) : DEFAULT_ARDUINO_LIPO_MAH;
+  double fona_lipo_mah = (argc > 2) ? atof(argv[2]) : DEFAULT_FONA_LIPO_MAH;
+
+  double sleep_awake_fraction = SLEEP_AWAKE_MS_PER_WAKEUP / (SLEEP_AWAKE_MS_PER_WAKEUP + SLEEP_NAP_MS);
+  double old_idle_awake_fraction = OLD_IDLE_AWAKE_MS_PER_ITERATION / (OLD_IDLE_AWAKE_MS_PER_ITERATION + IDLE_NAP_MS);
+
+  Mode modes[] = {
+    // SLEEP used to be a delay(500) loop with the OLED cleared and the FONA still registered.
+    {"SLEEP (delay loop)", BOARD_OVERHEAD_MA + MCU_ACTIVE_MA + OLED_BLANK_MA, FONA_REGISTERED_MA},
+    {"SLEEP (power-down)",
+     BOARD_OVERHEAD_MA + duty_cycle(sleep_awake_fraction, MCU_ACTIVE_MA, MCU_POWER_DOWN_MA) + OLED_OFF_MA,
+     FONA_MIN_FUNC_MA},
+    // IDLE after the screen has been dimmed.
+    {"IDLE (busy loop)", BOARD_OVERHEAD_MA + MCU_ACTIVE_MA + OLED_DIM_MA, FONA_REGISTERED_MA},
+    {"IDLE (AT+CSQ loop)",
+     BOARD_OVERHEAD_MA + duty_cycle(old_idle_awake_fraction, MCU_ACTIVE_MA, MCU_POWER_DOWN_MA) + OLED_DIM_MA,
+     FONA_REGISTERED_MA},
+    idle_mode("IDLE (radio asleep)", false),
+    idle_mode("IDLE (radio off)", true),
+    // HEARTBEAT used to poll back to back, with the FONA in an HTTP transaction nearly all the time.
+    {"HEARTBEAT (b2b)", BOARD_OVERHEAD_MA + MCU_ACTIVE_MA + OLED_ON_MA, FONA_GPRS_MA},
+    heartbeat_mode("HEARTBEAT (5 s)", HEARTBEAT_MIN_INTERVAL_MS),
+    heartbeat_mode("HEARTBEAT (60 s)", HEARTBEAT_MAX_INTERVAL_MS),
+  };
+
+  printf("Arduino lipo: %.0f mAh, FONA lipo: %.0f mAh\n\n", arduino_lipo_mah, fona_lipo_mah);
+  printf("%-20s %12s %12s %12s %12s\n", "mode", "arduino mA", "fona mA", "life (h)", "life (days)");
+  for (unsigned int i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+    double arduino_life = arduino_lipo_mah / modes[i].arduino_lipo_ma;
+    double fona_life = fona_lipo_mah / modes[i].fona_lipo_ma;
+    double life = (arduino_life < fona_life) ? arduino_life : fona_life;
+    printf("%-20s %12.2f %12.2f %12.1f %12.2f\n", modes[i].name, modes[i].arduino_lipo_ma,
+           modes[i].fona_lipo_ma, life, life / 24.0);
+  }
+  return 0;
+}
@@ -0,0 +1,265 @@
+/*
+  File:
+  firmware_host.cpp
+
+  Description:
+  Host side of one copy of the firmware: the Arduino core functions the shim headers declare,
+  plus simulated Display, OLED, PowerManager, ADCSampler, Haptics, StackMonitor and Watchdog.
+  These replace the parts of the firmware that drive hardware; everything else (buzzer.ino, the
+  FSM, the callbacks, the request bodies, the EEPROM record stores) is the real code. FonaShield is
+  simulated in fona_host.cpp for fleet_sim, tools/serial_replay uses the real one. See
+  firmware_host.h.
+*/
+
+#include <Arduino.h>
+#include "Globals.h"
+#include "Pins.h"
+#include "Board.h"
+#include "firmware_host.h"
+
+// What one loop() iteration costs on top of its waits (the OLED, the ADC, USB serial). Virtual time
+// has to move even when nothing in the iteration waits, e.g. IDLE before the screen is dimmed.
+#define SIM_LOOP_MS 20
+
+const SimHooks *sim_hooks;
+static unsigned long now_ms = 0;
+static bool is_reset_requested = false;
+
+uint8_t *sim_eeprom;
+HardwareSerial Serial;
+const DevType Adafruit128x64 = {};
+const uint8_t Adafruit5x7[] = {0};
+
+unsigned long millis() {
+  return now_ms;
+}
+
+void delay(unsigned long ms) {
+  now_ms += ms;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t val) {}
+
+int digitalRead(uint8_t pin) {
+  return LOW;
+}
+
+// The I/O registers behind Board.h. The button's PIN bit follows the simulator's button and
+// pulling ArduinoRst low resets the Buzzer.
+
+static uint8_t io_regs[0x40];
+
+SimIOReg::operator uint8_t() const {
+  typedef ThisBoard::Button Button;
+  if (addr == Button::PIN_ADDR) {
+    bool is_high = sim_hooks->button(sim_hooks->ctx, now_ms) != Button::IS_ACTIVE_LOW;
+    io_regs[addr] = is_high ? (io_regs[addr] | Button::MASK) : (io_regs[addr] & ~Button::MASK);
+  }
+  return io_regs[addr];
+}
+
+SimIOReg &SimIOReg::operator=(uint8_t val) {
+  typedef ThisBoard::ArduinoRst ArduinoRst;
+  if (addr == ArduinoRst::PORT_ADDR && (io_regs[addr] & ArduinoRst::MASK) && !(val & ArduinoRst::MASK)) {
+    is_reset_requested = true;
+  }
+  io_regs[addr] = val;
+  return *this;
+}
+
+void analogWrite(uint8_t pin, int val) {
+  if (pin == BUZZER_PIN) sim_hooks->motor(sim_hooks->ctx, now_ms, val != 0);
+}
+
+char *itoa(int val, char *buf, int radix) {
+  sprintf(buf, "%d", val);
+  return buf;
+}
+
+char *utoa(unsigned int val, char *buf, int radix) {
+  sprintf(buf, "%u", val);
+  return buf;
+}
+
+char *ltoa(long val, char *buf, int radix) {
+  sprintf(buf, "%ld", val);
+  return buf;
+}
+
+size_t Print::print(const char *str) {
+  size_t n = 0;
+  while (*str) n += write(*str++);
+  return n;
+}
+
+size_t Print::print(const __FlashStringHelper *str) { return print((const char *) str); }
+size_t Print::print(char c) { return write(c); }
+size_t Print::print(int val) { return print((long) val); }
+size_t Print::print(unsigned int val) { return print((unsigned long) val); }
+
+size_t Print::print(long val) {
+  char buf[24];
+  sprintf(buf, "%ld", val);
+  return print(buf);
+}
+
+size_t Print::print(unsigned long val) {
+  char buf[24];
+  sprintf(buf, "%lu", val);
+  return print(buf);
+}
+
+size_t Print::println() { return print("\r\n"); }
+size_t Print::println(const char *str) { return print(str) + println(); }
+size_t Print::println(const __FlashStringHelper *str) { return print(str) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(int val) { return print(val) + println(); }
+size_t Print::println(unsigned int val) { return print(val) + println(); }
+size_t Print::println(long val) { return print(val) + println(); }
+size_t Print::println(unsigned long val) { return print(val) + println(); }
+
+int HardwareSerial::available() { return 0; }
+int HardwareSerial::read() { return -1; }
+
+size_t HardwareSerial::write(uint8_t c) {
+  if (sim_hooks->serial != NULL) sim_hooks->serial(sim_hooks->ctx, c);
+  return 1;
+}
+
+// Nothing is drawn.
+
+Display::Display(SSD1306Ascii *oled) : _oled(oled) {}
+void Display::SetScreen(const ScreenRow *screen) {}
+void Display::SetField(unsigned char field, const char *text) {}
+void Display::SetField(unsigned char field, FlashStrPtr text) {}
+void Display::ShowMessage(FlashStrPtr message) {}
+void Display::Clear() {}
+
+void SSD1306AsciiAsyncI2c::begin(const DevType *dev, uint8_t i2c_addr) {}
+void SSD1306AsciiAsyncI2c::reset(uint8_t rst) {}
+void SSD1306AsciiAsyncI2c::flush() {}
+bool SSD1306AsciiAsyncI2c::isBusy() { return false; }
+void SSD1306AsciiAsyncI2c::writeDisplay(uint8_t b, uint8_t mode) {}
+
+// Powering down just lets virtual time pass. A button press doesn't cut the nap short, which
+// costs at most IDLE_NAP_MS of reaction time.
+
+PowerManager::PowerManager(int wake_pin) : _wake_pin(wake_pin) {}
+
+unsigned long PowerManager::PowerDown(unsigned long duration) {
+  delay(duration);
+  return duration;
+}
+
+void ADCSampler::begin() {}
+unsigned int ADCSampler::GetRaw(unsigned char channel) { return 0; }
+long ADCSampler::GetVcc() { return 3900; }
+
+// Patterns play in virtual time. The motor is on from the start of a pattern until it is stopped,
+// which is all the simulator looks at, and IsPlaying() holds until the steps add up (or until
+// Stop() for a looping pattern).
+
+static unsigned long haptics_end = 0;
+
+Haptics::Haptics(unsigned char motor_pin) : _motor_pin(motor_pin) {}
+void Haptics::begin() {}
+void Haptics::handleTick() {}
+
+void Haptics::Play(const HapticStep *pattern, bool is_looping) {
+  _is_looping = is_looping;
+  unsigned long duration = 0;
+  for (const HapticStep *step = pattern; step->ticks != 0; step++) duration += step->ticks * HAPTIC_TICK_MS;
+  haptics_end = now_ms + duration;
+  analogWrite(_motor_pin, 255);
+}
+
+void Haptics::Stop() {
+  _is_looping = false;
+  haptics_end = now_ms;
+  analogWrite(_motor_pin, 0);
+}
+
+bool Haptics::IsPlaying() {
+  return _is_looping || (long) (haptics_end - now_ms) > 0;
+}
+
+bool Haptics::IsLooping() {
+  return _is_looping;
+}
+
+// The host stack says nothing about the AVR's, so nothing is measured.
+
+void StackMonitor::Begin() {}
+unsigned char StackMonitor::Attribute(unsigned char slot) {
+  unsigned char prev_slot = _slot;
+  _slot = slot;
+  return prev_slot;
+}
+void StackMonitor::Clear() {}
+void StackMonitor::Print() {}
+
+// Nothing hangs in virtual time and a reset loads a fresh copy of the firmware, so there is never
+// a crash to recover from.
+
+void Watchdog::begin() { memset(&_last_crash, 0, sizeof(_last_crash)); }
+void Watchdog::handleTimeout() {}
+void Watchdog::Kick() {}
+void Watchdog::RecordCrash(unsigned char reason) {}
+const CrashRecord *Watchdog::LastCrash() { return &_last_crash; }
+void Watchdog::ClearCrashCount() {}
+void Watchdog::PrintLastCrash() {}
+void Watchdog::WakeAfter(unsigned char wdto) {}
+bool Watchdog::HasWoken() { return false; }
+void Watchdog::Resume() {}
+
+// Entry points for fleet_sim.
+
+// Defined in buzzer.ino.
+void setup();
+void loop();
+
+extern "C" {
+
+void fw_begin(const SimHooks *hooks) {
+  sim_hooks = hooks;
+  sim_eeprom = hooks->eeprom;
+}
+
+void fw_setup() {
+  setup();
+}
+
+void fw_loop() {
+  loop();
+  delay(SIM_LOOP_MS);
+}
+
+unsigned long fw_millis() {
+  return now_ms;
+}
+
+bool fw_is_reset() {
+  return is_reset_requested;
+}
+
+const char *fw_buzzer_name() {
+  return eeprom_data.buzzer_name;
+}
+
+int fw_party_id() {
+  return eeprom_data.curr_party_id;
+}
+
+bool fw_is_low_cell() {
+  return buzzer_fsm.CurrentStateId() == LOW_CELL_RECEPTION;
+}
+
+bool fw_is_booting() {
+  int state_id = buzzer_fsm.CurrentStateId();
+  return state_id == INIT || state_id == INIT_FONA || state_id == WAIT_NETWORK || state_id == INIT_GPRS ||
+         state_id == RESUME_FONA || state_id == CHECK_BUZZER_REGISTRATION;
+}
+
+}
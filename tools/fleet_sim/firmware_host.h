@@ -0,0 +1,67 @@
+/*
+  File:
+  firmware_host.h
+
+  Description:
+  Interface between fleet_sim and one loaded copy of the firmware (libbuzzer_fw.so). Each copy has
+  its own globals and its own virtual clock, which only moves forward when the firmware waits
+  (delay(), PowerManager::PowerDown(), talking to the FONA). Everything the firmware does to the
+  outside world goes through the hooks.
+*/
+
+#ifndef FIRMWARE_HOST_H
+#define FIRMWARE_HOST_H
+
+#include <stdint.h>
+
+// Size of the ATmega32U4 EEPROM.
+#define SIM_EEPROM_LEN 1024
+
+// NUM_MODEM_POWER_STATES in FonaShield.h: off, radio off, asleep, active.
+#define SIM_MODEM_POWER_STATES 4
+
+// What AT+CSQ reads: usually SIM_RSSI, but one sample in SIM_RSSI_DROP_ONE_IN is a noisy
+// SIM_RSSI_DROP.
+#define SIM_RSSI 20
+#define SIM_RSSI_DROP 2
+#define SIM_RSSI_DROP_ONE_IN 8
+// What AT+CSQ reads (RSSI and BER) until the FONA has registered with the network.
+#define SIM_CSQ_UNKNOWN 99
+
+struct SimHooks {
+  // Passed back to every hook.
+  void *ctx;
+  // SIM_EEPROM_LEN bytes owned by the simulator, so they survive a reset.
+  uint8_t *eeprom;
+  // Does one HTTP request. Returns the HTTP status (or -1 if the request failed altogether), fills
+  // in the reply body and how long (in ms) the FONA was busy with the request.
+  int (*http)(void *ctx, unsigned long now, const char *url, const char *body, char *reply,
+              int reply_len, unsigned long *elapsed);
+  // The vibration motor was turned on or off.
+  void (*motor)(void *ctx, unsigned long now, bool is_on);
+  // Whether the button is held down.
+  bool (*button)(void *ctx, unsigned long now);
+  // A char the firmware wrote to USB serial. Can be NULL.
+  void (*serial)(void *ctx, char c);
+};
+
+// Inside the firmware: the hooks fw_begin() was given.
+extern const SimHooks *sim_hooks;
+
+// The functions libbuzzer_fw.so exports. Looked up with dlsym.
+extern "C" {
+  typedef void (*fw_begin_func)(const SimHooks *hooks);
+  typedef void (*fw_step_func)();
+  typedef unsigned long (*fw_millis_func)();
+  typedef bool (*fw_is_reset_func)();
+  typedef const char *(*fw_buzzer_name_func)();
+  typedef int (*fw_party_id_func)();
+  // true until the FSM is through the boot states (INIT up to CHECK_BUZZER_REGISTRATION).
+  typedef bool (*fw_is_booting_func)();
+  // true while the FSM is in LOW_CELL_RECEPTION.
+  typedef bool (*fw_is_low_cell_func)();
+  // Time (in ms) the FONA has spent in one of modem_power_states (see FonaShield.h) so far.
+  typedef unsigned long (*fw_modem_ms_func)(unsigned char power_state);
+}
+
+#endif
@@ -0,0 +1,539 @@
+/*
+  File:
+  fleet_sim.cpp
+
+  Description:
+  Host-side (Linux) fleet load simulator. Runs N Buzzers, each one a separately loaded copy of the
+  real firmware (libbuzzer_fw.so: buzzer.ino, BuzzerFSM, the callbacks, the EEPROM record stores,
+  with the hardware drivers swapped for firmware_host.cpp), against the in-process mock buzzer_api
+  backend (../mock_buzzer_api.h), all in virtual time.
+
+  A host stand model drives the fleet: parties arrive at random, the host presses the button of an
+  idle Buzzer to hand one out, the party's table gets ready somewhere around the quoted wait, the
+  host buzzes it and seats it a minute later. Optionally the backend goes down for a while, and
+  optionally the whole fleet is power cycled once (e.g. taken off the charger in the morning).
+
+  Reports the request rate per Buzzer, time-to-buzz percentiles (table ready to motor on), how long
+  a Buzzer keeps buzzing after its party is seated, and how the fleet behaves around the outage
+  (retry storm peak, FATAL_ERROR resets, time to settle), which is what sizing the backend and
+  tuning HeartbeatCadence need. Also reports how long named Buzzers take from boot to the end of
+  the boot states (IDLE or HEARTBEAT), for cold boots (the power cycle) and for resets, how the
+  FONAs' time splits between their power states, and how often a noisy signal sample (see
+  SIM_RSSI_DROP_ONE_IN) sends a Buzzer to LOW_CELL_RECEPTION.
+
+  Build and run:
+    make -C tools/fleet_sim
+    tools/fleet_sim/fleet_sim [-n buzzers] [-m minutes] [-a arrivals_per_hour] [-o outage_start_min]
+                              [-d outage_min] [-l latency_ms] [-p power_cycle_min] [-s seed]
+                              [-v buzzer_to_echo]
+*/
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "firmware_host.h"
+#include "../mock_buzzer_api.h"
+
+#define DEFAULT_NUM_BUZZERS 20
+#define DEFAULT_MINUTES 180
+#define DEFAULT_ARRIVALS_PER_HOUR 30
+#define DEFAULT_OUTAGE_START_MIN 90
+#define DEFAULT_OUTAGE_MIN 5
+#define DEFAULT_LATENCY_MS 300
+// No power cycle.
+#define DEFAULT_POWER_CYCLE_MIN -1
+#define MAX_BUZZERS 256
+
+// Boots are spread over this long so the fleet doesn't start in lockstep.
+#define BOOT_STAGGER_MS 60000
+// How long an Arduino reset takes before setup() runs again (Caterina bootloader).
+#define RESET_MS 1000
+// How long the FONA takes to give up on a request to a backend that is down.
+#define FAILED_REQUEST_MS 10000
+// The host holds the button this long (a short press) and leaves a Buzzer alone for a while after.
+#define BUTTON_PRESS_MS 1500
+#define BUTTON_RETRY_MS 30000
+// Quoted waits are picked between these (minutes). The table is actually ready somewhere between
+// 70% and 120% of the quote.
+#define MIN_QUOTED_WAIT 10
+#define MAX_QUOTED_WAIT 40
+// How long after the buzz the party is seated.
+#define SEAT_DELAY_MS 60000
+// Rates are reported in bins of this many ms, and baselines skip the first WARMUP_MS.
+#define BIN_MS 10000
+#define WARMUP_MS (10 * 60000UL)
+
+struct Buzzer {
+  int index;
+  char so_path[PATH_MAX];
+  void *handle;
+  fw_begin_func fw_begin;
+  fw_step_func fw_setup;
+  fw_step_func fw_loop;
+  fw_millis_func fw_millis;
+  fw_is_reset_func fw_is_reset;
+  fw_buzzer_name_func fw_buzzer_name;
+  fw_party_id_func fw_party_id;
+  fw_is_booting_func fw_is_booting;
+  fw_modem_ms_func fw_modem_ms;
+  fw_is_low_cell_func fw_is_low_cell;
+  SimHooks hooks;
+  uint8_t eeprom[SIM_EEPROM_LEN];
+  // Virtual time the loaded copy of the firmware booted at. Its millis() counts from here.
+  unsigned long boot_at;
+  bool is_set_up;
+  // Whether the current boot is timed (the Buzzer had a name) and whether it is a cold one.
+  bool is_boot_timed;
+  bool is_cold_boot;
+  // When this Buzzer gets power cycled, 0 if it doesn't (anymore).
+  unsigned long power_cycle_at;
+  unsigned long button_until;
+  unsigned long last_press;
+  int num_resets;
+  // Whether the FSM was in LOW_CELL_RECEPTION after the last step, and how often it went there.
+  bool is_low_cell;
+  int num_low_cell;
+  // Party whose buzz the motor is on for, 0 if none.
+  int buzzing_party;
+};
+
+// What the host stand knows about each party, indexed by party ID.
+struct PartyTimes {
+  unsigned long ready_at;
+  unsigned long buzz_at;
+  bool is_buzzed;
+  bool is_motor_seen;
+  // 0 until the party is seated.
+  unsigned long seated_at;
+};
+
+static Buzzer buzzers[MAX_BUZZERS];
+static int num_buzzers = DEFAULT_NUM_BUZZERS;
+static PartyTimes party_times[MAX_PARTIES + 1];
+static unsigned long outage_start = 0;
+static unsigned long outage_end = 0;
+static int latency_ms = DEFAULT_LATENCY_MS;
+static int echo_buzzer = -1;
+
+// Stats.
+static const char *endpoint_names[] = {"get_new_buzzer_name", "is_buzzer_registered",
+                                       "get_available_party", "accept_party", "claim_party",
+                                       "heartbeat"};
+#define NUM_ENDPOINTS (sizeof(endpoint_names) / sizeof(endpoint_names[0]))
+static unsigned long endpoint_requests[NUM_ENDPOINTS];
+static unsigned long endpoint_failures[NUM_ENDPOINTS];
+// Requests the API answered with "e":true, e.g. an accept_party for a party another Buzzer got first.
+static unsigned long endpoint_rejections[NUM_ENDPOINTS];
+static unsigned long num_not_modified = 0;
+static std::vector<unsigned long> request_bins;
+static std::vector<double> times_to_buzz;
+static std::vector<double> times_to_stop;
+static std::vector<double> cold_boot_times;
+// Fleet wide time (in ms) the FONAs spent in each power state, from the copies unloaded so far.
+static unsigned long long modem_ms[SIM_MODEM_POWER_STATES];
+static std::vector<double> reset_boot_times;
+
+/*
+ * @return a uniformly distributed double in [0, 1).
+*/
+
+static double rand_unit() {
+  return rand() / (RAND_MAX + 1.0);
+}
+
+/*
+ * @input a Buzzer.
+ * @input a time on the Buzzer's millis() clock.
+ * @return the same time on the simulator's clock.
+*/
+
+static unsigned long global_time(Buzzer *buzzer, unsigned long local_ms) {
+  return buzzer->boot_at + local_ms;
+}
+
+/*
+ * HTTP hook. Sends the request to the mock backend unless it is down.
+*/
+
+static int http_hook(void *ctx, unsigned long now, const char *url, const char *body, char *reply,
+                     int reply_len, unsigned long *elapsed) {
+  Buzzer *buzzer = (Buzzer *) ctx;
+  unsigned long t = global_time(buzzer, now);
+  const char *path = strstr(url, "/buzzer_api/");
+  if (path == NULL) path = url;
+  unsigned int endpoint = 0;
+  while (endpoint < NUM_ENDPOINTS && strcmp(path + strlen("/buzzer_api/"), endpoint_names[endpoint]) != 0) endpoint++;
+  if (endpoint < NUM_ENDPOINTS) endpoint_requests[endpoint]++;
+  if (t / BIN_MS >= request_bins.size()) request_bins.resize(t / BIN_MS + 1);
+  request_bins[t / BIN_MS]++;
+  if (t >= outage_start && t < outage_end) {
+    if (endpoint < NUM_ENDPOINTS) endpoint_failures[endpoint]++;
+    *elapsed = FONA_HTTP_OVERHEAD_MS + FAILED_REQUEST_MS;
+    return -1;
+  }
+  char mock_reply[MAX_REPLY_LEN] = "";
+  int status = handle_request(path, body, mock_reply);
+  snprintf(reply, reply_len, "%s", mock_reply);
+  *elapsed = FONA_HTTP_OVERHEAD_MS + latency_ms;
+  if (endpoint < NUM_ENDPOINTS && strstr(mock_reply, "\"e\":true") != NULL) endpoint_rejections[endpoint]++;
+  if (status == 304) {
+    *elapsed -= FONA_HTTP_BODY_READ_MS;
+    num_not_modified++;
+  }
+  return status;
+}
+
+/*
+ * Motor hook. The first time the motor of a Buzzer comes on after its party was buzzed is when
+ * the guests notice. The first time it goes off after the party was seated is when the Buzzer
+ * noticed the seating.
+*/
+
+static void motor_hook(void *ctx, unsigned long now, bool is_on) {
+  Buzzer *buzzer = (Buzzer *) ctx;
+  if (!is_on) {
+    if (buzzer->buzzing_party == 0 || party_times[buzzer->buzzing_party].seated_at == 0) return;
+    times_to_stop.push_back((global_time(buzzer, now) - party_times[buzzer->buzzing_party].seated_at) / 1000.0);
+    buzzer->buzzing_party = 0;
+    return;
+  }
+  Party *party = find_buzzer_party(buzzer->fw_buzzer_name());
+  if (party == NULL || !party_times[party->id].is_buzzed || party_times[party->id].is_motor_seen) return;
+  party_times[party->id].is_motor_seen = true;
+  buzzer->buzzing_party = party->id;
+  times_to_buzz.push_back((global_time(buzzer, now) - party_times[party->id].buzz_at) / 1000.0);
+}
+
+static bool button_hook(void *ctx, unsigned long now) {
+  Buzzer *buzzer = (Buzzer *) ctx;
+  return global_time(buzzer, now) < buzzer->button_until;
+}
+
+static void serial_hook(void *ctx, char c) {
+  Buzzer *buzzer = (Buzzer *) ctx;
+  if (buzzer->index == echo_buzzer) putchar(c);
+}
+
+/*
+ * Unloads a Buzzer's copy of the firmware, keeping its FONA power state times.
+ *
+ * @input the Buzzer.
+*/
+
+static void unload_firmware(Buzzer *buzzer) {
+  for (unsigned char i = 0; i < SIM_MODEM_POWER_STATES; i++) modem_ms[i] += buzzer->fw_modem_ms(i);
+  dlclose(buzzer->handle);
+  buzzer->handle = NULL;
+}
+
+/*
+ * Loads a fresh copy of the firmware for a Buzzer, i.e. powers it up or resets it. The EEPROM is
+ * kept.
+ *
+ * @input the Buzzer.
+ * @input the virtual time it boots at.
+ * @input true for a power up, false for a reset.
+*/
+
+static void load_firmware(Buzzer *buzzer, unsigned long boot_at, bool is_cold_boot) {
+  if (buzzer->handle != NULL) unload_firmware(buzzer);
+  buzzer->handle = dlopen(buzzer->so_path, RTLD_NOW | RTLD_LOCAL);
+  if (buzzer->handle == NULL) {
+    fprintf(stderr, "%s\n", dlerror());
+    exit(1);
+  }
+  buzzer->fw_begin = (fw_begin_func) dlsym(buzzer->handle, "fw_begin");
+  buzzer->fw_setup = (fw_step_func) dlsym(buzzer->handle, "fw_setup");
+  buzzer->fw_loop = (fw_step_func) dlsym(buzzer->handle, "fw_loop");
+  buzzer->fw_millis = (fw_millis_func) dlsym(buzzer->handle, "fw_millis");
+  buzzer->fw_is_reset = (fw_is_reset_func) dlsym(buzzer->handle, "fw_is_reset");
+  buzzer->fw_buzzer_name = (fw_buzzer_name_func) dlsym(buzzer->handle, "fw_buzzer_name");
+  buzzer->fw_party_id = (fw_party_id_func) dlsym(buzzer->handle, "fw_party_id");
+  buzzer->fw_is_booting = (fw_is_booting_func) dlsym(buzzer->handle, "fw_is_booting");
+  buzzer->fw_modem_ms = (fw_modem_ms_func) dlsym(buzzer->handle, "fw_modem_ms");
+  buzzer->fw_is_low_cell = (fw_is_low_cell_func) dlsym(buzzer->handle, "fw_is_low_cell");
+  buzzer->hooks = {buzzer, buzzer->eeprom, http_hook, motor_hook, button_hook, serial_hook};
+  buzzer->fw_begin(&buzzer->hooks);
+  buzzer->boot_at = boot_at;
+  buzzer->is_set_up = false;
+  buzzer->is_cold_boot = is_cold_boot;
+}
+
+/*
+ * Copies libbuzzer_fw.so once per Buzzer. dlopen only loads a file once, so each Buzzer needs its
+ * own file to get its own globals.
+ *
+ * @input the path of libbuzzer_fw.so.
+ * @input a directory to put the copies in.
+*/
+
+static void copy_firmware(const char *lib_path, const char *dir) {
+  FILE *src = fopen(lib_path, "rb");
+  if (src == NULL) {
+    perror(lib_path);
+    exit(1);
+  }
+  std::vector<char> lib;
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), src)) > 0) lib.insert(lib.end(), buf, buf + n);
+  fclose(src);
+  for (int i = 0; i < num_buzzers; i++) {
+    snprintf(buzzers[i].so_path, sizeof(buzzers[i].so_path), "%s/buzzer_%d.so", dir, i);
+    FILE *dst = fopen(buzzers[i].so_path, "wb");
+    fwrite(lib.data(), 1, lib.size(), dst);
+    fclose(dst);
+  }
+}
+
+/*
+ * Host stand work due by the given time: new parties, tables getting ready, seating, and handing
+ * out Buzzers.
+ *
+ * @input the current virtual time.
+ * @input when the next party arrives, advanced as parties arrive.
+ * @input mean time between arrivals in ms.
+*/
+
+static void run_host_stand(unsigned long now, unsigned long *next_arrival, double mean_arrival_ms) {
+  char body[MAX_REPLY_LEN], reply[MAX_REPLY_LEN];
+  while (*next_arrival <= now && num_parties < MAX_PARTIES) {
+    int quoted = MIN_QUOTED_WAIT + rand() % (MAX_QUOTED_WAIT - MIN_QUOTED_WAIT + 1);
+    snprintf(body, sizeof(body), "{\"n\":\"Party %d\",\"t\":%d}", num_parties + 1, quoted);
+    handle_request("/mock/add_party", body, reply);
+    long id = 0;
+    json_get_long(reply, "id", &id);
+    party_times[id].ready_at = *next_arrival + (unsigned long) (quoted * 60000.0 * (0.7 + 0.5 * rand_unit()));
+    *next_arrival += (unsigned long) (-log(1.0 - rand_unit()) * mean_arrival_ms);
+  }
+  bool is_party_waiting = false;
+  for (int i = 0; i < num_parties; i++) {
+    Party *party = &parties[i];
+    if (party->is_seated) continue;
+    PartyTimes *times = &party_times[party->id];
+    snprintf(body, sizeof(body), "{\"id\":%d}", party->id);
+    if (!times->is_buzzed && times->ready_at <= now) {
+      times->is_buzzed = true;
+      times->buzz_at = times->ready_at;
+      handle_request("/mock/buzz", body, reply);
+    } else if (times->is_buzzed && times->buzz_at + SEAT_DELAY_MS <= now) {
+      handle_request("/mock/seat", body, reply);
+      times->seated_at = now;
+    }
+    if (!party->is_seated && party->buzzer_name[0] == '\0') is_party_waiting = true;
+  }
+  if (!is_party_waiting) return;
+  // Hands out the Buzzer that has been left alone the longest.
+  Buzzer *idle = NULL;
+  for (int i = 0; i < num_buzzers; i++) {
+    Buzzer *buzzer = &buzzers[i];
+    if (!buzzer->is_set_up || buzzer->fw_buzzer_name()[0] == '\0' || buzzer->fw_party_id() != -1) continue;
+    if (buzzer->last_press != 0 && now - buzzer->last_press < BUTTON_RETRY_MS) continue;
+    if (idle == NULL || buzzer->last_press < idle->last_press) idle = buzzer;
+  }
+  if (idle == NULL) return;
+  idle->button_until = now + BUTTON_PRESS_MS;
+  idle->last_press = now;
+}
+
+/*
+ * @input a sorted list.
+ * @input a percentile in [0, 100].
+ * @return the value at that percentile, 0 if the list is empty.
+*/
+
+static double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t i = (size_t) (p / 100.0 * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+/*
+ * @input the first and one past the last BIN_MS bin.
+ * @return the mean request rate (requests/s) over those bins.
+*/
+
+static double mean_rate(size_t first_bin, size_t end_bin) {
+  end_bin = std::min(end_bin, request_bins.size());
+  if (first_bin >= end_bin) return 0;
+  unsigned long total = 0;
+  for (size_t i = first_bin; i < end_bin; i++) total += request_bins[i];
+  return total / ((end_bin - first_bin) * (BIN_MS / 1000.0));
+}
+
+static void print_report(unsigned long duration) {
+  unsigned long total_requests = 0;
+  printf("\n%-22s %10s %10s %10s\n", "endpoint", "requests", "failed", "rejected");
+  for (unsigned int i = 0; i < NUM_ENDPOINTS; i++) {
+    printf("%-22s %10lu %10lu %10lu\n", endpoint_names[i], endpoint_requests[i], endpoint_failures[i],
+           endpoint_rejections[i]);
+    total_requests += endpoint_requests[i];
+  }
+  printf("heartbeats answered with 304: %lu\n", num_not_modified);
+  double duration_s = duration / 1000.0;
+  printf("\nrequests/s: %.3f fleet, %.4f per buzzer\n", total_requests / duration_s,
+         total_requests / duration_s / num_buzzers);
+
+  std::sort(times_to_buzz.begin(), times_to_buzz.end());
+  int num_buzzed = 0, num_handed_out = 0;
+  for (int i = 0; i < num_parties; i++) {
+    if (parties[i].buzzer_name[0] != '\0') num_handed_out++;
+    if (party_times[parties[i].id].is_buzzed) num_buzzed++;
+  }
+  printf("\nparties: %d arrived, %d got a buzzer, %d tables ready, %zu buzzes noticed\n", num_parties,
+         num_handed_out, num_buzzed, times_to_buzz.size());
+  printf("time-to-buzz (s): p50 %.1f, p99 %.1f, max %.1f\n", percentile(times_to_buzz, 50),
+         percentile(times_to_buzz, 99), times_to_buzz.empty() ? 0 : times_to_buzz.back());
+  std::sort(times_to_stop.begin(), times_to_stop.end());
+  printf("seated to motor off (s): p50 %.1f, p99 %.1f, max %.1f\n", percentile(times_to_stop, 50),
+         percentile(times_to_stop, 99), times_to_stop.empty() ? 0 : times_to_stop.back());
+  std::sort(cold_boot_times.begin(), cold_boot_times.end());
+  std::sort(reset_boot_times.begin(), reset_boot_times.end());
+  printf("boot to IDLE (s): cold p50 %.1f, max %.1f (%zu boots); reset p50 %.1f, max %.1f (%zu boots)\n",
+         percentile(cold_boot_times, 50), cold_boot_times.empty() ? 0 : cold_boot_times.back(),
+         cold_boot_times.size(), percentile(reset_boot_times, 50),
+         reset_boot_times.empty() ? 0 : reset_boot_times.back(), reset_boot_times.size());
+  unsigned long long total_modem_ms = 0;
+  for (int i = 0; i < SIM_MODEM_POWER_STATES; i++) total_modem_ms += modem_ms[i];
+  if (total_modem_ms == 0) total_modem_ms = 1;
+  printf("FONA time (%%): active %.1f, asleep %.1f, radio off %.1f, off %.1f\n",
+         100.0 * modem_ms[3] / total_modem_ms, 100.0 * modem_ms[2] / total_modem_ms,
+         100.0 * modem_ms[1] / total_modem_ms, 100.0 * modem_ms[0] / total_modem_ms);
+
+  int num_resets = 0, num_low_cell = 0;
+  for (int i = 0; i < num_buzzers; i++) {
+    num_resets += buzzers[i].num_resets;
+    num_low_cell += buzzers[i].num_low_cell;
+  }
+  printf("\nFATAL_ERROR resets: %d\n", num_resets);
+  printf("LOW_CELL_RECEPTION entries: %d (one AT+CSQ in %d reads %d)\n", num_low_cell,
+         SIM_RSSI_DROP_ONE_IN, SIM_RSSI_DROP);
+  // No outage, or it would have started after the run.
+  if (outage_end <= outage_start || outage_start >= duration) return;
+  size_t start_bin = outage_start / BIN_MS, end_bin = outage_end / BIN_MS;
+  double baseline = mean_rate(WARMUP_MS / BIN_MS, start_bin);
+  double peak = 0;
+  size_t peak_bin = end_bin;
+  for (size_t i = start_bin; i < request_bins.size() && i < end_bin + 60; i++) {
+    double rate = request_bins[i] / (BIN_MS / 1000.0);
+    if (rate > peak) {
+      peak = rate;
+      peak_bin = i;
+    }
+  }
+  printf("outage %.1f-%.1f min: baseline %.3f req/s, %.3f req/s during, peak %.3f req/s (%.1fx) at "
+         "%.1f min\n", outage_start / 60000.0, outage_end / 60000.0, baseline,
+         mean_rate(start_bin, end_bin), peak, baseline > 0 ? peak / baseline : 0, peak_bin * BIN_MS / 60000.0);
+  // Settled once a minute long window after the outage is back within 20% of the baseline.
+  for (size_t i = end_bin; i + 6 <= request_bins.size(); i++) {
+    if (mean_rate(i, i + 6) <= baseline * 1.2) {
+      printf("back within 20%% of baseline %.1f s after the backend came back\n",
+             (i * BIN_MS - (double) outage_end) / 1000.0);
+      return;
+    }
+  }
+  printf("never settled back to the baseline\n");
+}
+
+int main(int argc, char **argv) {
+  int minutes = DEFAULT_MINUTES;
+  double arrivals_per_hour = DEFAULT_ARRIVALS_PER_HOUR;
+  double outage_start_min = DEFAULT_OUTAGE_START_MIN, outage_min = DEFAULT_OUTAGE_MIN;
+  double power_cycle_min = DEFAULT_POWER_CYCLE_MIN;
+  unsigned int seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:m:a:o:d:l:p:s:v:h")) != -1) {
+    switch (opt) {
+      case 'n': num_buzzers = std::min(atoi(optarg), MAX_BUZZERS); break;
+      case 'm': minutes = atoi(optarg); break;
+      case 'a': arrivals_per_hour = atof(optarg); break;
+      case 'o': outage_start_min = atof(optarg); break;
+      case 'd': outage_min = atof(optarg); break;
+      case 'l': latency_ms = atoi(optarg); break;
+      case 'p': power_cycle_min = atof(optarg); break;
+      case 's': seed = atoi(optarg); break;
+      case 'v': echo_buzzer = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-n buzzers] [-m minutes] [-a arrivals_per_hour] [-o outage_start_min]\n"
+                        "       [-d outage_min] [-l latency_ms] [-p power_cycle_min] [-s seed]\n"
+                        "       [-v buzzer_to_echo]\n", argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  srand(seed);
+  outage_start = (unsigned long) (outage_start_min * 60000);
+  outage_end = outage_start + (unsigned long) (outage_min * 60000);
+
+  // libbuzzer_fw.so is built next to this binary.
+  char lib_path[PATH_MAX];
+  ssize_t len = readlink("/proc/self/exe", lib_path, sizeof(lib_path) - 1);
+  if (len < 0) return 1;
+  lib_path[len] = '\0';
+  strcpy(strrchr(lib_path, '/') + 1, "libbuzzer_fw.so");
+  char dir[] = "/tmp/fleet_sim_XXXXXX";
+  if (mkdtemp(dir) == NULL) return 1;
+  copy_firmware(lib_path, dir);
+
+  for (int i = 0; i < num_buzzers; i++) {
+    buzzers[i].index = i;
+    // A blank EEPROM, so every Buzzer gets a name and registers first.
+    memset(buzzers[i].eeprom, 0xFF, SIM_EEPROM_LEN);
+    load_firmware(&buzzers[i], rand() % BOOT_STAGGER_MS, true);
+    // Power cycles are spread out like the first boots.
+    if (power_cycle_min >= 0) buzzers[i].power_cycle_at = (unsigned long) (power_cycle_min * 60000) + rand() % BOOT_STAGGER_MS;
+  }
+  printf("%d buzzers, %d min, %.1f parties/h, %d ms server latency, outage at %.1f min for %.1f min\n",
+         num_buzzers, minutes, arrivals_per_hour, latency_ms, outage_start_min, outage_min);
+
+  unsigned long duration = minutes * 60000UL;
+  double mean_arrival_ms = 3600000.0 / arrivals_per_hour;
+  unsigned long next_arrival = WARMUP_MS / 2;
+  while (true) {
+    // Always runs the Buzzer that is furthest behind, so the fleet moves through time together.
+    Buzzer *next = &buzzers[0];
+    for (int i = 1; i < num_buzzers; i++) {
+      if (global_time(&buzzers[i], buzzers[i].fw_millis()) < global_time(next, next->fw_millis())) next = &buzzers[i];
+    }
+    unsigned long now = global_time(next, next->fw_millis());
+    if (now >= duration) break;
+    run_host_stand(now, &next_arrival, mean_arrival_ms);
+    if (next->power_cycle_at != 0 && now >= next->power_cycle_at) {
+      next->power_cycle_at = 0;
+      load_firmware(next, now, true);
+      continue;
+    }
+    if (!next->is_set_up) {
+      next->fw_setup();
+      next->is_set_up = true;
+      next->is_boot_timed = next->fw_buzzer_name()[0] != '\0';
+    } else {
+      next->fw_loop();
+    }
+    if (next->is_boot_timed && !next->fw_is_booting()) {
+      next->is_boot_timed = false;
+      double boot_time = (global_time(next, next->fw_millis()) - next->boot_at) / 1000.0;
+      (next->is_cold_boot ? cold_boot_times : reset_boot_times).push_back(boot_time);
+    }
+    bool is_low_cell = next->fw_is_low_cell();
+    if (is_low_cell && !next->is_low_cell) next->num_low_cell++;
+    next->is_low_cell = is_low_cell;
+    if (next->fw_is_reset()) {
+      next->num_resets++;
+      load_firmware(next, global_time(next, next->fw_millis()) + RESET_MS, false);
+    }
+  }
+  for (int i = 0; i < num_buzzers; i++) {
+    unload_firmware(&buzzers[i]);
+    unlink(buzzers[i].so_path);
+  }
+  print_report(duration);
+
+  rmdir(dir);
+  return 0;
+}
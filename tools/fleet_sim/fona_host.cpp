@@ -0,0 +1,241 @@
+/*
+  File:
+  fona_host.cpp
+
+  Description:
+  Simulated FonaShield for fleet_sim. Talks to the simulator instead of a FONA: requests go to the
+  http hook and every AT command exchange just takes its time on the virtual clock. Kept apart from
+  firmware_host.cpp so tools/serial_replay can link the real FonaShield against the same host
+  stand-ins instead.
+*/
+
+#include <Arduino.h>
+#include "Globals.h"
+#include "firmware_host.h"
+
+// Time (in ms) the FONA spends on the AT commands around one HTTP request, in the same spirit as
+// FONA_HTTP_OVERHEAD_MS in mock_buzzer_api.h. The simulator adds the server's share.
+#define SIM_RSSI_MS 500
+#define SIM_BATTERY_MS 100
+#define SIM_AT_MS 100
+#define SIM_ENABLE_GPRS_MS 4000
+#define SIM_RESUME_SHIELD_MS 300
+// A failed enableGPRS(): AT+CIPSHUT and AT+SAPBR=0,1 go through, AT+CGATT=1 doesn't.
+#define SIM_GPRS_FAIL_MS 1500
+// The FONA boot after a reset: the reset pulse, until it answers AT, and until it has registered
+// with the network after that.
+#define SIM_FONA_RESET_MS 200
+#define SIM_FONA_BOOT_MS 3000
+#define SIM_NETWORK_REG_MS 6000
+// How often retryATCommand() sends AT (reply timeout plus the delay between tries).
+#define SIM_AT_RETRY_MS 600
+// The throw away AT and the delay that wake up a sleeping serial line, and AT+CFUN=0 / AT+CFUN=1.
+#define SIM_WAKE_SERIAL_MS 200
+#define SIM_CFUN_MS 1000
+
+// FonaShield, talking to the simulator instead of a FONA. The FONA boots and registers with the
+// network in the background after a reset. Until the firmware resets it, it is taken to be up and
+// registered already (it isn't reset along with the Arduino).
+
+static unsigned long fona_ready_at = 0;
+static unsigned long fona_registered_at = 0;
+
+// Time (in ms) spent in each modem power state, up to modem_state_since for the current one.
+static unsigned long modem_ms[NUM_MODEM_POWER_STATES];
+static unsigned long modem_state_since = 0;
+
+// Moves the FONA to a power state and books the time spent in the one it leaves.
+static void enterModemState(unsigned char *power_state, unsigned char new_state) {
+  modem_ms[*power_state] += millis() - modem_state_since;
+  modem_state_since = millis();
+  *power_state = new_state;
+}
+
+FonaShield::FonaShield(SoftwareSerial *fona_serial) : _fona_serial(fona_serial) {}
+
+void FonaShield::StartReset() {
+  delay(SIM_FONA_RESET_MS);
+  fona_ready_at = millis() + SIM_FONA_BOOT_MS;
+  fona_registered_at = fona_ready_at + SIM_NETWORK_REG_MS;
+  _is_reset_started = true;
+  enterModemState(&_power_state, MODEM_OFF);
+  _link_sample_time = 0;
+  link_monitor.Reset();
+  _batt_mv = -1;
+}
+
+bool FonaShield::initShield() {
+  if (!_is_reset_started) StartReset();
+  _is_reset_started = false;
+  while (millis() < fona_ready_at) delay(SIM_AT_RETRY_MS);
+  // AT and ATE0.
+  delay(2 * SIM_AT_MS);
+  _is_gprs_up = false;
+  enterModemState(&_power_state, MODEM_ACTIVE);
+  _idle_power_state = MODEM_ACTIVE;
+  return true;
+}
+
+bool FonaShield::IsRegistered() {
+  delay(SIM_AT_MS);
+  return millis() >= fona_registered_at;
+}
+
+bool FonaShield::enableGPRS() {
+  if (millis() < fona_registered_at) {
+    delay(SIM_GPRS_FAIL_MS);
+    return false;
+  }
+  delay(SIM_ENABLE_GPRS_MS);
+  _is_gprs_up = true;
+  return true;
+}
+
+// The FONA isn't reset along with the Arduino, so its GPRS connection is still up.
+bool FonaShield::resumeShield() {
+  delay(SIM_WAKE_SERIAL_MS + SIM_RESUME_SHIELD_MS);
+  _is_gprs_up = true;
+  enterModemState(&_power_state, MODEM_ACTIVE);
+  _idle_power_state = MODEM_ACTIVE;
+  return true;
+}
+
+bool FonaShield::IsGPRSUp() { return _is_gprs_up; }
+
+// Same transitions as the firmware, see FonaShield.cpp.
+
+bool FonaShield::SetPowerState(unsigned char power_state) {
+  if (power_state == MODEM_OFF) return false;
+  _idle_power_state = power_state;
+  return changePowerState(power_state);
+}
+
+unsigned char FonaShield::PowerState() { return _power_state; }
+
+void FonaShield::PrintPowerState() {}
+
+bool FonaShield::changePowerState(unsigned char power_state) {
+  if (power_state == _power_state) return true;
+  if (_power_state == MODEM_OFF) return false;
+  if (power_state > _power_state) {
+    unsigned char from = _power_state;
+    unsigned long start_time = millis();
+    if (from == MODEM_MIN_FUNC) {
+      if (!wakeShield()) return false;
+    } else {
+      wakeSerial();
+      // AT+CSCLK=0.
+      delay(SIM_AT_MS);
+      enterModemState(&_power_state, MODEM_ACTIVE);
+    }
+    _resume_ms[from] = millis() - start_time;
+  }
+  if (power_state == MODEM_SLEEP) {
+    // AT+CSCLK=2.
+    if (_power_state == MODEM_ACTIVE) delay(SIM_AT_MS);
+    enterModemState(&_power_state, MODEM_SLEEP);
+  } else if (power_state == MODEM_MIN_FUNC) {
+    wakeSerial();
+    if (!sleepShield()) return false;
+  }
+  return true;
+}
+
+// AT+CFUN=0 and AT+CSCLK=2.
+bool FonaShield::sleepShield() {
+  delay(SIM_CFUN_MS + SIM_AT_MS);
+  _is_gprs_up = false;
+  enterModemState(&_power_state, MODEM_MIN_FUNC);
+  return true;
+}
+
+// AT, AT+CSCLK=0 and AT+CFUN=1, then the FONA registers with the network again before GPRS can
+// come up.
+bool FonaShield::wakeShield() {
+  wakeSerial();
+  delay(2 * SIM_AT_MS + SIM_CFUN_MS);
+  enterModemState(&_power_state, MODEM_ACTIVE);
+  fona_registered_at = millis() + SIM_NETWORK_REG_MS;
+  while (!IsRegistered()) delay(500);
+  int num_tries = 0;
+  while (num_tries < MAX_RETRIES && !enableGPRS()) {
+    delay(1000);
+    num_tries++;
+  }
+  return num_tries < MAX_RETRIES;
+}
+
+void FonaShield::wakeSerial() {
+  if (_power_state != MODEM_ACTIVE) delay(SIM_WAKE_SERIAL_MS);
+}
+
+int FonaShield::HTTPGETJSON(const char *url_base, FlashStrPtr url_path, JsonExtractor *reply) {
+  return HTTPPOSTJSON(url_base, url_path, NULL, 0, reply);
+}
+
+int FonaShield::HTTPPOSTJSON(const char *url_base, FlashStrPtr url_path, char *post_data_buffer,
+                             int post_data_buffer_len, JsonExtractor *reply) {
+  if (!changePowerState(MODEM_ACTIVE)) return ERROR;
+  char url[128];
+  snprintf(url, sizeof(url), "%s%s", url_base, (const char *) url_path);
+  char body[BUF_LENGTH_LARGE * 2];
+  unsigned long elapsed = 0;
+  int status = sim_hooks->http(sim_hooks->ctx, millis(), url, post_data_buffer ? post_data_buffer : "",
+                               body, sizeof(body), &elapsed);
+  delay(elapsed);
+  link_monitor.AddRequest(status != -1, elapsed);
+  _last_http_time = millis();
+  _is_not_modified = status == 304;
+  if (!_is_not_modified && status == 200) reply->Feed(body, strlen(body));
+  // HTTPFail() after AT+HTTPTERM.
+  changePowerState(_idle_power_state);
+  return (_is_not_modified || status == 200) ? SUCCESS : ERROR;
+}
+
+int FonaShield::GetBatteryVoltage() {
+  if (_power_state == MODEM_OFF) return -1;
+  if (_power_state != MODEM_ACTIVE && _batt_mv != -1 && millis() - _batt_time < ASLEEP_STATUS_MAX_AGE) return _batt_mv;
+  wakeSerial();
+  delay(SIM_BATTERY_MS);
+  _batt_mv = 3900;
+  _batt_time = millis();
+  return _batt_mv;
+}
+
+// A good signal, except that one AT+CSQ in SIM_RSSI_DROP_ONE_IN reads SIM_RSSI_DROP. Its own
+// generator, so the simulator's rand() sequence doesn't depend on how often the firmware samples.
+static unsigned long rssi_noise = 1;
+
+bool FonaShield::SampleLink(unsigned long max_age) {
+  if (_power_state < MODEM_SLEEP) return false;
+  if (_link_sample_time != 0 && millis() - _link_sample_time < max_age) return true;
+  wakeSerial();
+  // AT+CSQ, AT+CREG? and AT+CGREG?.
+  delay(SIM_RSSI_MS + 2 * SIM_AT_MS);
+  bool is_registered = millis() >= fona_registered_at;
+  rssi_noise = rssi_noise * 1103515245 + 12345;
+  if (!is_registered) link_monitor.AddSignal(SIM_CSQ_UNKNOWN, SIM_CSQ_UNKNOWN);
+  else link_monitor.AddSignal(((rssi_noise >> 16) % SIM_RSSI_DROP_ONE_IN == 0) ? SIM_RSSI_DROP : SIM_RSSI, 0);
+  link_monitor.SetRegistration(is_registered, is_registered);
+  _link_sample_time = millis();
+  return true;
+}
+
+unsigned long FonaShield::LinkSampleAge() {
+  return millis() - _link_sample_time;
+}
+
+bool FonaShield::IsRadioActive() {
+  return _last_http_time != 0 && millis() - _last_http_time < RADIO_ACTIVE_WINDOW;
+}
+
+bool FonaShield::WasNotModified() { return _is_not_modified; }
+FlashStrPtr FonaShield::LastATCommand() { return _last_at_command; }
+
+// Entry point for fleet_sim, see firmware_host.h.
+
+extern "C" unsigned long fw_modem_ms(unsigned char power_state) {
+  unsigned long ms = modem_ms[power_state];
+  if (power_state == fona_shield.PowerState()) ms += millis() - modem_state_since;
+  return ms;
+}
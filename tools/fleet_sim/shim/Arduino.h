@@ -0,0 +1,87 @@
+/*
+  File:
+  Arduino.h
+
+  Description:
+  Host stand-in for the parts of the Arduino core the firmware uses, so the real FSM, callbacks and
+  EEPROM code can be compiled into fleet_sim. Time, pins and serial are implemented in
+  firmware_host.cpp on top of the simulator's virtual clock.
+*/
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "avr/pgmspace.h"
+#include "avr/io.h"
+#include "avr/interrupt.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define LED_BUILTIN 13
+#define A0 18
+
+// Flash strings are ordinary strings on the host.
+class __FlashStringHelper;
+#define F(str) ((const __FlashStringHelper *) (str))
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+unsigned long millis();
+void delay(unsigned long ms);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+
+char *itoa(int val, char *buf, int radix);
+char *utoa(unsigned int val, char *buf, int radix);
+char *ltoa(long val, char *buf, int radix);
+
+class Print {
+  public:
+    virtual size_t write(uint8_t c) = 0;
+    size_t print(const char *str);
+    size_t print(const __FlashStringHelper *str);
+    size_t print(char c);
+    size_t print(int val);
+    size_t print(unsigned int val);
+    size_t print(long val);
+    size_t print(unsigned long val);
+    size_t println();
+    size_t println(const char *str);
+    size_t println(const __FlashStringHelper *str);
+    size_t println(char c);
+    size_t println(int val);
+    size_t println(unsigned int val);
+    size_t println(long val);
+    size_t println(unsigned long val);
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+};
+
+class HardwareSerial : public Stream {
+  public:
+    void begin(unsigned long baud) {}
+    int available();
+    int read();
+    size_t write(uint8_t c);
+};
+
+extern HardwareSerial Serial;
+
+#endif
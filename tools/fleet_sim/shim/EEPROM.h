@@ -0,0 +1,37 @@
+/*
+  File:
+  EEPROM.h
+
+  Description:
+  Host stand-in for the Arduino EEPROM library. The bytes belong to the simulator so they survive
+  the firmware being reloaded on a reset.
+*/
+
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+#include "avr/io.h"
+
+// E2END + 1 bytes, set up by fw_begin().
+extern uint8_t *sim_eeprom;
+
+struct EEPROMClass {
+  uint8_t read(int addr) { return sim_eeprom[addr]; }
+  void write(int addr, uint8_t val) { sim_eeprom[addr] = val; }
+  void update(int addr, uint8_t val) { sim_eeprom[addr] = val; }
+  uint16_t length() { return E2END + 1; }
+  template <typename T> T &get(int addr, T &t) {
+    memcpy(&t, sim_eeprom + addr, sizeof(T));
+    return t;
+  }
+  template <typename T> const T &put(int addr, const T &t) {
+    memcpy(sim_eeprom + addr, &t, sizeof(T));
+    return t;
+  }
+};
+
+static EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,39 @@
+/*
+  File:
+  SSD1306Ascii.h
+
+  Description:
+  Host stand-in for the SSD1306Ascii library. Nothing is drawn.
+*/
+
+#ifndef SSD1306ASCII_H
+#define SSD1306ASCII_H
+
+#include <Arduino.h>
+
+#define SSD1306_SETCONTRAST 0x81
+#define SSD1306_DISPLAYOFF 0xAE
+#define SSD1306_DISPLAYON 0xAF
+#define SSD1306_SEGREMAP 0xA0
+#define SSD1306_COMSCANINC 0xC0
+
+struct DevType {};
+extern const DevType Adafruit128x64;
+extern const uint8_t Adafruit5x7[];
+
+class SSD1306Ascii : public Print {
+  public:
+    void clear() {}
+    void set1X() {}
+    void set2X() {}
+    void setCursor(uint8_t col, uint8_t row) {}
+    void setContrast(uint8_t value) {}
+    void setFont(const uint8_t *font) {}
+    void ssd1306WriteCmd(uint8_t c) {}
+    size_t write(uint8_t c) { return 1; }
+  protected:
+    void init(const DevType *dev) {}
+    virtual void writeDisplay(uint8_t b, uint8_t mode) = 0;
+};
+
+#endif
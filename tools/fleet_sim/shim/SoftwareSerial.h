@@ -0,0 +1,23 @@
+/*
+  File:
+  SoftwareSerial.h
+
+  Description:
+  Host stand-in for SoftwareSerial. The simulated FonaShield never touches the port.
+*/
+
+#ifndef SOFTWARESERIAL_H
+#define SOFTWARESERIAL_H
+
+#include <Arduino.h>
+
+class SoftwareSerial : public Stream {
+  public:
+    SoftwareSerial(uint8_t rx_pin, uint8_t tx_pin) {}
+    void begin(long baud) {}
+    int available() { return 0; }
+    int read() { return -1; }
+    size_t write(uint8_t c) { return 1; }
+};
+
+#endif
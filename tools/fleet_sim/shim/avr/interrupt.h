@@ -0,0 +1,15 @@
+/*
+  File:
+  interrupt.h
+
+  Description:
+  Host stand-in for avr/interrupt.h. The simulated firmware has no interrupts.
+*/
+
+#ifndef INTERRUPT_H
+#define INTERRUPT_H
+
+#define cli()
+#define sei()
+
+#endif
@@ -0,0 +1,29 @@
+/*
+  File:
+  io.h
+
+  Description:
+  Host stand-in for avr/io.h. Only the ATmega32U4 facts the simulated firmware needs.
+*/
+
+#ifndef IO_H
+#define IO_H
+
+#include <stdint.h>
+
+#define E2END 0x3FF
+#define _BV(bit) (1 << (bit))
+
+// An I/O register the firmware accesses directly (see Board.h). Reads and writes go through
+// firmware_host.cpp, which connects the pins to the simulator.
+struct SimIOReg {
+  uint8_t addr;
+  operator uint8_t() const;
+  SimIOReg &operator=(uint8_t val);
+  SimIOReg &operator|=(uint8_t val) { return *this = (uint8_t) (*this | val); }
+  SimIOReg &operator&=(uint8_t val) { return *this = (uint8_t) (*this & val); }
+};
+
+#define _SFR_IO8(io_addr) (SimIOReg{(uint8_t) (io_addr)})
+
+#endif
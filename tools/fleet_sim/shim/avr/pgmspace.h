@@ -0,0 +1,27 @@
+/*
+  File:
+  pgmspace.h
+
+  Description:
+  Host stand-in for avr/pgmspace.h. There is only one address space, so PROGMEM data is read
+  directly.
+*/
+
+#ifndef PGMSPACE_H
+#define PGMSPACE_H
+
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(str) (str)
+#define pgm_read_byte(addr) (*(addr))
+#define pgm_read_word(addr) (*(addr))
+#define strcpy_P strcpy
+#define strcat_P strcat
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strlen_P strlen
+#define strstr_P strstr
+#define memcpy_P memcpy
+
+#endif
@@ -0,0 +1,20 @@
+/*
+  File:
+  crc16.h
+
+  Description:
+  Host stand-in for util/crc16.h, same polynomial (0xA001) as avr-libc.
+*/
+
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <stdint.h>
+
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a) {
+  crc ^= a;
+  for (int i = 0; i < 8; i++) crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  return crc;
+}
+
+#endif
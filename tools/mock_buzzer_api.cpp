@@ -0,0 +1,229 @@
+/*
+  File:
+  mock_buzzer_api.cpp
+
+  Description:
+  Host-side (Linux) mock of the buzzer_api backend. Serves the endpoints the firmware talks to
+  (get_new_buzzer_name, is_buzzer_registered, get_available_party, accept_party, claim_party and
+  heartbeat, including its 304 when the Buzzer already has the latest party state) over plain HTTP
+  from an in memory list of parties, so request/reply changes can be tried out without the real
+  backend. A few /mock/ endpoints stand in for the host stand: adding a
+  party, buzzing it and seating it.
+
+  The bench mode starts the server, hands out parties with both the two call flow
+  (get_available_party then accept_party) and the single claim_party call (CLAIM_PARTY_MODE in
+  BuzzerFSMCallbacks.h) and reports how long a hand out takes with each, adding the fixed cost of
+  one FONA HTTP transaction per call.
+
+  The backend itself lives in mock_buzzer_api.h.
+
+  Build and run:
+    g++ -O2 -o mock_buzzer_api tools/mock_buzzer_api.cpp
+    ./mock_buzzer_api serve [port] [latency_ms]
+    ./mock_buzzer_api bench [port] [latency_ms] [num_parties]
+*/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mock_buzzer_api.h"
+
+#define DEFAULT_PORT 8080
+// Extra time the server takes to answer each request, standing in for the real backend's
+// database work and the round trip over GPRS.
+#define DEFAULT_LATENCY_MS 300
+#define DEFAULT_BENCH_PARTIES 20
+
+#define MAX_REQUEST_LEN 2048
+
+static int latency_ms = DEFAULT_LATENCY_MS;
+
+/*
+ * @return the wall clock time in ms.
+*/
+
+static double now_ms() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+/*
+ * Reads one HTTP request off a connection and answers it.
+ *
+ * @input the connected socket.
+*/
+
+static void serve_connection(int fd) {
+  char request[MAX_REQUEST_LEN+1];
+  int len = 0;
+  char *body = NULL;
+  long content_len = 0;
+  while (len < MAX_REQUEST_LEN) {
+    int n = read(fd, request + len, MAX_REQUEST_LEN - len);
+    if (n <= 0) break;
+    len += n;
+    request[len] = '\0';
+    if (body == NULL) {
+      char *headers_end = strstr(request, "\r\n\r\n");
+      if (headers_end == NULL) continue;
+      body = headers_end + 4;
+      char *content_len_header = strcasestr(request, "Content-Length:");
+      if (content_len_header != NULL && content_len_header < body) content_len = atol(content_len_header + 15);
+    }
+    if (request + len - body >= content_len) break;
+  }
+  request[len] = '\0';
+  char path[128] = "";
+  sscanf(request, "%*s %127s", path);
+  char reply[MAX_REPLY_LEN] = "";
+  int status = handle_request(path, body ? body : "", reply);
+  usleep(latency_ms * 1000);
+  char response[MAX_REPLY_LEN + 128];
+  if (status == 304) {
+    len = snprintf(response, sizeof(response), "HTTP/1.0 304 Not Modified\r\n\r\n");
+  } else if (status == 404) {
+    len = snprintf(response, sizeof(response), "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+  } else {
+    len = snprintf(response, sizeof(response), "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\n"
+                   "Content-Length: %zu\r\n\r\n%s", strlen(reply), reply);
+  }
+  if (write(fd, response, len) != len) perror("write");
+  close(fd);
+}
+
+/*
+ * Answers requests one at a time until killed. The backend state lives in this process.
+ *
+ * @input the port to listen on.
+*/
+
+static void serve(int port) {
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listen_fd, 64) < 0) {
+    perror("bind/listen");
+    exit(1);
+  }
+  fprintf(stderr, "mock buzzer_api on http://127.0.0.1:%d, %d ms latency\n", port, latency_ms);
+  while (true) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd >= 0) serve_connection(fd);
+  }
+}
+
+/*
+ * POSTs a JSON body to the mock and reads the reply body.
+ *
+ * @input the port the mock listens on.
+ * @input the path to POST to.
+ * @input the JSON body.
+ * @input where to put the reply body.
+ * @input the size of the above buf.
+ * @return true if the mock answered with a 200.
+*/
+
+static bool post(int port, const char *path, const char *body, char *reply, int reply_len) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    close(fd);
+    return false;
+  }
+  char request[MAX_REQUEST_LEN];
+  int len = snprintf(request, sizeof(request), "POST %s HTTP/1.0\r\nContent-Type: application/json\r\n"
+                     "Content-Length: %zu\r\n\r\n%s", path, strlen(body), body);
+  bool is_ok = write(fd, request, len) == len;
+  char response[MAX_REPLY_LEN + 128];
+  len = 0;
+  int n;
+  while (is_ok && len < (int) sizeof(response) - 1 && (n = read(fd, response + len, sizeof(response) - 1 - len)) > 0) len += n;
+  close(fd);
+  response[len] = '\0';
+  char *reply_body = strstr(response, "\r\n\r\n");
+  if (!is_ok || strncmp(response, "HTTP/1.0 200", 12) != 0 || reply_body == NULL) return false;
+  snprintf(reply, reply_len, "%s", reply_body + 4);
+  return true;
+}
+
+/*
+ * Hands out parties with both flows and prints how long a hand out takes on average.
+ *
+ * @input the port the mock listens on.
+ * @input how many parties to hand out with each flow.
+*/
+
+static void bench(int port, int num_bench_parties) {
+  const char *flow_names[] = {"get_available_party + accept_party", "claim_party"};
+  for (int flow = 0; flow < 2; flow++) {
+    double total_ms = 0;
+    int num_calls = 0;
+    for (int i = 0; i < num_bench_parties; i++) {
+      char reply[MAX_REPLY_LEN], body[MAX_REPLY_LEN];
+      post(port, "/mock/add_party", "{\"n\":\"Bench\",\"t\":15}", reply, sizeof(reply));
+      double start = now_ms();
+      long id = 0;
+      if (flow == 0) {
+        post(port, "/buzzer_api/get_available_party", "{\"bn\":\"bench-0\"}", reply, sizeof(reply));
+        json_get_long(reply, "id", &id);
+        snprintf(body, sizeof(body), "{\"bn\":\"bench-0\",\"id\":%ld,\"k\":%d}", id, i);
+        post(port, "/buzzer_api/accept_party", body, reply, sizeof(reply));
+        num_calls += 2;
+      } else {
+        post(port, "/buzzer_api/claim_party", "{\"bn\":\"bench-1\"}", reply, sizeof(reply));
+        json_get_long(reply, "id", &id);
+        num_calls += 1;
+      }
+      total_ms += now_ms() - start;
+      // Seats the party so the next hand out gets a new one.
+      snprintf(body, sizeof(body), "{\"id\":%ld}", id);
+      post(port, "/mock/seat", body, reply, sizeof(reply));
+    }
+    double server_ms = total_ms / num_bench_parties;
+    double fona_ms = (double) num_calls / num_bench_parties * FONA_HTTP_OVERHEAD_MS;
+    printf("%-36s %6.2f calls %9.0f ms server %9.0f ms with FONA\n", flow_names[flow],
+           (double) num_calls / num_bench_parties, server_ms, server_ms + fona_ms);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || (strcmp(argv[1], "serve") != 0 && strcmp(argv[1], "bench") != 0)) {
+    fprintf(stderr, "usage: %s serve [port] [latency_ms]\n"
+                    "       %s bench [port] [latency_ms] [num_parties]\n", argv[0], argv[0]);
+    return 1;
+  }
+  int port = (argc > 2) ? atoi(argv[2]) : DEFAULT_PORT;
+  latency_ms = (argc > 3) ? atoi(argv[3]) : DEFAULT_LATENCY_MS;
+  if (strcmp(argv[1], "serve") == 0) {
+    serve(port);
+    return 0;
+  }
+  int num_bench_parties = (argc > 4) ? atoi(argv[4]) : DEFAULT_BENCH_PARTIES;
+  pid_t server_pid = fork();
+  if (server_pid == 0) serve(port);
+  // Gives the server time to start listening.
+  usleep(200 * 1000);
+  printf("%d hand outs per flow, %d ms server latency, %d ms FONA overhead per call\n\n",
+         num_bench_parties, latency_ms, FONA_HTTP_OVERHEAD_MS);
+  bench(port, num_bench_parties);
+  kill(server_pid, SIGTERM);
+  waitpid(server_pid, NULL, 0);
+  return 0;
+}
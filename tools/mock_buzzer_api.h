@@ -0,0 +1,217 @@
+/*
+  File:
+  mock_buzzer_api.h
+
+  Description:
+  In memory state and request handling of the mock buzzer_api backend. Shared by the HTTP server
+  in mock_buzzer_api.cpp and the in-process backend of fleet_sim, so both answer requests exactly
+  the same way. Header only, every function is static.
+*/
+
+#ifndef MOCK_BUZZER_API_H
+#define MOCK_BUZZER_API_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Time one FonaShield::HTTPPOSTJSON spends on the serial link apart from waiting for the server:
+// AT+HTTPINIT, two AT+HTTPPARA, AT+HTTPDATA (500ms for DOWNLOAD plus the 1000ms data window),
+// AT+HTTPACTION, at least one 1000ms AT+HTTPREAD poll, the 1000ms body read and AT+HTTPTERM.
+#define FONA_HTTP_OVERHEAD_MS 4000
+
+// Of the above, the time the body read takes. A 304 has no body to read.
+#define FONA_HTTP_BODY_READ_MS 1000
+
+// Parties are never removed, so this bounds how many parties one run can see.
+#define MAX_PARTIES 4096
+#define MAX_NAME_LEN 20
+#define MAX_REPLY_LEN 256
+
+struct Party {
+  int id;
+  char name[MAX_NAME_LEN+1];
+  int wait_time;
+  // Buzzer the party was handed to, empty if it is still waiting for one.
+  char buzzer_name[MAX_NAME_LEN+1];
+  // Idempotency key of the accept_party that took the party.
+  long accept_key;
+  bool is_buzzing;
+  bool is_seated;
+  // Bumped whenever something a heartbeat reports changes.
+  int version;
+};
+
+static Party parties[MAX_PARTIES];
+static int num_parties = 0;
+static int next_buzzer_num = 1;
+
+/*
+ * Copies the string value of a key out of a flat JSON object.
+ *
+ * @input the JSON body.
+ * @input the key.
+ * @input where to put the value.
+ * @input the size of the above buf.
+ * @return true if the key was found.
+*/
+
+static bool json_get_string(const char *body, const char *key, char *val, int val_len) {
+  char pattern[32];
+  snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+  const char *start = strstr(body, pattern);
+  if (start == NULL) return false;
+  start += strlen(pattern);
+  int len = 0;
+  while (start[len] != '\0' && start[len] != '"' && len < val_len - 1) len++;
+  memcpy(val, start, len);
+  val[len] = '\0';
+  return true;
+}
+
+/*
+ * Reads the integer value of a key out of a flat JSON object.
+ *
+ * @input the JSON body.
+ * @input the key.
+ * @input where to put the value.
+ * @return true if the key was found.
+*/
+
+static bool json_get_long(const char *body, const char *key, long *val) {
+  char pattern[32];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char *start = strstr(body, pattern);
+  if (start == NULL) return false;
+  *val = strtol(start + strlen(pattern), NULL, 10);
+  return true;
+}
+
+/*
+ * @input a party ID.
+ * @return the party, or NULL if there is no party with that ID.
+*/
+
+static Party *find_party(long id) {
+  for (int i = 0; i < num_parties; i++) {
+    if (parties[i].id == id) return &parties[i];
+  }
+  return NULL;
+}
+
+/*
+ * @input a buzzer name.
+ * @return the unseated party handed to that buzzer, or NULL if it doesn't have one.
+*/
+
+static Party *find_buzzer_party(const char *buzzer_name) {
+  for (int i = 0; i < num_parties; i++) {
+    if (!parties[i].is_seated && strcmp(parties[i].buzzer_name, buzzer_name) == 0) return &parties[i];
+  }
+  return NULL;
+}
+
+/*
+ * @return the oldest party still waiting for a buzzer, or NULL if there isn't one.
+*/
+
+static Party *find_avail_party() {
+  for (int i = 0; i < num_parties; i++) {
+    if (!parties[i].is_seated && parties[i].buzzer_name[0] == '\0') return &parties[i];
+  }
+  return NULL;
+}
+
+/*
+ * Writes the reply of get_available_party/claim_party for a party.
+ *
+ * @input the party, or NULL if there are no parties available.
+ * @input where to put the reply.
+*/
+
+static void party_reply(Party *party, char *reply) {
+  if (party == NULL) {
+    snprintf(reply, MAX_REPLY_LEN, "{\"e\":false,\"p_a\":false}");
+    return;
+  }
+  snprintf(reply, MAX_REPLY_LEN, "{\"e\":false,\"p_a\":true,\"id\":%d,\"n\":\"%s\",\"t\":%d}",
+           party->id, party->name, party->wait_time);
+}
+
+/*
+ * Works out the reply to one request.
+ *
+ * @input the path of the request.
+ * @input the JSON body of the request (empty for a GET).
+ * @input where to put the reply.
+ * @return the HTTP status of the reply.
+*/
+
+static int handle_request(const char *path, const char *body, char *reply) {
+  char buzzer_name[MAX_NAME_LEN+1] = "";
+  json_get_string(body, "bn", buzzer_name, sizeof(buzzer_name));
+  if (strcmp(path, "/buzzer_api/get_new_buzzer_name") == 0) {
+    snprintf(reply, MAX_REPLY_LEN, "{\"e\":false,\"bn\":\"mock-%d\"}", next_buzzer_num++);
+  } else if (strcmp(path, "/buzzer_api/is_buzzer_registered") == 0) {
+    snprintf(reply, MAX_REPLY_LEN, "{\"e\":false,\"i_reg\":true}");
+  } else if (strcmp(path, "/buzzer_api/get_available_party") == 0) {
+    party_reply(find_avail_party(), reply);
+  } else if (strcmp(path, "/buzzer_api/accept_party") == 0) {
+    long id = 0, key = -1;
+    json_get_long(body, "id", &id);
+    json_get_long(body, "k", &key);
+    Party *party = find_party(id);
+    bool is_ok = party != NULL && !party->is_seated;
+    if (is_ok && party->buzzer_name[0] == '\0') {
+      strcpy(party->buzzer_name, buzzer_name);
+      party->accept_key = key;
+    } else if (is_ok) {
+      // Only a resend of the accept that took the party succeeds.
+      is_ok = strcmp(party->buzzer_name, buzzer_name) == 0 && party->accept_key == key;
+    }
+    snprintf(reply, MAX_REPLY_LEN, "{\"e\":%s}", is_ok ? "false" : "true");
+  } else if (strcmp(path, "/buzzer_api/claim_party") == 0) {
+    // A buzzer that still holds a party gets it back, so retrying after a lost reply is safe.
+    Party *party = find_buzzer_party(buzzer_name);
+    if (party == NULL) {
+      party = find_avail_party();
+      if (party != NULL) strcpy(party->buzzer_name, buzzer_name);
+    }
+    party_reply(party, reply);
+  } else if (strcmp(path, "/buzzer_api/heartbeat") == 0) {
+    Party *party = find_buzzer_party(buzzer_name);
+    long version = 0;
+    json_get_long(body, "v", &version);
+    if (party != NULL && version == party->version) return 304;
+    snprintf(reply, MAX_REPLY_LEN, "{\"e\":false,\"i_a\":%s,\"b\":%s,\"v\":%d}", party ? "true" : "false",
+             (party && party->is_buzzing) ? "true" : "false", party ? party->version : 0);
+  } else if (strcmp(path, "/mock/add_party") == 0) {
+    if (num_parties == MAX_PARTIES) {
+      snprintf(reply, MAX_REPLY_LEN, "{\"e\":true,\"e_msg\":\"full\"}");
+      return 200;
+    }
+    Party *party = &parties[num_parties];
+    memset(party, 0, sizeof(Party));
+    party->id = (num_parties == 0) ? 1 : parties[num_parties - 1].id + 1;
+    if (!json_get_string(body, "n", party->name, sizeof(party->name))) strcpy(party->name, "Party");
+    long wait_time = 15;
+    json_get_long(body, "t", &wait_time);
+    party->wait_time = wait_time;
+    party->version = 1;
+    num_parties++;
+    snprintf(reply, MAX_REPLY_LEN, "{\"e\":false,\"id\":%d}", party->id);
+  } else if (strcmp(path, "/mock/buzz") == 0 || strcmp(path, "/mock/seat") == 0) {
+    long id = 0;
+    json_get_long(body, "id", &id);
+    Party *party = find_party(id);
+    if (party != NULL && path[6] == 'b') party->is_buzzing = true;
+    if (party != NULL && path[6] == 's') party->is_seated = true;
+    if (party != NULL) party->version++;
+    snprintf(reply, MAX_REPLY_LEN, "{\"e\":%s}", party ? "false" : "true");
+  } else {
+    return 404;
+  }
+  return 200;
+}
+
+#endif
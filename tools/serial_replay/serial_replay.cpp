@@ -0,0 +1,505 @@
+/*
+  File:
+  serial_replay.cpp
+
+  Description:
+  Host-side (Linux) replay of a FONA serial capture. Runs the real firmware (buzzer.ino, the FSM,
+  the callbacks and the real FonaShield, with the other hardware drivers swapped for
+  ../fleet_sim/firmware_host.cpp) in virtual time against what a Buzzer built with SERIAL_LOG
+  recorded (see buzzer/SerialLog.h): the "log" serial command's output, pasted into a file as is.
+
+  The capture is split into sessions at its boot markers, and one session is replayed from setup()
+  on, with the EEPROM set to what the dump holds. The oldest session has usually lost its boot to
+  the ring by the time it is dumped. It is replayed from its oldest state marker instead: setup()
+  runs with the FONA not answering and what it sends thrown away, then the FSM is forced into the
+  recorded state and the FONA driver and loop()'s battery timing are set to what the marker holds.
+  The bytes the firmware sends have to be the
+  recorded ones, in the recorded order. The recorded replies are handed to it no earlier than they
+  came in the recording (relative to the entry before them), so a firmware that waits less than it
+  used to, or sends its next command before a reply it used to wait for, is caught too. The replay
+  stops at the first difference and says where, which is what to look at after changing FonaShield
+  or the FSM: a capture from the field that replays to the end still does what it did in the field.
+
+  Reports how long the session took when it was recorded and when replayed (virtual), the largest
+  difference in when an entry started, and the host CPU time.
+
+  Things the capture doesn't hold can make a replay go another way than the recording did: the
+  button, USB serial commands, and the EEPROM as it was when the session started (the dump has it as
+  it was when it was dumped; -b starts from a blank one instead). A replay from a state marker also
+  starts with empty link filters (see LinkMonitor.h), and with the globals the FSM states keep as
+  setup() left them.
+
+  Build and run:
+    make -C tools/serial_replay
+    tools/serial_replay/serial_replay [-s session] [-b] [-v] capture.txt
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "firmware_host.h"
+#include "SoftwareSerial.h"
+#include "Globals.h"
+
+// How long past when the next entry was due the replay waits (in ms) before giving up on it.
+#define REPLAY_SLACK_MS 60000
+
+// Longest piece of an entry shown in a message.
+#define SHOWN_BYTES 48
+
+struct Entry {
+  // '>' sent to the FONA, '<' read from it.
+  char dir;
+  // ms since the previous entry started.
+  unsigned long delta;
+  std::vector<uint8_t> bytes;
+  // When the entry started, in the recording and in the replay (-1 until it has).
+  unsigned long recorded_at;
+  long replayed_at;
+};
+
+// Where a session is replayed from: its boot, or its oldest SERIAL_LOG_STATE marker if the boot
+// has dropped out of the ring.
+struct Start {
+  bool is_boot;
+  // For a state marker: the state entered, the FONA driver then, and how long ago (in ms) loop()
+  // had last read the battery (FONA_STATE_NEVER if it hadn't).
+  int state_id;
+  FonaState fona;
+  unsigned long batt_update_age;
+};
+
+struct Session {
+  Start start;
+  std::vector<Entry> entries;
+  // ms the state markers since the entry before took up. Entries count from the marker before
+  // them, the replay from the entry before that.
+  unsigned long marker_ms;
+};
+
+static std::vector<Entry> entries;
+static uint8_t eeprom[SIM_EEPROM_LEN];
+static bool is_verbose = false;
+// Next entry (and byte in it) to be sent by the firmware and to be read by it. entries.size() once
+// there are no more.
+static size_t tx_entry = 0, tx_pos = 0;
+static size_t rx_entry = 0, rx_pos = 0;
+// What the firmware has sent of entries[tx_entry] so far.
+static std::string tx_sent;
+static unsigned long num_bytes = 0;
+// Virtual ms the replay starts at, after setup() when it starts from a state marker.
+static unsigned long start_ms = 0;
+// While setup() runs ahead of a state marker: nothing to read, and what is sent is thrown away.
+static bool is_priming = false;
+
+// Defined in ../fleet_sim/firmware_host.cpp.
+extern "C" {
+  void fw_begin(const SimHooks *hooks);
+  void fw_setup();
+  void fw_loop();
+  unsigned long fw_millis();
+  bool fw_is_reset();
+}
+
+/*
+ * @return the virtual ms since the replay started.
+*/
+
+static unsigned long replayMillis() {
+  return fw_millis() - start_ms;
+}
+
+/*
+ * @input some bytes.
+ * @input how many.
+ * @return them as text, non printable bytes escaped, cut short after SHOWN_BYTES.
+*/
+
+static std::string show(const uint8_t *bytes, size_t len) {
+  std::string text;
+  for (size_t i = 0; i < len && i < SHOWN_BYTES; i++) {
+    char buf[8];
+    if (bytes[i] == '\r') snprintf(buf, sizeof(buf), "\\r");
+    else if (bytes[i] == '\n') snprintf(buf, sizeof(buf), "\\n");
+    else if (bytes[i] < 0x20 || bytes[i] >= 0x7F) snprintf(buf, sizeof(buf), "\\x%02X", bytes[i]);
+    else snprintf(buf, sizeof(buf), "%c", bytes[i]);
+    text += buf;
+  }
+  if (len > SHOWN_BYTES) text += "...";
+  return text;
+}
+
+static std::string show(const Entry &entry) {
+  return std::string(1, entry.dir) + " " + show(entry.bytes.data(), entry.bytes.size());
+}
+
+/*
+ * @input an index into entries.
+ * @return the index of the first entry at or after it that goes the given way, entries.size() if
+ * there's none.
+*/
+
+static size_t nextEntry(size_t i, char dir) {
+  while (i < entries.size() && entries[i].dir != dir) i++;
+  return i;
+}
+
+/*
+ * @input an index into entries.
+ * @return when (virtual ms) the entry is due: its delta after the entry before it started, or
+ * -1 if that hasn't started yet.
+*/
+
+static long dueAt(size_t i) {
+  long prev_at = (i == 0) ? 0 : entries[i - 1].replayed_at;
+  if (prev_at < 0) return -1;
+  return prev_at + entries[i].delta;
+}
+
+/*
+ * Prints the outcome of the replay and exits.
+ *
+ * @input the exit status, 0 if the replay got to the end.
+*/
+
+static void finish(int status) {
+  unsigned long recorded_ms = entries.empty() ? 0 : entries.back().recorded_at;
+  long drift = 0;
+  size_t drift_entry = 0;
+  size_t num_replayed = 0;
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (entries[i].replayed_at < 0) continue;
+    num_replayed++;
+    long d = entries[i].replayed_at - (long) entries[i].recorded_at;
+    if (labs(d) > labs(drift)) {
+      drift = d;
+      drift_entry = i;
+    }
+  }
+  printf("Replayed %zu of %zu entries (%lu bytes)\n", num_replayed, entries.size(), num_bytes);
+  printf("Recorded (s): %.3f\n", recorded_ms / 1000.0);
+  printf("Replayed (s): %.3f\n", replayMillis() / 1000.0);
+  if (num_replayed > 0) {
+    printf("Largest drift (s): %+.3f at entry %zu (%s)\n", drift / 1000.0, drift_entry,
+           show(entries[drift_entry]).c_str());
+  }
+  printf("Host CPU (s): %.3f\n", (double) clock() / CLOCKS_PER_SEC);
+  exit(status);
+}
+
+/*
+ * Says where the replay went another way than the recording and exits.
+ *
+ * @input the entry it is about.
+ * @input what went differently.
+*/
+
+static void diverge(size_t i, const char *what) {
+  printf("Diverged at entry %zu, recorded at %.3f s, replay at %.3f s: %s\n", i,
+         entries[i].recorded_at / 1000.0, replayMillis() / 1000.0, what);
+  printf("  recorded: %s\n", show(entries[i]).c_str());
+  finish(1);
+}
+
+/*
+ * Marks an entry as started.
+*/
+
+static void startEntry(size_t i) {
+  entries[i].replayed_at = replayMillis();
+  if (is_verbose) printf("[%10.3f] %zu %s\n", replayMillis() / 1000.0, i, show(entries[i]).c_str());
+}
+
+/*
+ * Moves on once an entry is done, and finishes the replay once they all are.
+*/
+
+static void checkDone() {
+  if (tx_entry < entries.size() && tx_pos == entries[tx_entry].bytes.size()) {
+    tx_entry = nextEntry(tx_entry + 1, '>');
+    tx_pos = 0;
+    tx_sent.clear();
+  }
+  if (rx_entry < entries.size() && rx_pos == entries[rx_entry].bytes.size()) {
+    rx_entry = nextEntry(rx_entry + 1, '<');
+    rx_pos = 0;
+  }
+  if (tx_entry == entries.size() && rx_entry == entries.size()) {
+    printf("Replayed to the end\n");
+    finish(0);
+  }
+}
+
+/*
+ * Gives up if the firmware is well past when the next entry was due.
+*/
+
+static void checkStalled() {
+  size_t next = (tx_entry < rx_entry) ? tx_entry : rx_entry;
+  if (next == entries.size()) return;
+  long due_at = dueAt(next);
+  if (due_at < 0 || (long) replayMillis() - due_at <= REPLAY_SLACK_MS) return;
+  char what[64];
+  snprintf(what, sizeof(what), "nothing happened for %d s after it was due", REPLAY_SLACK_MS / 1000);
+  diverge(next, what);
+}
+
+// The recorded FONA.
+
+/*
+ * A reply is there once the entries before it have all started (the firmware has sent whatever
+ * it answers) and its delta has passed. Nothing being there lets virtual time move on, so the
+ * firmware's busy waits end.
+*/
+
+int SoftwareSerial::available() {
+  if (is_priming) {
+    delay(1);
+    return 0;
+  }
+  if (rx_entry < entries.size() && (tx_entry > rx_entry || tx_entry == entries.size())) {
+    long due_at = dueAt(rx_entry);
+    if (due_at >= 0 && (long) replayMillis() >= due_at) return entries[rx_entry].bytes.size() - rx_pos;
+  }
+  delay(1);
+  checkStalled();
+  return 0;
+}
+
+int SoftwareSerial::read() {
+  if (available() == 0) return -1;
+  if (rx_pos == 0) startEntry(rx_entry);
+  uint8_t c = entries[rx_entry].bytes[rx_pos++];
+  num_bytes++;
+  checkDone();
+  return c;
+}
+
+size_t SoftwareSerial::write(uint8_t c) {
+  if (is_priming) return 1;
+  if (tx_entry == entries.size()) {
+    uint8_t byte = c;
+    printf("Diverged after the last entry was sent: the firmware sent %s too\n", show(&byte, 1).c_str());
+    finish(1);
+  }
+  Entry &entry = entries[tx_entry];
+  if (tx_pos == 0) {
+    // The recorded replies before this went in before it was sent, so they have to be read by now.
+    if (rx_entry < tx_entry) {
+      char what[96];
+      snprintf(what, sizeof(what), "sent before reading entry %zu (%s)", rx_entry,
+               (dueAt(rx_entry) >= 0 && (long) replayMillis() >= dueAt(rx_entry)) ? "there, left unread" : "not due yet");
+      tx_sent.push_back(c);
+      printf("  sent: > %s\n", show((const uint8_t *) tx_sent.data(), tx_sent.size()).c_str());
+      diverge(tx_entry, what);
+    }
+  }
+  tx_sent.push_back(c);
+  if (c != entry.bytes[tx_pos]) {
+    printf("  sent: > %s\n", show((const uint8_t *) tx_sent.data(), tx_sent.size()).c_str());
+    char what[64];
+    snprintf(what, sizeof(what), "byte %zu is different", tx_pos);
+    diverge(tx_entry, what);
+  }
+  if (tx_pos == 0) startEntry(tx_entry);
+  tx_pos++;
+  num_bytes++;
+  checkDone();
+  return 1;
+}
+
+// Hooks. Requests go through FonaShield, so the HTTP hook is never used.
+
+static int http_hook(void *ctx, unsigned long now, const char *url, const char *body, char *reply,
+                     int reply_len, unsigned long *elapsed) {
+  *elapsed = 0;
+  return -1;
+}
+
+static void motor_hook(void *ctx, unsigned long now, bool is_on) {}
+
+static bool button_hook(void *ctx, unsigned long now) {
+  return false;
+}
+
+static void serial_hook(void *ctx, char c) {
+  if (is_verbose) putchar(c);
+}
+
+/*
+ * @input a string of hex digits.
+ * @input where to put the bytes.
+ * @return false if it isn't hex.
+*/
+
+static bool parseHex(const char *hex, std::vector<uint8_t> *bytes) {
+  size_t len = strlen(hex);
+  if (len % 2 != 0) return false;
+  for (size_t i = 0; i < len; i += 2) {
+    unsigned int b;
+    if (sscanf(hex + i, "%2x", &b) != 1) return false;
+    bytes->push_back(b);
+  }
+  return true;
+}
+
+/*
+ * @input an age from the capture in ms, -1 if it never happened.
+ * @return it as FonaState has it.
+*/
+
+static unsigned long parseAge(long age) {
+  return (age < 0) ? FONA_STATE_NEVER : age;
+}
+
+/*
+ * Reads the capture. If it holds more than one dump, the last one counts. Whatever came before
+ * the oldest marker left in the ring is dropped, there is nothing to replay it from.
+ *
+ * @input the file.
+ * @input the session to keep, 1 for the first, 0 for the last.
+ * @input whether to start from a blank EEPROM rather than the dumped one.
+ * @input where to put where the replay starts.
+ * @return false if the capture or the session can't be used.
+*/
+
+static bool readCapture(FILE *file, int session, bool is_blank_eeprom, Start *start) {
+  std::vector<std::string> lines;
+  char line[512];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (strcmp(line, "SERIAL LOG BEGIN") == 0) lines.clear();
+    else if (strcmp(line, "SERIAL LOG END") != 0) lines.push_back(line);
+  }
+  memset(eeprom, 0xFF, sizeof(eeprom));
+  std::vector<Session> sessions;
+  for (size_t i = 0; i < lines.size(); i++) {
+    const char *text = lines[i].c_str();
+    char kind;
+    unsigned long val;
+    char hex[512] = "";
+    int state_id, power_state, idle_power_state, is_gprs_up, batt_mv;
+    long batt_age, link_sample_age, batt_update_age;
+    if (sscanf(text, "%c %lx %511s", &kind, &val, hex) >= 2 && kind == 'E') {
+      std::vector<uint8_t> bytes;
+      if (!parseHex(hex, &bytes) || val + bytes.size() > SIM_EEPROM_LEN) return false;
+      if (!is_blank_eeprom) memcpy(eeprom + val, bytes.data(), bytes.size());
+    } else if (sscanf(text, "%c %lu %511s", &kind, &val, hex) >= 2 && kind == 'B') {
+      Session boot = {{true}, std::vector<Entry>(), 0};
+      sessions.push_back(boot);
+    } else if (sscanf(text, "%c %lu %d %d %d %d %d %ld %ld %ld", &kind, &val, &state_id, &power_state,
+                      &idle_power_state, &is_gprs_up, &batt_mv, &batt_age, &link_sample_age,
+                      &batt_update_age) == 10 && kind == 'S') {
+      if (sessions.empty()) {
+        Start marker = {false, state_id,
+                        {(unsigned char) power_state, (unsigned char) idle_power_state, is_gprs_up != 0,
+                         batt_mv, parseAge(batt_age), parseAge(link_sample_age)},
+                        parseAge(batt_update_age)};
+        Session truncated = {marker, std::vector<Entry>(), 0};
+        sessions.push_back(truncated);
+      } else {
+        sessions.back().marker_ms += val;
+      }
+    } else if (sscanf(text, "%c %lu %511s", &kind, &val, hex) == 3 && (kind == '>' || kind == '<')) {
+      Entry entry = {kind, val, std::vector<uint8_t>(), 0, -1};
+      if (!parseHex(hex, &entry.bytes)) return false;
+      if (sessions.empty()) continue;
+      entry.delta += sessions.back().marker_ms;
+      sessions.back().marker_ms = 0;
+      sessions.back().entries.push_back(entry);
+    }
+  }
+  if (sessions.empty()) {
+    fprintf(stderr, "No boot or state marker in the capture\n");
+    return false;
+  }
+  if (session == 0) session = sessions.size();
+  if (session < 1 || session > (int) sessions.size()) {
+    fprintf(stderr, "The capture has %zu sessions\n", sessions.size());
+    return false;
+  }
+  *start = sessions[session - 1].start;
+  entries = sessions[session - 1].entries;
+  unsigned long at = 0;
+  for (size_t i = 0; i < entries.size(); i++) {
+    at += entries[i].delta;
+    entries[i].recorded_at = at;
+  }
+  printf("Session %d of %zu: %zu entries", session, sessions.size(), entries.size());
+  if (start->is_boot) printf("\n");
+  else printf(", from state %d (its boot is no longer in the log)\n", start->state_id);
+  return !entries.empty();
+}
+
+/*
+ * Starts the firmware where a state marker says the recorded one was: setup() runs while the FONA
+ * doesn't answer, then the FSM is forced into the state, and the FONA driver and loop()'s battery
+ * timing are set to what they were.
+ *
+ * @input the state marker.
+*/
+
+static void startFromState(const Start &start) {
+  is_priming = true;
+  fw_setup();
+  is_priming = false;
+  buzzer_fsm.StartAt(start.state_id);
+  fona_shield.RestoreState(&start.fona);
+  last_batt_update = (start.batt_update_age == FONA_STATE_NEVER) ? 0 : fw_millis() - start.batt_update_age;
+  start_ms = fw_millis();
+}
+
+int main(int argc, char **argv) {
+  int session = 0;
+  bool is_blank_eeprom = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:bvh")) != -1) {
+    switch (opt) {
+      case 's': session = atoi(optarg); break;
+      case 'b': is_blank_eeprom = true; break;
+      case 'v': is_verbose = true; break;
+      default:
+        fprintf(stderr, "Usage: %s [-s session] [-b] [-v] capture.txt\n"
+                        "  -s  session to replay, 1 for the first (default: the last)\n"
+                        "  -b  start from a blank EEPROM rather than the dumped one\n"
+                        "  -v  print the entries as they go and echo the firmware's USB serial\n", argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "Usage: %s [-s session] [-b] [-v] capture.txt\n", argv[0]);
+    return 2;
+  }
+  FILE *file = fopen(argv[optind], "r");
+  if (file == NULL) {
+    perror(argv[optind]);
+    return 2;
+  }
+  Start start;
+  bool is_read = readCapture(file, session, is_blank_eeprom, &start);
+  fclose(file);
+  if (!is_read) {
+    fprintf(stderr, "Nothing to replay in %s\n", argv[optind]);
+    return 2;
+  }
+
+  rx_entry = nextEntry(0, '<');
+  tx_entry = nextEntry(0, '>');
+  static const SimHooks hooks = {NULL, eeprom, http_hook, motor_hook, button_hook, serial_hook};
+  fw_begin(&hooks);
+  if (start.is_boot) fw_setup();
+  else startFromState(start);
+  while (true) {
+    fw_loop();
+    // A reset starts a new session, and the capture has it as one.
+    if (fw_is_reset()) {
+      printf("Diverged: the firmware reset itself at %.3f s\n", replayMillis() / 1000.0);
+      finish(1);
+    }
+    checkStalled();
+  }
+}
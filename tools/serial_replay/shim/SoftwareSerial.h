@@ -0,0 +1,24 @@
+/*
+  File:
+  SoftwareSerial.h
+
+  Description:
+  Host stand-in for SoftwareSerial that talks to a recorded FONA instead of a real one. Found before
+  ../fleet_sim/shim/SoftwareSerial.h. What it does is in serial_replay.cpp.
+*/
+
+#ifndef SOFTWARESERIAL_H
+#define SOFTWARESERIAL_H
+
+#include <Arduino.h>
+
+class SoftwareSerial : public Stream {
+  public:
+    SoftwareSerial(uint8_t rx_pin, uint8_t tx_pin) {}
+    void begin(long baud) {}
+    int available();
+    int read();
+    size_t write(uint8_t c);
+};
+
+#endif